@@ -22,10 +22,9 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "gstcolorconv.h"
-#include <gst/gstnativebuffer.h>
 #include <gst/video/video.h>
 
-GST_DEBUG_CATEGORY_STATIC (colorconv_debug);
+GST_DEBUG_CATEGORY (colorconv_debug);
 #define GST_CAT_DEFAULT colorconv_debug
 
 #define gst_color_conv_debug_init(ignored_parameter)                                      \
@@ -33,20 +32,373 @@ GST_DEBUG_CATEGORY_STATIC (colorconv_debug);
 
 #define IS_NATIVE_CAPS(x) (strcmp(gst_structure_get_name (gst_caps_get_structure (x, 0)), GST_NATIVE_BUFFER_NAME) == 0)
 #define IS_NATIVE_STRUCTURE(x) (strcmp(gst_structure_get_name (x), GST_NATIVE_BUFFER_NAME) == 0)
+#if GST_CHECK_VERSION (1,0,0)
+/* See the native buffer contract above the pad templates. */
+#define IS_NATIVE_BUFFER(x) (gst_buffer_n_memory (x) == 1 \
+    && gst_buffer_get_size (x) == sizeof (buffer_handle_t))
+#else
+#define IS_NATIVE_BUFFER(x) GST_IS_NATIVE_BUFFER (x)
+#endif
+
+#define TRANSPOSED(orient) (((orient) & GST_COLOR_CONV_ORIENT_TRANSPOSE) != 0)
+#define ORIENTED_WIDTH(orient, w, h) (TRANSPOSED (orient) ? (h) : (w))
+#define ORIENTED_HEIGHT(orient, w, h) (TRANSPOSED (orient) ? (w) : (h))
 
 #define BACKEND "/usr/lib/gstcolorconv/libgstcolorconvqcom.so"
-#define BUFFER_LOCK_USAGE GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_OFTEN
+/* Overrides the conversion backend, the test suite uses a stub */
+#define BACKEND_ENV "COLORCONV_BACKEND"
+
+/*
+ * Input is only ever read. Ask for a cached mapping first and drop the
+ * hint if the probe finds the mapping uncached anyway, which spares the
+ * cache maintenance on every lock.
+ */
+#define READ_USAGE_CACHED GRALLOC_USAGE_SW_READ_OFTEN
+#define READ_USAGE_UNCACHED GRALLOC_USAGE_SW_READ_RARELY
+
+/*
+ * Bands of the first mapped frame timed to measure its read cost, spread
+ * over the frame so one cold or contended band does not decide it.
+ */
+#define READ_PROBE_BANDS 5
+#define READ_PROBE_BAND_SIZE (64 * 1024)
+#define PROBE_STRATEGY (1 << 0)
+#define PROBE_USAGE (1 << 1)
+
+#if GST_CHECK_VERSION (1,0,0)
+#define GST_COLOR_CONV_PARENT_EVENT(trans, event) \
+  GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event)
+#else
+#define GST_COLOR_CONV_PARENT_EVENT(trans, event) \
+  GST_BASE_TRANSFORM_CLASS (parent_class)->event (trans, event)
+#endif
+
+/*
+ * Returned by transform for frames handed to the stream, the push task
+ * pushes them. 0.10 drops the output buffer for it, on 1.x generate_output
+ * hands the base class nothing to push.
+ */
+#if GST_CHECK_VERSION (1,0,0)
+#define GST_COLOR_CONV_FLOW_QUEUED GST_FLOW_CUSTOM_SUCCESS_1
+#else
+#define GST_COLOR_CONV_FLOW_QUEUED GST_BASE_TRANSFORM_FLOW_DROPPED
+#endif
+
+#if GST_CHECK_VERSION (1,0,0)
+/*
+ * Returned by transform for an unchanged frame without a stream,
+ * generate_output swaps the output buffer for the last one.
+ */
+#define GST_COLOR_CONV_FLOW_REPEAT GST_FLOW_CUSTOM_SUCCESS_2
+#endif
+
+enum
+{
+  PROP_0,
+  PROP_RANGE,
+  PROP_OUTPUT_MEMORY,
+  PROP_TRACING,
+  PROP_TRACE_FILE,
+  PROP_KERNELS,
+  PROP_SCHEDULING,
+  PROP_CPU_THREADS,
+  PROP_FALLBACKS,
+  PROP_DECIMATION,
+  PROP_LOCK_USAGE,
+  PROP_READ_STRATEGY,
+  PROP_SHARED_SCHEDULER,
+  PROP_FRAMES_IN_FLIGHT,
+  PROP_ROTATION,
+  PROP_FLIP,
+  PROP_CAPTURE_FILE,
+  PROP_CAPTURE_FRAMES,
+  PROP_SKIP_UNCHANGED,
+  PROP_SKIPPED_FRAMES,
+  PROP_CHECKSUM_TIME,
+  PROP_LATENCY,
+  PROP_DEADLINE,
+  PROP_LATE_FRAMES,
+  PROP_READ_COST_THRESHOLD,
+  PROP_BOUNCE_READS,
+};
+
+enum
+{
+  SIGNAL_DUMP_TRACE,
+  SIGNAL_SNAPSHOT,
+  LAST_SIGNAL
+};
+
+#define DEFAULT_RANGE GST_COLOR_CONV_RANGE_NONE
+#define DEFAULT_ROTATION GST_COLOR_CONV_ROTATION_NONE
+#define DEFAULT_FLIP GST_COLOR_CONV_FLIP_NONE
+#define DEFAULT_OUTPUT_MEMORY GST_COLOR_CONV_OUTPUT_MEMORY_SYSTEM
+#define DEFAULT_TRACING FALSE
+#define DEFAULT_SCHEDULING GST_COLOR_CONV_SCHEDULING_VENDOR
+#define DEFAULT_CPU_THREADS 1
+#define DEFAULT_SHARED_SCHEDULER FALSE
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define DEFAULT_DECIMATION 1
+#define DEFAULT_LOCK_USAGE 0
+#define DEFAULT_READ_STRATEGY GST_COLOR_CONV_READ_STRATEGY_AUTO
+/* Mappings this many times slower to read than cache use bounce reads */
+#define DEFAULT_READ_COST_THRESHOLD 4.0
+#define DEFAULT_CAPTURE_FRAMES 300
+#define DEFAULT_SKIP_UNCHANGED GST_COLOR_CONV_SKIP_UNCHANGED_NONE
+#define DEFAULT_LATENCY 0
+#define DEFAULT_DEADLINE FALSE
+
+/* Sampled checksums read one GST_COLOR_CONV_CHECKSUM_BLOCK in this many */
+#define CHECKSUM_SAMPLE 8
+
+/*
+ * Latency reported is the worst of this many conversions after start,
+ * not counting the cold ones before them
+ */
+#define LATENCY_WARMUP_FRAMES 60
+
+/* Upstream custom event requesting snapshots, "frames" defaults to 1 */
+#define SNAPSHOT_EVENT "GstColorConvSnapshot"
+#define SNAPSHOT_MESSAGE "colorconv-snapshot"
+
+/* 5 stages per frame, enough for the last ~30 seconds at 60 fps */
+#define TRACE_CAPACITY 8192
+
+static guint gst_color_conv_signals[LAST_SIGNAL] = { 0 };
+
+#define GST_TYPE_COLOR_CONV_RANGE (gst_color_conv_range_get_type ())
+
+static GType
+gst_color_conv_range_get_type (void)
+{
+  static GType range_type = 0;
+  static const GEnumValue ranges[] = {
+    {GST_COLOR_CONV_RANGE_NONE, "Keep the decoder range", "none"},
+    {GST_COLOR_CONV_RANGE_FULL_TO_LIMITED, "Full range to limited range",
+        "full-to-limited"},
+    {GST_COLOR_CONV_RANGE_LIMITED_TO_FULL, "Limited range to full range",
+        "limited-to-full"},
+    {0, NULL, NULL},
+  };
+
+  if (!range_type) {
+    range_type = g_enum_register_static ("GstColorConvRange", ranges);
+  }
+
+  return range_type;
+}
+
+#define GST_TYPE_COLOR_CONV_ROTATION (gst_color_conv_rotation_get_type ())
+
+static GType
+gst_color_conv_rotation_get_type (void)
+{
+  static GType rotation_type = 0;
+  static const GEnumValue rotations[] = {
+    {GST_COLOR_CONV_ROTATION_NONE, "No rotation", "none"},
+    {GST_COLOR_CONV_ROTATION_90, "Rotate 90 degrees clockwise", "90"},
+    {GST_COLOR_CONV_ROTATION_180, "Rotate 180 degrees", "180"},
+    {GST_COLOR_CONV_ROTATION_270, "Rotate 90 degrees counterclockwise",
+        "270"},
+    {0, NULL, NULL},
+  };
+
+  if (!rotation_type) {
+    rotation_type = g_enum_register_static ("GstColorConvRotation", rotations);
+  }
+
+  return rotation_type;
+}
+
+#define GST_TYPE_COLOR_CONV_FLIP (gst_color_conv_flip_get_type ())
+
+static GType
+gst_color_conv_flip_get_type (void)
+{
+  static GType flip_type = 0;
+  static const GEnumValue flips[] = {
+    {GST_COLOR_CONV_FLIP_NONE, "No mirroring", "none"},
+    {GST_COLOR_CONV_FLIP_HORIZONTAL, "Mirror left to right", "horizontal"},
+    {GST_COLOR_CONV_FLIP_VERTICAL, "Mirror top to bottom", "vertical"},
+    {0, NULL, NULL},
+  };
+
+  if (!flip_type) {
+    flip_type = g_enum_register_static ("GstColorConvFlip", flips);
+  }
+
+  return flip_type;
+}
+
+#if !GST_CHECK_VERSION (1,0,0)
+#define GST_TYPE_COLOR_CONV_OUTPUT_MEMORY (gst_color_conv_output_memory_get_type ())
+
+static GType
+gst_color_conv_output_memory_get_type (void)
+{
+  static GType memory_type = 0;
+  static const GEnumValue memories[] = {
+    {GST_COLOR_CONV_OUTPUT_MEMORY_SYSTEM, "Private heap memory", "system"},
+    {GST_COLOR_CONV_OUTPUT_MEMORY_MEMFD,
+        "Sealed memfd regions that can be shared with other processes",
+        "memfd"},
+    {0, NULL, NULL},
+  };
+
+  if (!memory_type) {
+    memory_type = g_enum_register_static ("GstColorConvOutputMemory", memories);
+  }
+
+  return memory_type;
+}
+#endif
+
+#define GST_TYPE_COLOR_CONV_SCHEDULING (gst_color_conv_scheduling_get_type ())
+
+static GType
+gst_color_conv_scheduling_get_type (void)
+{
+  static GType scheduling_type = 0;
+  static const GEnumValue schedulings[] = {
+    {GST_COLOR_CONV_SCHEDULING_VENDOR,
+        "Vendor converter, CPU kernels only if it fails", "vendor"},
+    {GST_COLOR_CONV_SCHEDULING_CPU, "CPU kernels only", "cpu"},
+    {GST_COLOR_CONV_SCHEDULING_HYBRID,
+        "Split frames between the vendor converter and CPU threads",
+        "hybrid"},
+    {0, NULL, NULL},
+  };
+
+  if (!scheduling_type) {
+    scheduling_type =
+        g_enum_register_static ("GstColorConvScheduling", schedulings);
+  }
 
+  return scheduling_type;
+}
+
+#define GST_TYPE_COLOR_CONV_SKIP_UNCHANGED (gst_color_conv_skip_unchanged_get_type ())
+
+static GType
+gst_color_conv_skip_unchanged_get_type (void)
+{
+  static GType skip_type = 0;
+  static const GEnumValue skips[] = {
+    {GST_COLOR_CONV_SKIP_UNCHANGED_NONE, "Convert every frame", "none"},
+    {GST_COLOR_CONV_SKIP_UNCHANGED_SAMPLED,
+        "Compare a sample of the input, misses changes outside of it",
+        "sampled"},
+    {GST_COLOR_CONV_SKIP_UNCHANGED_FULL, "Compare the whole input", "full"},
+    {0, NULL, NULL},
+  };
+
+  if (!skip_type) {
+    skip_type = g_enum_register_static ("GstColorConvSkipUnchanged", skips);
+  }
+
+  return skip_type;
+}
+
+#define GST_TYPE_COLOR_CONV_READ_STRATEGY (gst_color_conv_read_strategy_get_type ())
+
+static GType
+gst_color_conv_read_strategy_get_type (void)
+{
+  static GType strategy_type = 0;
+  static const GEnumValue strategies[] = {
+    {GST_COLOR_CONV_READ_STRATEGY_AUTO,
+        "Pick from the read cost of the first frame", "auto"},
+    {GST_COLOR_CONV_READ_STRATEGY_DIRECT,
+        "Convert straight out of the mapped buffer", "direct"},
+    {GST_COLOR_CONV_READ_STRATEGY_BOUNCE,
+        "Stream bands of the mapped buffer through a cached bounce buffer",
+        "bounce"},
+    {0, NULL, NULL},
+  };
+
+  if (!strategy_type) {
+    strategy_type =
+        g_enum_register_static ("GstColorConvReadStrategy", strategies);
+  }
+
+  return strategy_type;
+}
+
+/*
+ * Orientation flags for rotating the output, then mirroring it. Mirroring
+ * a transposed frame swaps the axes the flags refer to.
+ */
+static guint
+gst_color_conv_orientation (GstColorConvRotation rotation,
+    GstColorConvFlip flip)
+{
+  static const guint rotations[] = {
+    0,
+    GST_COLOR_CONV_ORIENT_VFLIP | GST_COLOR_CONV_ORIENT_TRANSPOSE,
+    GST_COLOR_CONV_ORIENT_HFLIP | GST_COLOR_CONV_ORIENT_VFLIP,
+    GST_COLOR_CONV_ORIENT_HFLIP | GST_COLOR_CONV_ORIENT_TRANSPOSE,
+  };
+  guint orient = rotations[rotation];
+
+  if (flip == GST_COLOR_CONV_FLIP_HORIZONTAL) {
+    orient ^= TRANSPOSED (orient) ?
+        GST_COLOR_CONV_ORIENT_VFLIP : GST_COLOR_CONV_ORIENT_HFLIP;
+  } else if (flip == GST_COLOR_CONV_FLIP_VERTICAL) {
+    orient ^= TRANSPOSED (orient) ?
+        GST_COLOR_CONV_ORIENT_HFLIP : GST_COLOR_CONV_ORIENT_VFLIP;
+  }
+
+  return orient;
+}
+
+typedef struct
+{
+  GstBuffer *inbuf;
+  GstBuffer *outbuf;
+  int width;
+  int height;
+  guint64 frame;
+  gint64 submitted;
+  gboolean snapshot;
+  gboolean repeat;
+  gboolean ret;
+} GstColorConvJob;
+
+/* Output buffer mapped for writing */
+typedef struct
+{
+  GstBuffer *buffer;
+  guint8 *data;
+  GstColorConvPlanes planes;
+#if GST_CHECK_VERSION (1,0,0)
+  GstMapInfo map;
+#endif
+} GstColorConvFrame;
+
+#if GST_CHECK_VERSION (1,0,0)
+G_DEFINE_TYPE_WITH_CODE (GstColorConv, gst_color_conv, GST_TYPE_BASE_TRANSFORM,
+    gst_color_conv_debug_init (0));
+#define parent_class gst_color_conv_parent_class
+#else
 GST_BOILERPLATE_FULL (GstColorConv, gst_color_conv, GstBaseTransform,
     GST_TYPE_BASE_TRANSFORM, gst_color_conv_debug_init);
+#endif
 
+/*
+ * GST_NATIVE_BUFFER_NAME caps carry frames that stay in gralloc memory.
+ * On 0.10 every buffer is a GstNativeBuffer. On 1.x every buffer holds
+ * exactly one buffer_handle_t in a single memory, and the handle stays
+ * valid while the buffer lives. The planes are only ever reached by
+ * locking that handle. Input that does not look like this fails with a
+ * negotiation error before gralloc is handed anything.
+ */
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS (GST_NATIVE_BUFFER_NAME ","
         "framerate = (fraction) [ 0, MAX ], "
         "width = (int) [ 1, MAX ], " "height = (int) [ 1, MAX ] ;"
-        GST_VIDEO_CAPS_YUV ("{ I420 }")));
+        GST_COLOR_CONV_CAPS_I420));
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -55,28 +407,129 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
         "framerate = (fraction) [ 0, MAX ], "
         "width = (int) [ 1, MAX ], " "height = (int) [ 1, MAX ]"));
 
+static GstStaticPadTemplate native_template = GST_STATIC_PAD_TEMPLATE ("native",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_NATIVE_BUFFER_NAME ","
+        "framerate = (fraction) [ 0, MAX ], "
+        "width = (int) [ 1, MAX ], " "height = (int) [ 1, MAX ]"));
+
 static void gst_color_conv_finalize (GObject * object);
+#if GST_CHECK_VERSION (1,0,0)
+static GstPad *gst_color_conv_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+#else
+static GstPad *gst_color_conv_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name);
+#endif
+static void gst_color_conv_release_pad (GstElement * element, GstPad * pad);
+static void gst_color_conv_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_color_conv_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+#if GST_CHECK_VERSION (1,0,0)
+static GstCaps *gst_color_conv_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter);
+static gboolean gst_color_conv_get_unit_size (GstBaseTransform * trans,
+    GstCaps * caps, gsize * size);
+#else
 static GstCaps *gst_color_conv_transform_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps);
 static gboolean gst_color_conv_get_unit_size (GstBaseTransform * trans,
     GstCaps * caps, guint * size);
+#endif
 static gboolean gst_color_conv_set_caps (GstBaseTransform * trans,
     GstCaps * incaps, GstCaps * outcaps);
+static void gst_color_conv_apply_tuning (GstColorConv * conv);
+static void gst_color_conv_finish_tuning (GstColorConv * conv,
+    gboolean apply);
 static gboolean gst_color_conv_start (GstBaseTransform * trans);
 static gboolean gst_color_conv_stop (GstBaseTransform * trans);
+static gboolean gst_color_conv_src_event (GstBaseTransform * trans,
+    GstEvent * event);
+static gboolean gst_color_conv_event (GstBaseTransform * trans,
+    GstEvent * event);
 static GstFlowReturn gst_color_conv_transform (GstBaseTransform * trans,
     GstBuffer * inbuf, GstBuffer * outbuf);
+#if GST_CHECK_VERSION (1,0,0)
+static GstFlowReturn gst_color_conv_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf);
+static gboolean gst_color_conv_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query);
+static gboolean gst_color_conv_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+static GstCaps *gst_color_conv_fixate_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps);
+#else
 static GstFlowReturn gst_color_conv_prepare_output_buffer (GstBaseTransform *
     trans, GstBuffer * input, gint size, GstCaps * caps, GstBuffer ** buf);
-static gboolean gst_color_conv_accept_caps (GstBaseTransform * trans,
-    GstPadDirection direction, GstCaps * caps);
 static void gst_color_conv_fixate_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * othercaps);
+#endif
+static gboolean gst_color_conv_accept_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps);
 static void *gst_color_conv_get_buffer_data (GstColorConv * conv,
     GstBuffer * buffer, gboolean * was_locked);
 static gboolean gst_color_conv_unlock_buffer (GstColorConv * conv,
     GstBuffer * buffer, gboolean was_locked);
-static void gst_color_conv_copy_buffer (GstBuffer * buff, guint8 *data, int width, int height);
+#if GST_CHECK_VERSION (1,0,0)
+static GstFlowReturn gst_color_conv_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer);
+static gboolean gst_color_conv_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static gboolean gst_color_conv_src_activate (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active);
+static gboolean gst_color_conv_native_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static gboolean gst_color_conv_native_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static GstIterator *gst_color_conv_native_iterate_links (GstPad * pad,
+    GstObject * parent);
+#else
+static GstFlowReturn gst_color_conv_chain (GstPad * pad, GstBuffer * buffer);
+static gboolean gst_color_conv_src_query (GstPad * pad, GstQuery * query);
+static gboolean gst_color_conv_src_activate (GstPad * pad, gboolean active);
+static gboolean gst_color_conv_native_event (GstPad * pad, GstEvent * event);
+static gboolean gst_color_conv_native_query (GstPad * pad, GstQuery * query);
+static GstIterator *gst_color_conv_native_iterate_links (GstPad * pad);
+#endif
+static void gst_color_conv_update_latency (GstColorConv * conv,
+    gint64 latency);
+static GstClockTime gst_color_conv_reported_latency (GstColorConv * conv);
+static gboolean gst_color_conv_convert_frame (GstColorConv * conv,
+    GstBuffer * inbuf, GstBuffer * outbuf, int width, int height,
+    GstColorConvLane lane, guint64 frame);
+static gboolean gst_color_conv_submit_job (GstColorConv * conv,
+    GstBuffer * inbuf, GstBuffer * outbuf, gboolean snapshot);
+static void gst_color_conv_run_job (gpointer data, GstColorConvLane lane,
+    gpointer user_data);
+static void gst_color_conv_free_job (gpointer data);
+static void gst_color_conv_push_loop (GstColorConv * conv);
+static void gst_color_conv_start_pushing (GstColorConv * conv);
+static void gst_color_conv_stop_pushing (GstColorConv * conv);
+static gboolean gst_color_conv_checksum_input (GstColorConv * conv,
+    GstBuffer * inbuf, guint64 * checksum);
+static GstFlowReturn gst_color_conv_repeat_frame (GstColorConv * conv,
+    GstBuffer * outbuf);
+static GstBuffer *gst_color_conv_repeat_buffer (GstColorConv * conv,
+    GstBuffer * outbuf);
+static void gst_color_conv_forget_frame (GstColorConv * conv);
+static gboolean gst_color_conv_dump_trace (GstColorConv * conv,
+    const gchar * filename);
+static void gst_color_conv_snapshot (GstColorConv * conv, guint frames);
+static GstFlowReturn gst_color_conv_snapshot_frame (GstColorConv * conv,
+    GstBuffer * inbuf);
+static void gst_color_conv_snapshot_output (GstColorConv * conv,
+    GstBuffer * buffer);
+static void gst_color_conv_post_snapshot (GstColorConv * conv,
+    GstBuffer * buffer);
+static void gst_color_conv_capture_frame (GstColorConv * conv,
+    GstBuffer * buffer);
+static void gst_color_conv_stop_capture (GstColorConv * conv);
+static gboolean gst_color_conv_map_output (GstColorConv * conv,
+    GstBuffer * buffer, int width, int height, GstColorConvFrame * frame);
+static void gst_color_conv_unmap_output (GstColorConvFrame * frame);
+static GstPad *gst_color_conv_get_native_pad (GstColorConv * conv);
 
 static void
 gst_color_conv_base_init (gpointer gclass)
@@ -91,15 +544,22 @@ gst_color_conv_base_init (gpointer gclass)
 
   gst_element_class_add_static_pad_template (element_class, &src_template);
   gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &native_template);
 }
 
 static void
 gst_color_conv_class_init (GstColorConvClass * klass)
 {
   GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
   GstBaseTransformClass *trans_class = (GstBaseTransformClass *) klass;
 
   gobject_class->finalize = gst_color_conv_finalize;
+  gobject_class->set_property = gst_color_conv_set_property;
+  gobject_class->get_property = gst_color_conv_get_property;
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_color_conv_request_new_pad);
+  element_class->release_pad = GST_DEBUG_FUNCPTR (gst_color_conv_release_pad);
   trans_class->transform_caps =
       GST_DEBUG_FUNCPTR (gst_color_conv_transform_caps);
   trans_class->get_unit_size = GST_DEBUG_FUNCPTR (gst_color_conv_get_unit_size);
@@ -107,24 +567,346 @@ gst_color_conv_class_init (GstColorConvClass * klass)
   trans_class->start = GST_DEBUG_FUNCPTR (gst_color_conv_start);
   trans_class->stop = GST_DEBUG_FUNCPTR (gst_color_conv_stop);
   trans_class->transform = GST_DEBUG_FUNCPTR (gst_color_conv_transform);
+  trans_class->src_event = GST_DEBUG_FUNCPTR (gst_color_conv_src_event);
+#if GST_CHECK_VERSION (1,0,0)
+  trans_class->sink_event = GST_DEBUG_FUNCPTR (gst_color_conv_event);
+  trans_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_color_conv_generate_output);
+  trans_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_color_conv_decide_allocation);
+  trans_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_color_conv_propose_allocation);
+#else
+  trans_class->event = GST_DEBUG_FUNCPTR (gst_color_conv_event);
   trans_class->prepare_output_buffer =
       GST_DEBUG_FUNCPTR (gst_color_conv_prepare_output_buffer);
+#endif
   trans_class->accept_caps = GST_DEBUG_FUNCPTR (gst_color_conv_accept_caps);
   trans_class->fixate_caps = GST_DEBUG_FUNCPTR (gst_color_conv_fixate_caps);
+  trans_class->passthrough_on_same_caps = FALSE;
+
+#if GST_CHECK_VERSION (1,0,0)
+  /* No base_init in 1.x */
+  gst_color_conv_base_init (klass);
+#endif
+
+  g_object_class_install_property (gobject_class, PROP_RANGE,
+      g_param_spec_enum ("range", "Range",
+          "Quantization range remap applied while writing I420 output "
+          "(takes effect on the next caps negotiation)",
+          GST_TYPE_COLOR_CONV_RANGE, DEFAULT_RANGE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROTATION,
+      g_param_spec_enum ("rotation", "Rotation",
+          "Rotation applied while writing I420 output "
+          "(takes effect on the next caps negotiation)",
+          GST_TYPE_COLOR_CONV_ROTATION, DEFAULT_ROTATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FLIP,
+      g_param_spec_enum ("flip", "Flip",
+          "Mirroring applied to the rotated I420 output "
+          "(takes effect on the next caps negotiation)",
+          GST_TYPE_COLOR_CONV_FLIP, DEFAULT_FLIP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CAPTURE_FILE,
+      g_param_spec_string ("capture-file", "Capture file",
+          "Write the raw decoder frames to this file for colorconv-replay "
+          "(takes effect on the next start)",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CAPTURE_FRAMES,
+      g_param_spec_uint ("capture-frames", "Capture frames",
+          "Frames to capture, 0 for all of them "
+          "(takes effect on the next start)",
+          0, G_MAXUINT, DEFAULT_CAPTURE_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SKIP_UNCHANGED,
+      g_param_spec_enum ("skip-unchanged", "Skip unchanged",
+          "Push the last converted frame again instead of converting input "
+          "identical to the last one (takes effect on the next caps "
+          "negotiation)", GST_TYPE_COLOR_CONV_SKIP_UNCHANGED,
+          DEFAULT_SKIP_UNCHANGED, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SKIPPED_FRAMES,
+      g_param_spec_uint ("skipped-frames", "Skipped frames",
+          "Frames not converted because the input was unchanged",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CHECKSUM_TIME,
+      g_param_spec_uint64 ("checksum-time", "Checksum time",
+          "Microseconds spent checksumming input for skip-unchanged",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY,
+      g_param_spec_uint64 ("latency", "Latency",
+          "Conversion latency to report in nanoseconds, 0 to report the "
+          "worst of the first frames converted",
+          0, G_MAXUINT64, DEFAULT_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DEADLINE,
+      g_param_spec_boolean ("deadline", "Deadline",
+          "Drop frames unconverted when converting them would make them late",
+          DEFAULT_DEADLINE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATE_FRAMES,
+      g_param_spec_uint ("late-frames", "Late frames",
+          "Frames dropped because they would have missed their deadline",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+#if !GST_CHECK_VERSION (1,0,0)
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_MEMORY,
+      g_param_spec_enum ("output-memory", "Output memory",
+          "Memory backing the converted output buffers",
+          GST_TYPE_COLOR_CONV_OUTPUT_MEMORY, DEFAULT_OUTPUT_MEMORY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+#endif
+
+  g_object_class_install_property (gobject_class, PROP_TRACING,
+      g_param_spec_boolean ("tracing", "Tracing",
+          "Record per frame stage timings into a fixed size ring buffer",
+          DEFAULT_TRACING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TRACE_FILE,
+      g_param_spec_string ("trace-file", "Trace file",
+          "Chrome trace JSON file written on stop or on dump-trace",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KERNELS,
+      g_param_spec_string ("kernels", "Kernels",
+          "CPU kernels selected for this machine "
+          "(override with the COLORCONV_KERNELS environment variable)",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SCHEDULING,
+      g_param_spec_enum ("scheduling", "Scheduling",
+          "Where frames are converted (takes effect on the next start)",
+          GST_TYPE_COLOR_CONV_SCHEDULING, DEFAULT_SCHEDULING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CPU_THREADS,
+      g_param_spec_uint ("cpu-threads", "CPU threads",
+          "CPU threads next to the vendor converter in hybrid scheduling, "
+          "0 uses the autotuned count", 0, 64, DEFAULT_CPU_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHARED_SCHEDULER,
+      g_param_spec_boolean ("shared-scheduler", "Shared scheduler",
+          "Convert on a pool shared by every colorconv in the process, "
+          "ordered by buffer deadlines (takes effect on the next start)",
+          DEFAULT_SHARED_SCHEDULER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FRAMES_IN_FLIGHT,
+      g_param_spec_uint ("frames-in-flight", "Frames in flight",
+          "Frames converting or waiting for a lane at once with "
+          "shared-scheduler (takes effect on the next start)",
+          1, 64, DEFAULT_FRAMES_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FALLBACKS,
+      g_param_spec_uint ("fallbacks", "Fallbacks",
+          "Frames converted on the CPU because the vendor converter failed",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DECIMATION,
+      g_param_spec_uint ("decimation", "Decimation",
+          "Convert only every Nth frame, the native pad still gets all of "
+          "them (takes effect on the next caps negotiation)",
+          1, G_MAXUINT, DEFAULT_DECIMATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOCK_USAGE,
+      g_param_spec_uint ("lock-usage", "Lock usage",
+          "Gralloc usage flags for locking input buffers, 0 picks them from "
+          "the measured read cost (takes effect on the next start)",
+          0, G_MAXUINT, DEFAULT_LOCK_USAGE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_READ_STRATEGY,
+      g_param_spec_enum ("read-strategy", "Read strategy",
+          "How CPU kernels read input buffers (takes effect on the next "
+          "start)", GST_TYPE_COLOR_CONV_READ_STRATEGY, DEFAULT_READ_STRATEGY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_READ_COST_THRESHOLD,
+      g_param_spec_double ("read-cost-threshold", "Read cost threshold",
+          "With the auto read strategy, input reading at least this many "
+          "times slower than cache is read through a bounce buffer and locked "
+          "uncached (takes effect on the next start)", 0, G_MAXDOUBLE,
+          DEFAULT_READ_COST_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BOUNCE_READS,
+      g_param_spec_boolean ("bounce-reads", "Bounce reads",
+          "Whether the CPU kernels read input through a bounce buffer",
+          FALSE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstColorConv::dump-trace:
+   * @conv: the colorconv instance
+   * @filename: file to write, or NULL to use the trace-file property
+   *
+   * Writes the recorded frame timings in Chrome trace JSON format, which
+   * can be loaded in chrome://tracing or Perfetto.
+   */
+  gst_color_conv_signals[SIGNAL_DUMP_TRACE] =
+      g_signal_new ("dump-trace", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstColorConvClass, dump_trace), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 1, G_TYPE_STRING);
+
+  /**
+   * GstColorConv::snapshot:
+   * @conv: the colorconv instance
+   * @frames: number of frames to convert
+   *
+   * Converts the next @frames input frames to I420 and posts each one in a
+   * "colorconv-snapshot" element message, whatever the src pad pushes. When
+   * the src pad pushes I420 already the next @frames frames it pushes are
+   * posted as they are. The message carries a "sample" on 1.x and a
+   * "buffer" with caps on 0.10.
+   * Upstream elements can ask for the same with a custom upstream event
+   * named "GstColorConvSnapshot" holding an optional "frames" uint.
+   */
+  gst_color_conv_signals[SIGNAL_SNAPSHOT] =
+      g_signal_new ("snapshot", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstColorConvClass, snapshot), NULL, NULL, NULL,
+      G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  klass->dump_trace = gst_color_conv_dump_trace;
+  klass->snapshot = gst_color_conv_snapshot;
 }
 
 static void
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_init (GstColorConv * conv)
+#else
 gst_color_conv_init (GstColorConv * conv, GstColorConvClass * gclass)
+#endif
 {
   GstBaseTransform *trans = GST_BASE_TRANSFORM (conv);
 
   gst_base_transform_set_passthrough (trans, FALSE);
   gst_base_transform_set_in_place (trans, FALSE);
 
-  GST_BASE_TRANSFORM_CLASS (gclass)->passthrough_on_same_caps = FALSE;
-
   conv->backend = NULL;
   conv->mod = NULL;
+
+  conv->range = DEFAULT_RANGE;
+  conv->apply_luts = FALSE;
+
+  conv->rotation = DEFAULT_ROTATION;
+  conv->flip = DEFAULT_FLIP;
+  conv->orient = 0;
+
+  conv->width = 0;
+  conv->height = 0;
+
+#if GST_CHECK_VERSION (1,0,0)
+  conv->gralloc = NULL;
+  gst_video_info_init (&conv->out_info);
+  conv->in_flight = 0;
+#else
+  conv->output_memory = DEFAULT_OUTPUT_MEMORY;
+  conv->fd_pool = NULL;
+  conv->fd_failed = FALSE;
+#endif
+
+  conv->kernels = gst_color_conv_kernels_get ();
+  GST_INFO_OBJECT (conv, "using %s kernels", conv->kernels->name);
+
+  conv->tracing = DEFAULT_TRACING;
+  conv->trace_file = NULL;
+  conv->trace = NULL;
+  conv->trace_frame = 0;
+  conv->trace_push_start = 0;
+
+  conv->hal_format = 0;
+  conv->scheduling = DEFAULT_SCHEDULING;
+  conv->cpu_threads = DEFAULT_CPU_THREADS;
+  conv->shared_scheduler = DEFAULT_SHARED_SCHEDULER;
+  conv->frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+  conv->lane = GST_COLOR_CONV_LANE_VENDOR;
+  conv->fallbacks = 0;
+
+  conv->lock_usage = DEFAULT_LOCK_USAGE;
+  conv->read_strategy = DEFAULT_READ_STRATEGY;
+  conv->read_cost_threshold = DEFAULT_READ_COST_THRESHOLD;
+  conv->cur_lock_usage = READ_USAGE_CACHED;
+  conv->bounce = FALSE;
+  conv->bounce_pool = NULL;
+  conv->scratch_pool = NULL;
+  conv->read_probe = 0;
+
+  conv->tune_cache = NULL;
+  conv->tune = FALSE;
+  conv->auto_threads = FALSE;
+  conv->tune_thread = NULL;
+  conv->tuned = FALSE;
+
+  conv->native_pad = NULL;
+  conv->decimation = DEFAULT_DECIMATION;
+  conv->cur_decimation = 1;
+  conv->decimation_count = 0;
+
+  conv->skip_unchanged = DEFAULT_SKIP_UNCHANGED;
+  conv->checksum_sample = 0;
+  conv->checksum_valid = FALSE;
+  conv->checksum = 0;
+  conv->last_out = NULL;
+  conv->skipped_frames = 0;
+  conv->checksum_time = 0;
+#if !GST_CHECK_VERSION (1,0,0)
+  conv->input_checksummed = FALSE;
+#endif
+
+  conv->latency = DEFAULT_LATENCY;
+  conv->measured_latency = 0;
+  conv->latency_frames = 0;
+  conv->frame_duration = GST_CLOCK_TIME_NONE;
+  conv->pipeline_latency = 0;
+  conv->queue_depth = 0;
+  conv->deadline = DEFAULT_DEADLINE;
+  conv->late_frames = 0;
+
+  conv->snapshot_frames = 0;
+  conv->snapshot_output = FALSE;
+
+  conv->capture_file = NULL;
+  conv->capture_frames = DEFAULT_CAPTURE_FRAMES;
+  conv->cur_capture_frames = 0;
+  conv->capture = NULL;
+
+  conv->stream = NULL;
+  conv->push_ret = GST_FLOW_OK;
+  conv->push_discont = FALSE;
+
+  /* Wrap the chain function so we can time pushing downstream. */
+  conv->base_chain = GST_PAD_CHAINFUNC (trans->sinkpad);
+  gst_pad_set_chain_function (trans->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_color_conv_chain));
+
+  /* And the source pad query one to add our latency to upstream's. */
+  conv->base_src_query = GST_PAD_QUERYFUNC (trans->srcpad);
+  gst_pad_set_query_function (trans->srcpad,
+      GST_DEBUG_FUNCPTR (gst_color_conv_src_query));
+
+  /* The push task has to stop before the src pad deactivates. */
+#if GST_CHECK_VERSION (1,0,0)
+  conv->base_src_activate = GST_PAD_ACTIVATEMODEFUNC (trans->srcpad);
+  gst_pad_set_activatemode_function (trans->srcpad,
+      GST_DEBUG_FUNCPTR (gst_color_conv_src_activate));
+#else
+  conv->base_src_activate = GST_PAD_ACTIVATEPUSHFUNC (trans->srcpad);
+  gst_pad_set_activatepush_function (trans->srcpad,
+      GST_DEBUG_FUNCPTR (gst_color_conv_src_activate));
+#endif
 }
 
 static void
@@ -149,494 +931,3176 @@ gst_color_conv_finalize (GObject * object)
     conv->mod = NULL;
   }
 
+#if !GST_CHECK_VERSION (1,0,0)
+  if (conv->fd_pool) {
+    gst_color_conv_fd_pool_destroy (conv->fd_pool);
+    conv->fd_pool = NULL;
+  }
+#endif
+
+  if (conv->trace) {
+    gst_color_conv_trace_free (conv->trace);
+    conv->trace = NULL;
+  }
+
+  g_free (conv->trace_file);
+  conv->trace_file = NULL;
+
+  g_free (conv->capture_file);
+  conv->capture_file = NULL;
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
-static GstCaps *
-gst_color_conv_transform_caps (GstBaseTransform * trans,
-    GstPadDirection direction, GstCaps * caps)
+static void
+gst_color_conv_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
 {
-  int x;
-  int len;
-  GstColorConv *conv = GST_COLOR_CONV (trans);
-  GstCaps *out_caps = NULL;
+  GstColorConv *conv = GST_COLOR_CONV (object);
 
-  GST_DEBUG_OBJECT (conv, "transform caps %" GST_PTR_FORMAT, caps);
+  switch (prop_id) {
+    case PROP_RANGE:
+      GST_OBJECT_LOCK (conv);
+      conv->range = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  switch (direction) {
-    case GST_PAD_SRC:
-      out_caps = gst_caps_make_writable (gst_static_pad_template_get_caps
-          (&sink_template));
+    case PROP_ROTATION:
+      GST_OBJECT_LOCK (conv);
+      conv->rotation = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (conv);
       break;
 
-    case GST_PAD_SINK:
-      out_caps = gst_caps_make_writable (gst_static_pad_template_get_caps
-          (&src_template));
+    case PROP_FLIP:
+      GST_OBJECT_LOCK (conv);
+      conv->flip = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (conv);
       break;
 
-    default:
-      GST_WARNING_OBJECT (conv, "unknown pad direction %i", direction);
-      return NULL;
-  }
+    case PROP_CAPTURE_FILE:
+      GST_OBJECT_LOCK (conv);
+      g_free (conv->capture_file);
+      conv->capture_file = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  if (!conv->backend) {
-    GST_DEBUG_OBJECT (conv, "no backend loaded");
+    case PROP_CAPTURE_FRAMES:
+      GST_OBJECT_LOCK (conv);
+      conv->capture_frames = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-    return out_caps;
-  }
+    case PROP_SKIP_UNCHANGED:
+      GST_OBJECT_LOCK (conv);
+      conv->skip_unchanged = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  len = gst_caps_get_size (out_caps);
+    case PROP_LATENCY:
+      GST_OBJECT_LOCK (conv);
+      conv->latency = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  for (x = 0; x < len; x++) {
-    GstStructure *s = gst_caps_get_structure (out_caps, x);
-    if (IS_NATIVE_STRUCTURE (s)) {
-      gst_structure_set (s, "format", G_TYPE_INT,
-          conv->backend->get_hal_format (conv->backend->handle), NULL);
-    }
-  }
+    case PROP_DEADLINE:
+      g_atomic_int_set (&conv->deadline, g_value_get_boolean (value));
+      break;
 
-  GST_LOG_OBJECT (conv, "returning caps %" GST_PTR_FORMAT, out_caps);
+#if !GST_CHECK_VERSION (1,0,0)
+    case PROP_OUTPUT_MEMORY:
+      GST_OBJECT_LOCK (conv);
+      conv->output_memory = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+#endif
 
-  return out_caps;
-}
+    case PROP_TRACING:
+      GST_OBJECT_LOCK (conv);
+      /* The ring is allocated once and kept so recording never allocates. */
+      if (g_value_get_boolean (value) && !conv->trace) {
+        conv->trace = gst_color_conv_trace_new (TRACE_CAPACITY);
+      }
+      g_atomic_int_set (&conv->tracing, g_value_get_boolean (value));
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-static gboolean
-gst_color_conv_get_unit_size (GstBaseTransform * trans,
-    GstCaps * caps, guint * size)
-{
-  int width;
-  int height;
-  GstVideoFormat fmt;
+    case PROP_TRACE_FILE:
+      GST_OBJECT_LOCK (conv);
+      g_free (conv->trace_file);
+      conv->trace_file = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  GST_DEBUG_OBJECT (trans, "get unit size");
+    case PROP_SCHEDULING:
+      GST_OBJECT_LOCK (conv);
+      conv->scheduling = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  if (IS_NATIVE_CAPS (caps)) {
-    *size = sizeof (buffer_handle_t);
-    return TRUE;
-  }
+    case PROP_CPU_THREADS:
+      GST_OBJECT_LOCK (conv);
+      conv->cpu_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  if (!gst_video_format_parse_caps (caps, &fmt, &width, &height)) {
-    GST_WARNING_OBJECT (trans, "failed to parse caps %" GST_PTR_FORMAT, caps);
-    return FALSE;
-  }
+    case PROP_SHARED_SCHEDULER:
+      GST_OBJECT_LOCK (conv);
+      conv->shared_scheduler = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  *size = gst_video_format_get_size (fmt, width, height);
+    case PROP_FRAMES_IN_FLIGHT:
+      GST_OBJECT_LOCK (conv);
+      conv->frames_in_flight = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  return TRUE;
-}
+    case PROP_DECIMATION:
+      GST_OBJECT_LOCK (conv);
+      conv->decimation = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-static gboolean
-gst_color_conv_set_caps (GstBaseTransform * trans,
-    GstCaps * incaps, GstCaps * outcaps)
-{
-  GST_DEBUG_OBJECT (trans, "set caps");
-  GST_LOG_OBJECT (trans, "in %" GST_PTR_FORMAT, incaps);
-  GST_LOG_OBJECT (trans, "out %" GST_PTR_FORMAT, outcaps);
+    case PROP_LOCK_USAGE:
+      GST_OBJECT_LOCK (conv);
+      conv->lock_usage = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
+    case PROP_READ_STRATEGY:
+      GST_OBJECT_LOCK (conv);
+      conv->read_strategy = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  // TODO:
+    case PROP_READ_COST_THRESHOLD:
+      GST_OBJECT_LOCK (conv);
+      conv->read_cost_threshold = g_value_get_double (value);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  return TRUE;
-}
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
 
-static gboolean
-gst_color_conv_start (GstBaseTransform * trans)
+static void
+gst_color_conv_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
 {
-  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstColorConv *conv = GST_COLOR_CONV (object);
+  const GstColorConvKernels *kernels;
 
-  GST_DEBUG_OBJECT (conv, "start");
+  switch (prop_id) {
+    case PROP_RANGE:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_enum (value, conv->range);
+      GST_OBJECT_UNLOCK (conv);
+      break;
 
-  if (!conv->mod) {
-    conv->mod =
-        g_module_open (BACKEND, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+    case PROP_ROTATION:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_enum (value, conv->rotation);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_FLIP:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_enum (value, conv->flip);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_CAPTURE_FILE:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_string (value, conv->capture_file);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_CAPTURE_FRAMES:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_uint (value, conv->capture_frames);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_SKIP_UNCHANGED:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_enum (value, conv->skip_unchanged);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_SKIPPED_FRAMES:
+      g_value_set_uint (value, g_atomic_int_get (&conv->skipped_frames));
+      break;
+
+    case PROP_CHECKSUM_TIME:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_uint64 (value, conv->checksum_time);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_LATENCY:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_uint64 (value, conv->latency);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_DEADLINE:
+      g_value_set_boolean (value, g_atomic_int_get (&conv->deadline));
+      break;
+
+    case PROP_LATE_FRAMES:
+      g_value_set_uint (value, g_atomic_int_get (&conv->late_frames));
+      break;
+
+#if !GST_CHECK_VERSION (1,0,0)
+    case PROP_OUTPUT_MEMORY:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_enum (value, conv->output_memory);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+#endif
+
+    case PROP_TRACING:
+      g_value_set_boolean (value, g_atomic_int_get (&conv->tracing));
+      break;
+
+    case PROP_TRACE_FILE:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_string (value, conv->trace_file);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_KERNELS:
+      kernels = g_atomic_pointer_get (&conv->kernels);
+      g_value_set_string (value, kernels->name);
+      break;
+
+    case PROP_SCHEDULING:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_enum (value, conv->scheduling);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_CPU_THREADS:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_uint (value, conv->cpu_threads);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_SHARED_SCHEDULER:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_boolean (value, conv->shared_scheduler);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_FRAMES_IN_FLIGHT:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_uint (value, conv->frames_in_flight);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_FALLBACKS:
+      g_value_set_uint (value, g_atomic_int_get (&conv->fallbacks));
+      break;
+
+    case PROP_DECIMATION:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_uint (value, conv->decimation);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_LOCK_USAGE:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_uint (value, conv->lock_usage);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_READ_STRATEGY:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_enum (value, conv->read_strategy);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_READ_COST_THRESHOLD:
+      GST_OBJECT_LOCK (conv);
+      g_value_set_double (value, conv->read_cost_threshold);
+      GST_OBJECT_UNLOCK (conv);
+      break;
+
+    case PROP_BOUNCE_READS:
+      g_value_set_boolean (value, g_atomic_int_get (&conv->bounce));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
   }
+}
 
-  if (!conv->mod) {
-    GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
-        ("Failed to load conversion backend: %s", g_module_error ()), (NULL));
-    return FALSE;
+static GstCaps *
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter)
+#else
+gst_color_conv_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps)
+#endif
+{
+  int x;
+  int len;
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstCaps *out_caps = NULL;
+
+  GST_DEBUG_OBJECT (conv, "transform caps %" GST_PTR_FORMAT, caps);
+
+  switch (direction) {
+    case GST_PAD_SRC:
+      out_caps = gst_caps_make_writable (gst_static_pad_template_get_caps
+          (&sink_template));
+      break;
+
+    case GST_PAD_SINK:
+      out_caps = gst_caps_make_writable (gst_static_pad_template_get_caps
+          (&src_template));
+      break;
+
+    default:
+      GST_WARNING_OBJECT (conv, "unknown pad direction %i", direction);
+      return NULL;
   }
 
   if (!conv->backend) {
-    _gst_color_conv_backend_get sym;
+    GST_DEBUG_OBJECT (conv, "no backend loaded");
+  } else {
+    len = gst_caps_get_size (out_caps);
 
-    if (!g_module_symbol (conv->mod, BACKEND_SYMBOL_NAME, (gpointer *) & sym)) {
-      GST_ELEMENT_ERROR (conv, LIBRARY, INIT, ("Invalid conversion backend: %s",
-              g_module_error ()), (NULL));
-      return FALSE;
+    for (x = 0; x < len; x++) {
+      GstStructure *s = gst_caps_get_structure (out_caps, x);
+      if (IS_NATIVE_STRUCTURE (s)) {
+        gst_structure_set (s, "format", G_TYPE_INT,
+            conv->backend->get_hal_format (conv->backend->handle), NULL);
+      }
     }
+  }
 
-    conv->backend = g_malloc (sizeof (GstColorConvBackend));
+#if GST_CHECK_VERSION (1,0,0)
+  if (filter) {
+    GstCaps *tmp = gst_caps_intersect_full (filter, out_caps,
+        GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (out_caps);
+    out_caps = tmp;
+  }
+#endif
 
-    if (!sym (conv->backend)) {
-      GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
-          ("Failed to initialize conversion backend"), (NULL));
-      return FALSE;
-    }
+  GST_LOG_OBJECT (conv, "returning caps %" GST_PTR_FORMAT, out_caps);
+
+  return out_caps;
+}
+
+static gboolean
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_get_unit_size (GstBaseTransform * trans,
+    GstCaps * caps, gsize * size)
+#else
+gst_color_conv_get_unit_size (GstBaseTransform * trans,
+    GstCaps * caps, guint * size)
+#endif
+{
+#if GST_CHECK_VERSION (1,0,0)
+  GstVideoInfo info;
+#else
+  int width;
+  int height;
+  GstVideoFormat fmt;
+#endif
+
+  GST_DEBUG_OBJECT (trans, "get unit size");
+
+  if (IS_NATIVE_CAPS (caps)) {
+    *size = sizeof (buffer_handle_t);
+    return TRUE;
   }
 
-  if (!conv->backend->start (conv->backend->handle)) {
-    GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
-        ("Failed to start conversion backend"), (NULL));
+#if GST_CHECK_VERSION (1,0,0)
+  if (!gst_video_info_from_caps (&info, caps)) {
+    GST_WARNING_OBJECT (trans, "failed to parse caps %" GST_PTR_FORMAT, caps);
     return FALSE;
   }
 
+  *size = GST_VIDEO_INFO_SIZE (&info);
+#else
+  if (!gst_video_format_parse_caps (caps, &fmt, &width, &height)) {
+    GST_WARNING_OBJECT (trans, "failed to parse caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  *size = gst_video_format_get_size (fmt, width, height);
+#endif
+
   return TRUE;
 }
 
+/*
+ * Allocates a bounce buffer for the negotiated size for every conversion
+ * that can run at once. Called with the stream drained.
+ */
+static void
+gst_color_conv_alloc_bounce (GstColorConv * conv)
+{
+  gsize size = gst_color_conv_bounce_size (conv->hal_format, conv->width,
+      GST_COLOR_CONV_BAND_ROWS);
+  guint count;
+
+  GST_OBJECT_LOCK (conv);
+  count = conv->stream ? conv->queue_depth : 1;
+  GST_OBJECT_UNLOCK (conv);
+
+  conv->bounce_pool = g_async_queue_new_full (g_free);
+  while (count--) {
+    g_async_queue_push (conv->bounce_pool, g_malloc (size));
+  }
+}
+
+static void
+gst_color_conv_free_bounce (GstColorConv * conv)
+{
+  if (conv->bounce_pool) {
+    g_async_queue_unref (conv->bounce_pool);
+    conv->bounce_pool = NULL;
+  }
+}
+
+static void
+gst_color_conv_free_scratch (GstColorConv * conv)
+{
+  if (conv->scratch_pool) {
+    g_async_queue_unref (conv->scratch_pool);
+    conv->scratch_pool = NULL;
+  }
+}
+
 static gboolean
-gst_color_conv_stop (GstBaseTransform * trans)
+gst_color_conv_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps)
 {
   GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstColorConvRange range;
+  GstColorConvSkipUnchanged skip_unchanged;
+  GstStructure *s;
+  GstClockTime frame_duration = GST_CLOCK_TIME_NONE;
+  int fps_n;
+  int fps_d;
+  int out_width;
+  int out_height;
 
-  GST_DEBUG_OBJECT (conv, "stop");
+  GST_DEBUG_OBJECT (trans, "set caps");
+  GST_LOG_OBJECT (trans, "in %" GST_PTR_FORMAT, incaps);
+  GST_LOG_OBJECT (trans, "out %" GST_PTR_FORMAT, outcaps);
 
-  if (conv->backend) {
-    if (!conv->backend->stop (conv->backend->handle)) {
-      GST_ELEMENT_ERROR (conv, LIBRARY, SHUTDOWN,
-          ("Failed to stop conversion backend"), (NULL));
+  /* Frames in flight still read the state below. */
+  if (conv->stream) {
+    gst_color_conv_stream_drain (conv->stream);
+  }
+
+  s = gst_caps_get_structure (incaps, 0);
+
+  if (!gst_structure_get_int (s, "width", &conv->width)) {
+    GST_ELEMENT_ERROR (conv, STREAM, FORMAT, ("failed to get width"), (NULL));
+    return FALSE;
+  }
+
+  if (!gst_structure_get_int (s, "height", &conv->height)) {
+    GST_ELEMENT_ERROR (conv, STREAM, FORMAT, ("failed to get height"), (NULL));
+    return FALSE;
+  }
+
+  if (gst_structure_get_fraction (s, "framerate", &fps_n, &fps_d)
+      && fps_n > 0) {
+    frame_duration = gst_util_uint64_scale_int (GST_SECOND, fps_d, fps_n);
+  }
+
+#if GST_CHECK_VERSION (1,0,0)
+  /* Native output is pushed as it is. */
+  gst_base_transform_set_passthrough (trans, IS_NATIVE_CAPS (outcaps));
+
+  if (!IS_NATIVE_CAPS (outcaps)
+      && !gst_video_info_from_caps (&conv->out_info, outcaps)) {
+    GST_WARNING_OBJECT (conv, "failed to parse caps %" GST_PTR_FORMAT, outcaps);
+    return FALSE;
+  }
+#endif
+
+  GST_OBJECT_LOCK (conv);
+  range = conv->range;
+  skip_unchanged = IS_NATIVE_CAPS (outcaps) ? GST_COLOR_CONV_SKIP_UNCHANGED_NONE
+      : conv->skip_unchanged;
+#if !GST_CHECK_VERSION (1,0,0)
+  /* Sub-buffers sharing the last frame would not carry its memfd. */
+  if (conv->output_memory == GST_COLOR_CONV_OUTPUT_MEMORY_MEMFD) {
+    skip_unchanged = GST_COLOR_CONV_SKIP_UNCHANGED_NONE;
+  }
+#endif
+  conv->cur_decimation = IS_NATIVE_CAPS (outcaps) ? 1 : conv->decimation;
+  conv->orient = IS_NATIVE_CAPS (outcaps) ? 0 :
+      gst_color_conv_orientation (conv->rotation, conv->flip);
+  conv->snapshot_output = !IS_NATIVE_CAPS (outcaps);
+  conv->frame_duration = frame_duration;
+  GST_OBJECT_UNLOCK (conv);
+
+  if (!IS_NATIVE_CAPS (outcaps)) {
+    s = gst_caps_get_structure (outcaps, 0);
+
+    if (!gst_structure_get_int (s, "width", &out_width)
+        || !gst_structure_get_int (s, "height", &out_height)
+        || out_width != ORIENTED_WIDTH (conv->orient, conv->width,
+            conv->height)
+        || out_height != ORIENTED_HEIGHT (conv->orient, conv->width,
+            conv->height)) {
+      GST_WARNING_OBJECT (conv, "output size does not match the rotation");
       return FALSE;
     }
   }
 
+  conv->decimation_count = 0;
+
+  /* Frames of the old caps are no reference for the new ones. */
+  gst_color_conv_forget_frame (conv);
+  conv->layout_probed = FALSE;
+  conv->checksum_sample = 0;
+  if (skip_unchanged != GST_COLOR_CONV_SKIP_UNCHANGED_NONE) {
+    if (!gst_color_conv_input_size (conv->hal_format, conv->width,
+            conv->height)) {
+      GST_WARNING_OBJECT (conv, "cannot checksum format 0x%x, converting "
+          "every frame", conv->hal_format);
+    } else {
+      conv->checksum_sample =
+          skip_unchanged == GST_COLOR_CONV_SKIP_UNCHANGED_SAMPLED ?
+          CHECKSUM_SAMPLE : 1;
+    }
+  }
+
+  /* A size still being measured is kept for when it comes back. */
+  gst_color_conv_finish_tuning (conv, FALSE);
+  if (conv->tune && !IS_NATIVE_CAPS (outcaps)) {
+    gst_color_conv_apply_tuning (conv);
+  }
+
+  gst_color_conv_free_bounce (conv);
+  if (!IS_NATIVE_CAPS (outcaps)
+      && gst_color_conv_can_convert (conv->hal_format)) {
+    gst_color_conv_alloc_bounce (conv);
+  }
+
+  /*
+   * Scratch frames are only allocated once a frame needs one, there are
+   * never more than conversions that ran at once. Snapshots of native
+   * output need them as well.
+   */
+  gst_color_conv_free_scratch (conv);
+  conv->scratch_pool = g_async_queue_new_full (g_free);
+
+  /*
+   * Range remap tables are built once here and used by the repack loop,
+   * which only snapshots run with native output.
+   */
+  conv->apply_luts = range != GST_COLOR_CONV_RANGE_NONE;
+  if (conv->apply_luts) {
+    GST_DEBUG_OBJECT (conv, "building range tables for mode %d", range);
+    gst_color_conv_range_build_luts (range, conv->luts);
+  }
+
   return TRUE;
 }
 
-static GstFlowReturn
-gst_color_conv_transform (GstBaseTransform * trans,
-    GstBuffer * inbuf, GstBuffer * outbuf)
+/* Switches to tuned kernels and thread count, with the stream drained. */
+static void
+gst_color_conv_use_tuning (GstColorConv * conv,
+    const GstColorConvTuning * tuning)
 {
-  void *in_data;
-  void *out_data;
-  gboolean in_locked;
-  int width;
-  int height;
-  GstStructure *s;
-  gboolean ret;
-  gboolean copy_buffer;
-  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GST_INFO_OBJECT (conv, "using %s kernels, %u threads",
+      tuning->kernels->name, tuning->threads);
 
-  GST_DEBUG_OBJECT (conv, "transform");
+  if (!gst_color_conv_kernels_forced ()) {
+    g_atomic_pointer_set (&conv->kernels, tuning->kernels);
+  }
 
-  if (!GST_IS_NATIVE_BUFFER (inbuf)) {
-    GST_ELEMENT_ERROR (conv, STREAM, FAILED,
-        ("input buffer is not a native buffer"), (NULL));
-    return GST_FLOW_ERROR;
+  if (conv->stream && conv->auto_threads) {
+    gst_color_conv_stream_set_max_jobs (conv->stream, tuning->threads + 1);
+
+    GST_OBJECT_LOCK (conv);
+    conv->queue_depth = tuning->threads + 1;
+    GST_OBJECT_UNLOCK (conv);
   }
+}
 
-  if (IS_NATIVE_CAPS (outbuf->caps)) {
-    /* We are pushing the buffer as it is. */
-    GST_DEBUG_OBJECT (conv, "shortcutting native buffer");
-    return GST_FLOW_OK;
+/*
+ * Measures the size set up by gst_color_conv_apply_tuning () and saves it
+ * to the cache file, off the streaming thread.
+ */
+static gpointer
+gst_color_conv_tune_thread (gpointer data)
+{
+  GstColorConv *conv = data;
+  GstColorConvTuneCache *cache;
+  gchar *path;
+  gint64 start = g_get_monotonic_time ();
+
+  conv->tune_ret = gst_color_conv_tune (conv->tune_format, conv->tune_width,
+      conv->tune_height, gst_color_conv_tune_max_threads (), &conv->tuning);
+
+  if (!conv->tune_ret) {
+    GST_WARNING_OBJECT (conv, "failed to tune format 0x%x",
+        conv->tune_format);
+  } else {
+    GST_INFO_OBJECT (conv, "tuned %dx%d in %" G_GINT64_FORMAT " us",
+        conv->tune_width, conv->tune_height, g_get_monotonic_time () - start);
+
+    /* The element's cache belongs to the streaming thread. */
+    path = gst_color_conv_tune_cache_path ();
+    cache = gst_color_conv_tune_cache_load (path);
+    g_free (path);
+
+    gst_color_conv_tune_cache_store (cache, BACKEND, conv->tune_format,
+        conv->tune_width, conv->tune_height, &conv->tuning);
+    if (!gst_color_conv_tune_cache_save (cache)) {
+      GST_WARNING_OBJECT (conv, "failed to save the tuning cache");
+    }
+
+    gst_color_conv_tune_cache_free (cache);
   }
 
-  s = gst_caps_get_structure (inbuf->caps, 0);
+  g_atomic_int_set (&conv->tuned, TRUE);
 
-  if (!gst_structure_get_int (s, "width", &width)) {
-    GST_ELEMENT_ERROR (conv, STREAM, FORMAT, ("failed to get width"), (NULL));
-    return GST_FLOW_ERROR;
+  return NULL;
+}
+
+/*
+ * Picks the kernels and thread count for the negotiated size. Sizes not
+ * in the cache keep converting as they are while a thread measures them
+ * once, for a few dozen frame times, and saves them for later runs.
+ */
+static void
+gst_color_conv_apply_tuning (GstColorConv * conv)
+{
+  GstColorConvTuning tuning;
+
+  if (gst_color_conv_tune_cache_lookup (conv->tune_cache, BACKEND,
+          conv->hal_format, conv->width, conv->height, &tuning)) {
+    gst_color_conv_use_tuning (conv, &tuning);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (conv, "tuning %dx%d in the background", conv->width,
+      conv->height);
+
+  conv->tune_format = conv->hal_format;
+  conv->tune_width = conv->width;
+  conv->tune_height = conv->height;
+  conv->tuned = FALSE;
+  conv->tune_thread = g_thread_new ("colorconv-tune",
+      gst_color_conv_tune_thread, conv);
+}
+
+/*
+ * Waits for the tuning thread, if any, and remembers what it measured.
+ * With apply the result is used right away, the caps it was measured for
+ * are still the negotiated ones then. Called from the streaming thread or
+ * with it stopped.
+ */
+static void
+gst_color_conv_finish_tuning (GstColorConv * conv, gboolean apply)
+{
+  if (!conv->tune_thread) {
+    return;
+  }
+
+  g_thread_join (conv->tune_thread);
+  conv->tune_thread = NULL;
+  conv->tuned = FALSE;
+
+  if (!conv->tune_ret) {
+    return;
+  }
+
+  gst_color_conv_tune_cache_store (conv->tune_cache, BACKEND,
+      conv->tune_format, conv->tune_width, conv->tune_height, &conv->tuning);
+
+  if (apply) {
+    /* Frames in flight still use the old kernels and thread count. */
+    if (conv->stream) {
+      gst_color_conv_stream_drain (conv->stream);
+    }
+
+    gst_color_conv_use_tuning (conv, &conv->tuning);
+  }
+}
+
+static gboolean
+gst_color_conv_start (GstBaseTransform * trans)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstColorConvScheduling scheduling;
+  guint cpu_threads;
+  gboolean shared_scheduler;
+  guint frames_in_flight;
+  guint max_jobs;
+  guint lock_usage;
+  GstColorConvReadStrategy read_strategy;
+  gchar *capture_file;
+
+  GST_DEBUG_OBJECT (conv, "start");
+
+  if (!conv->mod) {
+    const gchar *backend = g_getenv (BACKEND_ENV);
+
+    conv->mod = g_module_open (backend ? backend : BACKEND,
+        G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+  }
+
+  if (!conv->mod) {
+    GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
+        ("Failed to load conversion backend: %s", g_module_error ()), (NULL));
+    return FALSE;
+  }
+
+  if (!conv->backend) {
+    _gst_color_conv_backend_get sym;
+
+    if (!g_module_symbol (conv->mod, BACKEND_SYMBOL_NAME, (gpointer *) & sym)) {
+      GST_ELEMENT_ERROR (conv, LIBRARY, INIT, ("Invalid conversion backend: %s",
+              g_module_error ()), (NULL));
+      return FALSE;
+    }
+
+    conv->backend = g_malloc (sizeof (GstColorConvBackend));
+
+    if (!sym (conv->backend)) {
+      GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
+          ("Failed to initialize conversion backend"), (NULL));
+      return FALSE;
+    }
+  }
+
+  if (!conv->backend->start (conv->backend->handle)) {
+    GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
+        ("Failed to start conversion backend"), (NULL));
+    return FALSE;
+  }
+
+  conv->hal_format = conv->backend->get_hal_format (conv->backend->handle);
+
+#if GST_CHECK_VERSION (1,0,0)
+  /* 0.10 gets the gralloc module from libgstnativebuffer. */
+  if (!conv->gralloc && hw_get_module (GRALLOC_HARDWARE_MODULE_ID,
+          (const hw_module_t **) & conv->gralloc) != 0) {
+    GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
+        ("Failed to load gralloc module"), (NULL));
+    return FALSE;
+  }
+#endif
+
+  GST_OBJECT_LOCK (conv);
+  scheduling = conv->scheduling;
+  cpu_threads = conv->cpu_threads;
+  shared_scheduler = conv->shared_scheduler;
+  frames_in_flight = conv->frames_in_flight;
+  lock_usage = conv->lock_usage;
+  read_strategy = conv->read_strategy;
+  conv->cur_read_cost_threshold = conv->read_cost_threshold;
+  capture_file = g_strdup (conv->capture_file);
+  conv->cur_capture_frames = conv->capture_frames;
+  GST_OBJECT_UNLOCK (conv);
+
+  if (capture_file && !conv->capture) {
+    /* The converters' frame size is all we know about the buffer. */
+    if (!gst_color_conv_can_convert (conv->hal_format)) {
+      GST_WARNING_OBJECT (conv, "cannot capture format 0x%x",
+          conv->hal_format);
+    } else if (!(conv->capture =
+            gst_color_conv_capture_writer_new (capture_file))) {
+      GST_WARNING_OBJECT (conv, "failed to create capture file %s",
+          capture_file);
+    } else {
+      GST_INFO_OBJECT (conv, "capturing to %s", capture_file);
+    }
+  }
+
+  g_free (capture_file);
+
+  conv->cur_lock_usage = lock_usage ? lock_usage : READ_USAGE_CACHED;
+  conv->bounce = read_strategy == GST_COLOR_CONV_READ_STRATEGY_BOUNCE;
+  conv->read_probe =
+      (read_strategy == GST_COLOR_CONV_READ_STRATEGY_AUTO ? PROBE_STRATEGY : 0)
+      | (lock_usage ? 0 : PROBE_USAGE);
+
+  if (scheduling != GST_COLOR_CONV_SCHEDULING_VENDOR
+      && !gst_color_conv_can_convert (conv->hal_format)) {
+    if (scheduling == GST_COLOR_CONV_SCHEDULING_CPU) {
+      GST_ELEMENT_ERROR (conv, LIBRARY, INIT,
+          ("No CPU conversion for format 0x%x", conv->hal_format), (NULL));
+      return FALSE;
+    }
+
+    GST_WARNING_OBJECT (conv, "no CPU conversion for format 0x%x, "
+        "using the vendor converter only", conv->hal_format);
+    scheduling = GST_COLOR_CONV_SCHEDULING_VENDOR;
+  }
+
+  conv->cur_scheduling = scheduling;
+  conv->lane = scheduling == GST_COLOR_CONV_SCHEDULING_CPU ?
+      GST_COLOR_CONV_LANE_CPU : GST_COLOR_CONV_LANE_VENDOR;
+  conv->cpu_layout = TRUE;
+  conv->layout_probed = FALSE;
+
+  /*
+   * Tuned settings are cached per size, which is only known in set_caps.
+   * Load them all now so known sizes start at their tuned configuration.
+   */
+  conv->tune = scheduling != GST_COLOR_CONV_SCHEDULING_VENDOR;
+  if (conv->tune && !conv->tune_cache) {
+    gchar *path = gst_color_conv_tune_cache_path ();
+
+    conv->tune_cache = gst_color_conv_tune_cache_load (path);
+    g_free (path);
+  }
+
+  /*
+   * Enough lanes for any tuned count, the stream limits what is used. The
+   * shared pool has its own lanes, only the frames in flight are ours.
+   */
+  conv->auto_threads = cpu_threads == 0 && !shared_scheduler;
+  if (conv->auto_threads) {
+    cpu_threads = gst_color_conv_tune_max_threads ();
+  }
+
+  max_jobs = shared_scheduler ? frames_in_flight : cpu_threads + 1;
+
+  if ((scheduling == GST_COLOR_CONV_SCHEDULING_HYBRID || shared_scheduler)
+      && !conv->stream) {
+    GstColorConvScheduler *sched;
+
+    if (shared_scheduler) {
+      GST_INFO_OBJECT (conv, "shared scheduling with up to %u frames in "
+          "flight", max_jobs);
+      sched = gst_color_conv_scheduler_get_shared ();
+    } else {
+      GST_INFO_OBJECT (conv, "hybrid scheduling with %u CPU threads",
+          cpu_threads);
+      sched = gst_color_conv_scheduler_new (TRUE, cpu_threads);
+    }
+
+    conv->stream = gst_color_conv_stream_new (sched,
+        scheduling != GST_COLOR_CONV_SCHEDULING_CPU,
+        scheduling != GST_COLOR_CONV_SCHEDULING_VENDOR, max_jobs,
+        gst_color_conv_run_job, conv);
+    gst_color_conv_scheduler_unref (sched);
+
+    gst_color_conv_start_pushing (conv);
+  }
+
+  GST_OBJECT_LOCK (conv);
+  conv->queue_depth = conv->stream ? max_jobs : 0;
+  /* Measured again from the first frame, reported after the warm-up. */
+  conv->measured_latency = 0;
+  conv->latency_frames = 0;
+  GST_OBJECT_UNLOCK (conv);
+
+#if GST_CHECK_VERSION (1,0,0)
+  /* The stream holds on to this many, one more is being prepared. */
+  conv->in_flight = conv->stream ? max_jobs + 1 : 1;
+#else
+  conv->fd_failed = FALSE;
+#endif
+
+  return TRUE;
+}
+
+static gboolean
+gst_color_conv_stop (GstBaseTransform * trans)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+
+  GST_DEBUG_OBJECT (conv, "stop");
+
+  /* Workers use the backend so they have to finish before it stops. */
+  if (conv->stream) {
+    gst_color_conv_stop_pushing (conv);
+    gst_color_conv_stream_flush (conv->stream, gst_color_conv_free_job);
+    gst_color_conv_stream_free (conv->stream);
+    conv->stream = NULL;
+
+    GST_OBJECT_LOCK (conv);
+    conv->queue_depth = 0;
+    GST_OBJECT_UNLOCK (conv);
+  }
+
+  gst_color_conv_finish_tuning (conv, FALSE);
+  if (conv->tune_cache) {
+    gst_color_conv_tune_cache_free (conv->tune_cache);
+    conv->tune_cache = NULL;
+  }
+
+  gst_color_conv_forget_frame (conv);
+  gst_color_conv_free_bounce (conv);
+  gst_color_conv_free_scratch (conv);
+
+  if (conv->capture) {
+    gst_color_conv_stop_capture (conv);
+  }
+
+  if (conv->backend) {
+    if (!conv->backend->stop (conv->backend->handle)) {
+      GST_ELEMENT_ERROR (conv, LIBRARY, SHUTDOWN,
+          ("Failed to stop conversion backend"), (NULL));
+      return FALSE;
+    }
+  }
+
+#if !GST_CHECK_VERSION (1,0,0)
+  if (conv->fd_pool) {
+    gst_color_conv_fd_pool_destroy (conv->fd_pool);
+    conv->fd_pool = NULL;
+  }
+#endif
+
+  if (conv->trace) {
+    gst_color_conv_dump_trace (conv, NULL);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_color_conv_src_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  const GstStructure *s;
+  GstClockTime latency;
+  guint frames = 1;
+
+  /* Frames are rendered this much after their running time. */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_LATENCY) {
+    gst_event_parse_latency (event, &latency);
+
+    GST_OBJECT_LOCK (conv);
+    conv->pipeline_latency = latency;
+    GST_OBJECT_UNLOCK (conv);
+  }
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_UPSTREAM) {
+    s = gst_event_get_structure (event);
+
+    if (s && gst_structure_has_name (s, SNAPSHOT_EVENT)) {
+      gst_structure_get_uint (s, "frames", &frames);
+      gst_color_conv_snapshot (conv, frames);
+      gst_event_unref (event);
+      return TRUE;
+    }
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->src_event (trans, event);
+}
+
+static gboolean
+gst_color_conv_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstPad *native;
+
+  native = gst_color_conv_get_native_pad (conv);
+  if (native) {
+    gst_pad_push_event (native, gst_event_ref (event));
+    gst_object_unref (native);
+  }
+
+  /* Whatever comes after a seek is compared afresh. */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP && !conv->stream) {
+    gst_color_conv_forget_frame (conv);
+  }
+
+  if (!conv->stream) {
+    return GST_COLOR_CONV_PARENT_EVENT (trans, event);
+  }
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      /*
+       * Unblocks the streaming thread if it waits for room in the stream,
+       * the push task pauses once downstream lets go of it.
+       */
+      gst_color_conv_stream_set_flushing (conv->stream, TRUE);
+      break;
+
+    case GST_EVENT_FLUSH_STOP:
+      /*
+       * Frames in flight are dropped unpushed. Flushing again wakes the
+       * push task for a flush stop that came alone.
+       */
+      gst_color_conv_stream_set_flushing (conv->stream, TRUE);
+      gst_pad_pause_task (GST_BASE_TRANSFORM_SRC_PAD (conv));
+      gst_color_conv_stream_flush (conv->stream, gst_color_conv_free_job);
+      gst_color_conv_forget_frame (conv);
+      gst_color_conv_stream_set_flushing (conv->stream, FALSE);
+      gst_color_conv_start_pushing (conv);
+      break;
+
+    default:
+      /* Keep EOS and friends behind the frames still being converted. */
+      if (GST_EVENT_IS_SERIALIZED (event)) {
+        gst_color_conv_stream_drain (conv->stream);
+      }
+      break;
+  }
+
+  return GST_COLOR_CONV_PARENT_EVENT (trans, event);
+}
+
+/*
+ * Returns when the frame is due in g_get_monotonic_time () units, which
+ * every instance sharing a scheduler can compare, or -1 if unknown.
+ */
+static gint64
+gst_color_conv_deadline (GstColorConv * conv, GstBuffer * buffer)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (conv);
+  GstClock *clock;
+  GstClockTime running_time;
+  GstClockTimeDiff due;
+
+  if (!GST_BUFFER_TIMESTAMP_IS_VALID (buffer)) {
+    return -1;
+  }
+
+  running_time = gst_segment_to_running_time (&trans->segment,
+      GST_FORMAT_TIME, GST_BUFFER_TIMESTAMP (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time)) {
+    return -1;
+  }
+
+  clock = gst_element_get_clock (GST_ELEMENT (conv));
+  if (!clock) {
+    return -1;
+  }
+
+  /* Pipelines may run on different clocks, only the distance carries over. */
+  due = GST_CLOCK_DIFF (gst_clock_get_time (clock),
+      gst_element_get_base_time (GST_ELEMENT (conv)) + running_time);
+  gst_object_unref (clock);
+
+  return g_get_monotonic_time () + due / GST_USECOND;
+}
+
+/*
+ * Whether @inbuf would miss its presentation even if converted right
+ * away: sinks render it the pipeline latency after its running time and
+ * converting it takes up to the latency reported for this element.
+ */
+static gboolean
+gst_color_conv_too_late (GstColorConv * conv, GstBuffer * inbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (conv);
+  GstClock *clock;
+  GstClockTime running_time;
+  GstClockTime latency;
+  GstClockTime due;
+  gboolean late;
+
+  if (!GST_BUFFER_TIMESTAMP_IS_VALID (inbuf)) {
+    return FALSE;
+  }
+
+  running_time = gst_segment_to_running_time (&trans->segment,
+      GST_FORMAT_TIME, GST_BUFFER_TIMESTAMP (inbuf));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time)) {
+    return FALSE;
+  }
+
+  clock = gst_element_get_clock (GST_ELEMENT (conv));
+  if (!clock) {
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (conv);
+  latency = gst_color_conv_reported_latency (conv);
+  due = running_time + conv->pipeline_latency;
+  GST_OBJECT_UNLOCK (conv);
+
+  due += gst_element_get_base_time (GST_ELEMENT (conv));
+  late = gst_clock_get_time (clock) + latency > due;
+  gst_object_unref (clock);
+
+  return late;
+}
+
+/*
+ * Gives a kept frame the timing of the decimated stream: it lasts until
+ * the next kept frame and its offsets count output frames. Its timestamp
+ * is the input frame's, which already is where it belongs.
+ */
+static void
+gst_color_conv_decimate_timing (GstColorConv * conv, GstBuffer * outbuf)
+{
+  guint decimation = conv->cur_decimation;
+  GstClockTime duration = GST_BUFFER_DURATION (outbuf);
+
+  if (!GST_CLOCK_TIME_IS_VALID (duration)) {
+    GST_OBJECT_LOCK (conv);
+    duration = conv->frame_duration;
+    GST_OBJECT_UNLOCK (conv);
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (duration)) {
+    GST_BUFFER_DURATION (outbuf) = duration * decimation;
+  }
+
+  if (GST_BUFFER_OFFSET_IS_VALID (outbuf)) {
+    GST_BUFFER_OFFSET (outbuf) /= decimation;
+    GST_BUFFER_OFFSET_END (outbuf) = GST_BUFFER_OFFSET (outbuf) + 1;
+  }
+}
+
+/*
+ * Works out where the planes of linear semi-planar input are from
+ * gralloc, which knows how the decoder padded them. Returns FALSE if the
+ * layout cannot be known, only the vendor converter can read such input.
+ */
+static gboolean
+gst_color_conv_probe_layout (GstColorConv * conv, GstBuffer * inbuf)
+{
+#ifdef GRALLOC_MODULE_API_VERSION_0_2
+  const gralloc_module_t *gralloc;
+  buffer_handle_t handle = NULL;
+  struct android_ycbcr ycbcr;
+  const guint8 *cb;
+  const guint8 *cr;
+  gboolean known;
+#endif
+
+  gst_color_conv_layout_packed (&conv->layout, conv->width, conv->height);
+
+  if (conv->hal_format != GST_COLOR_CONV_FORMAT_NV12
+      && conv->hal_format != GST_COLOR_CONV_FORMAT_NV21) {
+    /* Tiled input is laid out by its format. */
+    return TRUE;
+  }
+
+#ifdef GRALLOC_MODULE_API_VERSION_0_2
+#if GST_CHECK_VERSION (1,0,0)
+  gralloc = conv->gralloc;
+  gst_buffer_extract (inbuf, 0, &handle, sizeof (handle));
+#else
+  gralloc = gst_native_buffer_get_gralloc (GST_NATIVE_BUFFER (inbuf))->gralloc;
+  handle = *gst_native_buffer_get_handle (GST_NATIVE_BUFFER (inbuf));
+#endif
+
+  if (gralloc->common.module_api_version < GRALLOC_MODULE_API_VERSION_0_2
+      || !gralloc->lock_ycbcr) {
+    GST_WARNING_OBJECT (conv, "gralloc does not report plane layouts, "
+        "converting on the vendor converter only");
+    return FALSE;
+  }
+
+  if (gralloc->lock_ycbcr (gralloc, handle,
+          g_atomic_int_get (&conv->cur_lock_usage), 0, 0, conv->width,
+          conv->height, &ycbcr) != 0) {
+    GST_WARNING_OBJECT (conv, "failed to get the plane layout, converting "
+        "on the vendor converter only");
+    return FALSE;
+  }
+
+  cb = ycbcr.cb;
+  cr = ycbcr.cr;
+  known = ycbcr.chroma_step == 2
+      && (conv->hal_format == GST_COLOR_CONV_FORMAT_NV12 ?
+      cr == cb + 1 : cb == cr + 1);
+  if (known) {
+    conv->layout.stride = ycbcr.ystride;
+    conv->layout.uv_offset = MIN (cb, cr) - (const guint8 *) ycbcr.y;
+    conv->layout.uv_stride = ycbcr.cstride;
+    known = gst_color_conv_layout_valid (&conv->layout, conv->width,
+        conv->height);
+  }
+
+  if (gralloc->unlock (gralloc, handle) != 0) {
+    GST_WARNING_OBJECT (conv, "failed to unlock inbuf");
+  }
+
+  if (!known) {
+    GST_WARNING_OBJECT (conv, "unexpected plane layout, converting on the "
+        "vendor converter only");
+    gst_color_conv_layout_packed (&conv->layout, conv->width, conv->height);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (conv, "luma stride %d, chroma at %d with stride %d",
+      conv->layout.stride, conv->layout.uv_offset, conv->layout.uv_stride);
+
+  return TRUE;
+#else
+  GST_WARNING_OBJECT (conv, "gralloc does not report plane layouts, "
+      "converting on the vendor converter only");
+  return FALSE;
+#endif
+}
+
+/*
+ * Takes the CPU lane out of use while its kernels cannot read the input
+ * and puts it back once they can. Called with the stream drained.
+ */
+static void
+gst_color_conv_set_cpu_layout (GstColorConv * conv, gboolean known)
+{
+  GstColorConvScheduling scheduling = conv->cur_scheduling;
+  gboolean cpu = known && scheduling != GST_COLOR_CONV_SCHEDULING_VENDOR;
+
+  conv->cpu_layout = known;
+  conv->lane = cpu && scheduling == GST_COLOR_CONV_SCHEDULING_CPU ?
+      GST_COLOR_CONV_LANE_CPU : GST_COLOR_CONV_LANE_VENDOR;
+
+  if (conv->stream) {
+    gst_color_conv_stream_set_lanes (conv->stream,
+        !cpu || scheduling != GST_COLOR_CONV_SCHEDULING_CPU, cpu);
+  }
+}
+
+/* Probes the layout once per caps, on the first frame that needs it. */
+static void
+gst_color_conv_ensure_layout (GstColorConv * conv, GstBuffer * inbuf)
+{
+  if (G_UNLIKELY (!conv->layout_probed)) {
+    gst_color_conv_set_cpu_layout (conv,
+        gst_color_conv_probe_layout (conv, inbuf));
+    conv->layout_probed = TRUE;
+  }
+}
+
+static GstFlowReturn
+gst_color_conv_transform (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer * outbuf)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  guint64 checksum = 0;
+  gint64 start;
+
+  GST_DEBUG_OBJECT (conv, "transform");
+
+  conv->trace_frame++;
+  conv->trace_push_start = 0;
+
+  if (!IS_NATIVE_BUFFER (inbuf)) {
+    GST_ELEMENT_ERROR (conv, CORE, NEGOTIATION,
+        ("input buffer is not a native buffer"), (NULL));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+#if !GST_CHECK_VERSION (1,0,0)
+  if (IS_NATIVE_CAPS (outbuf->caps)) {
+    /* We are pushing the buffer as it is. */
+    GST_DEBUG_OBJECT (conv, "shortcutting native buffer");
+    return GST_FLOW_OK;
+  }
+#endif
+
+  if (conv->cur_decimation > 1) {
+    gst_color_conv_decimate_timing (conv, outbuf);
+  }
+
+  /* Checked before anything locks the input. */
+  if (g_atomic_int_get (&conv->deadline) && gst_color_conv_too_late (conv,
+          inbuf)) {
+    GST_DEBUG_OBJECT (conv, "frame %" G_GUINT64_FORMAT " would be late, "
+        "dropping it", conv->trace_frame);
+    g_atomic_int_inc (&conv->late_frames);
+#if !GST_CHECK_VERSION (1,0,0)
+    conv->input_checksummed = FALSE;
+#endif
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  }
+
+  if (G_UNLIKELY (g_atomic_int_get (&conv->tuned))) {
+    gst_color_conv_finish_tuning (conv, TRUE);
+  }
+
+  gst_color_conv_ensure_layout (conv, inbuf);
+
+  if (conv->checksum_sample) {
+#if !GST_CHECK_VERSION (1,0,0)
+    /* prepare_output_buffer may have taken it already. */
+    if (conv->input_checksummed) {
+      checksum = conv->input_checksum;
+      conv->input_checksummed = FALSE;
+    } else if (!gst_color_conv_checksum_input (conv, inbuf, &checksum)) {
+      return GST_FLOW_ERROR;
+    }
+#else
+    if (!gst_color_conv_checksum_input (conv, inbuf, &checksum)) {
+      return GST_FLOW_ERROR;
+    }
+#endif
+
+    if (conv->checksum_valid && checksum == conv->checksum) {
+      GST_LOG_OBJECT (conv, "input unchanged, repeating the last frame");
+      return gst_color_conv_repeat_frame (conv, outbuf);
+    }
+
+    /* Valid again once this frame is on its way. */
+    conv->checksum_valid = FALSE;
+  }
+
+  if (!conv->stream) {
+    start = g_get_monotonic_time ();
+
+    if (!gst_color_conv_convert_frame (conv, inbuf, outbuf, conv->width,
+            conv->height, conv->lane, conv->trace_frame)) {
+      return GST_FLOW_ERROR;
+    }
+
+    gst_color_conv_update_latency (conv, g_get_monotonic_time () - start);
+    gst_color_conv_snapshot_output (conv, outbuf);
+
+    if (conv->checksum_sample) {
+      gst_buffer_replace (&conv->last_out, outbuf);
+      conv->checksum = checksum;
+      conv->checksum_valid = TRUE;
+    }
+
+    if (G_UNLIKELY (g_atomic_int_get (&conv->tracing))) {
+      conv->trace_push_start = g_get_monotonic_time ();
+    }
+
+    return GST_FLOW_OK;
+  }
+
+  /*
+   * Hybrid or shared scheduling: hand the frame to a lane, the push task
+   * pushes it once it and every frame before it are done.
+   */
+  if (!gst_color_conv_submit_job (conv, inbuf, outbuf, FALSE)) {
+    return GST_FLOW_WRONG_STATE;
+  }
+
+  /* The last output is picked up when this job is pushed. */
+  if (conv->checksum_sample) {
+    conv->checksum = checksum;
+    conv->checksum_valid = TRUE;
+  }
+
+  return GST_COLOR_CONV_FLOW_QUEUED;
+}
+
+/*
+ * Checksums the input for skip-unchanged. The buffer is locked once more
+ * than converting it takes, the sampled mode keeps the extra read cheap
+ * on uncached mappings. Posts an error and returns FALSE if the buffer
+ * cannot be locked.
+ */
+static gboolean
+gst_color_conv_checksum_input (GstColorConv * conv, GstBuffer * inbuf,
+    guint64 * checksum)
+{
+  void *data;
+  gboolean locked;
+  gint64 start;
+  gint64 end;
+
+  start = g_get_monotonic_time ();
+
+  data = gst_color_conv_get_buffer_data (conv, inbuf, &locked);
+  if (!data) {
+    return FALSE;
+  }
+
+  *checksum = gst_color_conv_checksum (conv->kernels, data,
+      gst_color_conv_layout_size (&conv->layout, conv->hal_format,
+          conv->width, conv->height), conv->checksum_sample);
+
+  if (!gst_color_conv_unlock_buffer (conv, inbuf, locked)) {
+    GST_WARNING_OBJECT (conv, "failed to unlock inbuf");
+  }
+
+  end = g_get_monotonic_time ();
+
+  GST_OBJECT_LOCK (conv);
+  conv->checksum_time += end - start;
+  GST_OBJECT_UNLOCK (conv);
+
+  if (G_UNLIKELY (g_atomic_int_get (&conv->tracing))) {
+    gst_color_conv_trace_record (conv->trace, GST_COLOR_CONV_TRACE_CHECKSUM,
+        conv->trace_frame, start, end);
+  }
+
+  return TRUE;
+}
+
+/*
+ * Has the base class push the last converted frame again in place of
+ * @outbuf, which is not converted. On 1.x generate_output swaps it for
+ * a buffer sharing the last frame, on 0.10 prepare_output_buffer already
+ * handed out such a buffer as @outbuf. With a stream it is queued behind
+ * the frames in flight, the last of which it repeats.
+ */
+static GstFlowReturn
+gst_color_conv_repeat_frame (GstColorConv * conv, GstBuffer * outbuf)
+{
+  GstColorConvJob *job;
+
+  g_atomic_int_inc (&conv->skipped_frames);
+
+  if (!conv->stream) {
+    if (G_UNLIKELY (g_atomic_int_get (&conv->tracing))) {
+      conv->trace_push_start = g_get_monotonic_time ();
+    }
+
+#if GST_CHECK_VERSION (1,0,0)
+    return GST_COLOR_CONV_FLOW_REPEAT;
+#else
+    gst_color_conv_snapshot_output (conv, outbuf);
+
+    return GST_FLOW_OK;
+#endif
+  }
+
+  job = g_slice_new0 (GstColorConvJob);
+  job->outbuf = gst_buffer_ref (outbuf);
+  job->frame = conv->trace_frame;
+  job->repeat = TRUE;
+  job->ret = TRUE;
+
+  if (!gst_color_conv_stream_append (conv->stream, job)) {
+    gst_color_conv_free_job (job);
+    return GST_FLOW_WRONG_STATE;
+  }
+
+  return GST_COLOR_CONV_FLOW_QUEUED;
+}
+
+/*
+ * Returns a buffer sharing the data of the last converted frame with the
+ * timestamps and flags of @outbuf. No pixels are copied.
+ */
+static GstBuffer *
+gst_color_conv_repeat_buffer (GstColorConv * conv, GstBuffer * outbuf)
+{
+  GstBuffer *buffer;
+
+#if GST_CHECK_VERSION (1,0,0)
+  buffer = gst_buffer_copy (conv->last_out);
+  gst_buffer_copy_into (buffer, outbuf,
+      GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+#else
+  buffer = gst_buffer_create_sub (conv->last_out, 0,
+      GST_BUFFER_SIZE (conv->last_out));
+  gst_buffer_copy_metadata (buffer, outbuf, GST_BUFFER_COPY_ALL);
+  /* Copying only adds flags, the last frame may have been the first. */
+  if (!GST_BUFFER_FLAG_IS_SET (outbuf, GST_BUFFER_FLAG_DISCONT)) {
+    GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_DISCONT);
+  }
+#endif
+
+  return buffer;
+}
+
+/* Drops the reference frame, the next input gets converted */
+static void
+gst_color_conv_forget_frame (GstColorConv * conv)
+{
+  conv->checksum_valid = FALSE;
+  gst_buffer_replace (&conv->last_out, NULL);
+}
+
+/*
+ * Queues the conversion of @inbuf into @outbuf on the stream. Snapshot
+ * jobs are posted on the bus instead of pushed. Returns FALSE if the
+ * stream is flushing.
+ */
+static gboolean
+gst_color_conv_submit_job (GstColorConv * conv, GstBuffer * inbuf,
+    GstBuffer * outbuf, gboolean snapshot)
+{
+  GstColorConvJob *job;
+
+  job = g_slice_new0 (GstColorConvJob);
+  job->inbuf = gst_buffer_ref (inbuf);
+  job->outbuf = gst_buffer_ref (outbuf);
+  job->width = conv->width;
+  job->height = conv->height;
+  job->frame = conv->trace_frame;
+  job->submitted = g_get_monotonic_time ();
+  job->snapshot = snapshot;
+
+  if (!gst_color_conv_stream_submit (conv->stream, job,
+          gst_color_conv_deadline (conv, inbuf))) {
+    GST_DEBUG_OBJECT (conv, "flushing, dropping frame");
+    gst_color_conv_free_job (job);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Times reads from the first mapped input against reads from cache. Write
+ * combined gralloc mappings come out an order of magnitude slower, CPU
+ * kernels then read them through a bounce buffer and the lock stops asking
+ * for a cached mapping it does not get. The median band decides.
+ */
+static void
+gst_color_conv_probe_read (GstColorConv * conv, const guint8 * data,
+    int size, guint probe)
+{
+  int n = MIN (size / READ_PROBE_BANDS, READ_PROBE_BAND_SIZE);
+  guint8 *scratch = g_malloc (2 * n);
+  gdouble costs[READ_PROBE_BANDS];
+  gdouble cost;
+  gboolean slow;
+  int i;
+  int j;
+
+  for (i = 0; i < READ_PROBE_BANDS; i++) {
+    cost = gst_color_conv_read_cost (conv->kernels,
+        data + i * (size / READ_PROBE_BANDS), n, scratch);
+
+    /* Kept sorted, there are only a handful. */
+    for (j = i; j > 0 && costs[j - 1] > cost; j--) {
+      costs[j] = costs[j - 1];
+    }
+    costs[j] = cost;
+  }
+
+  g_free (scratch);
+
+  cost = costs[READ_PROBE_BANDS / 2];
+  slow = cost >= conv->cur_read_cost_threshold;
+
+  GST_INFO_OBJECT (conv, "input reads %.1fx slower than cache (%.1fx to "
+      "%.1fx), treating the mapping as %s", cost, costs[0],
+      costs[READ_PROBE_BANDS - 1], slow ? "uncached" : "cached");
+
+  if (probe & PROBE_STRATEGY) {
+    g_atomic_int_set (&conv->bounce, slow);
+  }
+
+  if ((probe & PROBE_USAGE) && slow) {
+    g_atomic_int_set (&conv->cur_lock_usage, READ_USAGE_UNCACHED);
+  }
+}
+
+/*
+ * Converts one frame on the given lane. Runs on the streaming thread or,
+ * with hybrid scheduling, on a lane thread. Posts an error and returns
+ * FALSE on failure.
+ */
+static gboolean
+gst_color_conv_convert_frame (GstColorConv * conv, GstBuffer * inbuf,
+    GstBuffer * outbuf, int width, int height, GstColorConvLane lane,
+    guint64 frame)
+{
+  void *in_data;
+  guint8 *out_data;
+  gboolean in_locked;
+  gboolean ret = FALSE;
+  gboolean copy_buffer;
+  GstColorConvPlanes packed;
+  GstColorConvFrame dst;
+  gboolean tracing;
+  guint probe;
+  guint orient = conv->orient;
+  /* Tuning may swap them from the streaming thread, keep one set. */
+  const GstColorConvKernels *kernels = g_atomic_pointer_get (&conv->kernels);
+  gint64 ts[5] = { 0, };
+
+  tracing = g_atomic_int_get (&conv->tracing);
+
+  if (!gst_color_conv_map_output (conv, outbuf,
+          ORIENTED_WIDTH (orient, width, height),
+          ORIENTED_HEIGHT (orient, width, height), &dst)) {
+    GST_ELEMENT_ERROR (conv, RESOURCE, WRITE,
+        ("failed to map output buffer"), (NULL));
+    return FALSE;
+  }
+
+  /* The converters write packed planes, the output buffer may be padded. */
+  gst_color_conv_planes_packed (&packed, width, height);
+
+  /* Orienting needs the converted frame in a scratch buffer too. */
+  copy_buffer = orient != 0
+      || !gst_color_conv_planes_equal (&packed, &dst.planes);
+  if (copy_buffer && !orient) {
+    GST_INFO_OBJECT (conv, "manually padding buffer strides from %d/%d to %d/%d",
+        packed.stride[0], packed.stride[1], dst.planes.stride[0],
+        dst.planes.stride[1]);
+  }
+
+  if (copy_buffer) {
+    out_data = g_async_queue_try_pop (conv->scratch_pool);
+    if (!out_data) {
+      out_data = g_malloc (packed.size);
+    }
+  } else {
+    out_data = dst.data;
+  }
+
+  if (!out_data) {
+    GST_ELEMENT_ERROR (conv, RESOURCE, NOT_FOUND, ("failed to allocate memory for output data"), (NULL));
+    gst_color_conv_unmap_output (&dst);
+    return FALSE;
+  }
+
+  /* lock */
+  if (G_UNLIKELY (tracing)) {
+    ts[0] = g_get_monotonic_time ();
+  }
+
+  in_data = gst_color_conv_get_buffer_data (conv, inbuf, &in_locked);
+  if (!in_data) {
+    if (copy_buffer) {
+      g_async_queue_push (conv->scratch_pool, out_data);
+    }
+
+    gst_color_conv_unmap_output (&dst);
+    return FALSE;
+  }
+
+  /* Only the first frame after start gets measured. */
+  if (G_UNLIKELY (g_atomic_int_get (&conv->read_probe))) {
+    probe = g_atomic_int_and (&conv->read_probe, 0);
+    if (probe) {
+      gst_color_conv_probe_read (conv, in_data, width * height, probe);
+    }
+  }
+
+  /* Convert */
+  if (G_UNLIKELY (tracing)) {
+    ts[1] = g_get_monotonic_time ();
+  }
+
+  if (lane == GST_COLOR_CONV_LANE_VENDOR) {
+    GST_LOG_OBJECT (conv, "sending buffer to backend for conversion");
+    ret =
+        conv->backend->convert (conv->backend->handle, width,
+        height, in_data, out_data);
+
+    if (!ret && conv->cpu_layout
+        && gst_color_conv_can_convert (conv->hal_format)) {
+      GST_WARNING_OBJECT (conv, "backend failed to convert frame %"
+          G_GUINT64_FORMAT ", converting on the CPU", frame);
+      g_atomic_int_inc (&conv->fallbacks);
+      lane = GST_COLOR_CONV_LANE_CPU;
+    }
+  }
+
+  if (lane == GST_COLOR_CONV_LANE_CPU && g_atomic_int_get (&conv->bounce)
+      && conv->bounce_pool) {
+    /* There is one for every conversion that can run at once. */
+    guint8 *bounce = g_async_queue_pop (conv->bounce_pool);
+
+    GST_LOG_OBJECT (conv, "converting buffer with %s kernels through a "
+        "bounce buffer", kernels->name);
+    ret = gst_color_conv_convert_layout (kernels, conv->hal_format,
+        width, height, &conv->layout, in_data, out_data, bounce,
+        GST_COLOR_CONV_BAND_ROWS);
+    g_async_queue_push (conv->bounce_pool, bounce);
+  } else if (lane == GST_COLOR_CONV_LANE_CPU) {
+    GST_LOG_OBJECT (conv, "converting buffer with %s kernels", kernels->name);
+    ret = gst_color_conv_convert_layout (kernels, conv->hal_format,
+        width, height, &conv->layout, in_data, out_data, NULL, 0);
+  }
+
+  /* unlock */
+  if (G_UNLIKELY (tracing)) {
+    ts[2] = g_get_monotonic_time ();
+  }
+
+  if (!gst_color_conv_unlock_buffer (conv, inbuf, in_locked)) {
+    GST_WARNING_OBJECT (conv, "failed to unlock inbuf");
+  }
+
+  if (G_UNLIKELY (tracing)) {
+    ts[3] = g_get_monotonic_time ();
+  }
+
+  if (!ret) {
+    GST_ELEMENT_ERROR (conv, LIBRARY, ENCODE, ("failed to convert"), (NULL));
+
+    if (copy_buffer) {
+      g_async_queue_push (conv->scratch_pool, out_data);
+    }
+
+    gst_color_conv_unmap_output (&dst);
+    return FALSE;
+  }
+
+  if (orient) {
+    gst_color_conv_orient (kernels, dst.data, &dst.planes, out_data,
+        &packed, orient, conv->apply_luts ? conv->luts : NULL);
+    g_async_queue_push (conv->scratch_pool, out_data);
+  } else if (copy_buffer) {
+    gst_color_conv_repack (kernels, dst.data, &dst.planes, out_data,
+        &packed, conv->apply_luts ? conv->luts : NULL);
+    g_async_queue_push (conv->scratch_pool, out_data);
+  } else if (conv->apply_luts) {
+    /* Remap in place while the converted output is still in cache. */
+    gst_color_conv_repack (kernels, out_data, &packed, out_data, &packed,
+        conv->luts);
+  }
+
+  gst_color_conv_unmap_output (&dst);
+
+  if (G_UNLIKELY (tracing)) {
+    ts[4] = g_get_monotonic_time ();
+
+    gst_color_conv_trace_record (conv->trace, GST_COLOR_CONV_TRACE_LOCK,
+        frame, ts[0], ts[1]);
+    gst_color_conv_trace_record (conv->trace, GST_COLOR_CONV_TRACE_CONVERT,
+        frame, ts[1], ts[2]);
+    gst_color_conv_trace_record (conv->trace, GST_COLOR_CONV_TRACE_UNLOCK,
+        frame, ts[2], ts[3]);
+    gst_color_conv_trace_record (conv->trace, GST_COLOR_CONV_TRACE_REPACK,
+        frame, ts[3], ts[4]);
+  }
+
+  return TRUE;
+}
+
+static void
+gst_color_conv_run_job (gpointer data, GstColorConvLane lane,
+    gpointer user_data)
+{
+  gboolean ret;
+  GstColorConvJob *job = data;
+  GstColorConv *conv = GST_COLOR_CONV (user_data);
+
+  ret = gst_color_conv_convert_frame (conv, job->inbuf, job->outbuf,
+      job->width, job->height, lane, job->frame);
+
+  /* Waiting for a lane counts, the frame is just as late. */
+  if (ret && !job->snapshot) {
+    gst_color_conv_update_latency (conv,
+        g_get_monotonic_time () - job->submitted);
+  }
+
+  /* Hand the native buffer back to the decoder as early as possible. */
+  gst_buffer_unref (job->inbuf);
+  job->inbuf = NULL;
+
+  job->ret = ret;
+}
+
+/* Drops a job that is not going to be pushed */
+static void
+gst_color_conv_free_job (gpointer data)
+{
+  GstColorConvJob *job = data;
+
+  if (job->inbuf) {
+    gst_buffer_unref (job->inbuf);
+  }
+
+  gst_buffer_unref (job->outbuf);
+  g_slice_free (GstColorConvJob, job);
+}
+
+/*
+ * Src pad task pushing the stream's jobs downstream in submission order,
+ * keeping the segment position the base class would. Frames after a
+ * failed push are dropped, the streaming thread returns that flow
+ * upstream. Pauses itself once the stream is flushing.
+ */
+static void
+gst_color_conv_push_loop (GstColorConv * conv)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (conv);
+  GstColorConvJob *job;
+  GstBuffer *buffer = NULL;
+  GstClockTime position;
+  GstFlowReturn ret;
+  gint64 start;
+
+  job = gst_color_conv_stream_pop (conv->stream);
+  if (!job) {
+    GST_DEBUG_OBJECT (conv, "flushing, pausing push task");
+    gst_pad_pause_task (trans->srcpad);
+    return;
+  }
+
+  ret = g_atomic_int_get (&conv->push_ret);
+
+  if (!job->ret) {
+    /* Nothing left to repeat for the frames behind it. */
+    gst_buffer_replace (&conv->last_out, NULL);
+    gst_buffer_unref (job->outbuf);
+    ret = GST_FLOW_ERROR;
+  } else if (ret != GST_FLOW_OK
+      || (job->repeat && G_UNLIKELY (!conv->last_out))) {
+    gst_buffer_unref (job->outbuf);
+    conv->push_discont = TRUE;
+  } else if (job->snapshot) {
+    gst_color_conv_post_snapshot (conv, job->outbuf);
+  } else if (job->repeat) {
+    /* Repeats follow the frame they repeat, which is pushed by now. */
+    buffer = gst_color_conv_repeat_buffer (conv, job->outbuf);
+    gst_buffer_unref (job->outbuf);
+  } else {
+    buffer = job->outbuf;
+  }
+
+  if (buffer) {
+    if (G_UNLIKELY (conv->push_discont)) {
+#if GST_CHECK_VERSION (1,0,0)
+      buffer = gst_buffer_make_writable (buffer);
+#else
+      buffer = gst_buffer_make_metadata_writable (buffer);
+#endif
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+      conv->push_discont = FALSE;
+    }
+
+    if (conv->checksum_sample && !job->repeat) {
+      gst_buffer_replace (&conv->last_out, buffer);
+    }
+
+    gst_color_conv_snapshot_output (conv, buffer);
+
+    /* Position queries answer with the end of the last frame pushed. */
+    if (GST_BUFFER_TIMESTAMP_IS_VALID (buffer)
+        && trans->segment.format == GST_FORMAT_TIME) {
+      position = GST_BUFFER_TIMESTAMP (buffer);
+      if (GST_BUFFER_DURATION_IS_VALID (buffer)) {
+        position += GST_BUFFER_DURATION (buffer);
+      }
+
+      GST_OBJECT_LOCK (conv);
+#if GST_CHECK_VERSION (1,0,0)
+      trans->segment.position = position;
+#else
+      gst_segment_set_last_stop (&trans->segment, GST_FORMAT_TIME, position);
+#endif
+      GST_OBJECT_UNLOCK (conv);
+    }
+
+    start = g_atomic_int_get (&conv->tracing) ? g_get_monotonic_time () : 0;
+
+    ret = gst_pad_push (trans->srcpad, buffer);
+
+    if (G_UNLIKELY (start)) {
+      gst_color_conv_trace_record (conv->trace, GST_COLOR_CONV_TRACE_PUSH,
+          job->frame, start, g_get_monotonic_time ());
+    }
+  }
+
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (conv, "push returned %s", gst_flow_get_name (ret));
+  }
+
+  g_atomic_int_set (&conv->push_ret, ret);
+
+  g_slice_free (GstColorConvJob, job);
+  gst_color_conv_stream_release (conv->stream);
+}
+
+/* Starts or restarts the push task with a clean flow */
+static void
+gst_color_conv_start_pushing (GstColorConv * conv)
+{
+  GstPad *pad = GST_BASE_TRANSFORM_SRC_PAD (conv);
+  gboolean ret;
+
+  g_atomic_int_set (&conv->push_ret, GST_FLOW_OK);
+  conv->push_discont = FALSE;
+
+#if GST_CHECK_VERSION (1,0,0)
+  ret = gst_pad_start_task (pad, (GstTaskFunction) gst_color_conv_push_loop,
+      conv, NULL);
+#else
+  ret = gst_pad_start_task (pad, (GstTaskFunction) gst_color_conv_push_loop,
+      conv);
+#endif
+
+  if (!ret) {
+    GST_ERROR_OBJECT (conv, "failed to start push task");
+  }
+}
+
+/* Wakes the push task up and waits for it to end */
+static void
+gst_color_conv_stop_pushing (GstColorConv * conv)
+{
+  gst_color_conv_stream_set_flushing (conv->stream, TRUE);
+  gst_pad_stop_task (GST_BASE_TRANSFORM_SRC_PAD (conv));
+}
+
+#if GST_CHECK_VERSION (1,0,0)
+/*
+ * Frames queued on the stream leave the base class nothing to push. A
+ * dropped frame instead would mark the next one it pushes discontinuous.
+ * Repeated frames are pushed like converted ones.
+ */
+static GstFlowReturn
+gst_color_conv_generate_output (GstBaseTransform * trans, GstBuffer ** outbuf)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  ret = GST_BASE_TRANSFORM_CLASS (parent_class)->generate_output (trans,
+      outbuf);
+
+  if (ret == GST_COLOR_CONV_FLOW_QUEUED) {
+    gst_buffer_replace (outbuf, NULL);
+    ret = GST_FLOW_OK;
+  } else if (ret == GST_COLOR_CONV_FLOW_REPEAT) {
+    buffer = gst_color_conv_repeat_buffer (conv, *outbuf);
+    gst_buffer_unref (*outbuf);
+    *outbuf = buffer;
+    gst_color_conv_snapshot_output (conv, buffer);
+    ret = GST_FLOW_OK;
+  }
+
+  return ret;
+}
+
+static gboolean
+gst_color_conv_decide_allocation (GstBaseTransform * trans, GstQuery * query)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstCaps *caps;
+  GstVideoInfo info;
+  GstBufferPool *pool = NULL;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstVideoAlignment align;
+  GstStructure *config;
+  guint size;
+  guint min;
+  guint max;
+  gboolean update_pool;
+  gboolean video_meta;
+  int i;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  if (!caps || !gst_video_info_from_caps (&info, caps)) {
+    GST_WARNING_OBJECT (conv, "failed to parse caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  video_meta = gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE,
+      NULL);
+
+  if (gst_query_get_n_allocation_params (query) > 0) {
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+  } else {
+    gst_allocation_params_init (&params);
+  }
+
+  /* Prefer the downstream pool so we convert straight into its memory. */
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    size = MAX (size, GST_VIDEO_INFO_SIZE (&info));
+    update_pool = TRUE;
+  } else {
+    size = GST_VIDEO_INFO_SIZE (&info);
+    min = max = 0;
+    update_pool = FALSE;
+  }
+
+  /* skip-unchanged holds on to the last frame pushed. */
+  if (conv->checksum_sample) {
+    min++;
+    if (max) {
+      max++;
+    }
+  }
+
+  if (!pool) {
+    pool = gst_video_buffer_pool_new ();
+  }
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  gst_buffer_pool_config_set_allocator (config, allocator, &params);
+
+  /*
+   * With video meta downstream follows whatever strides the pool picks,
+   * so rows can be aligned the way the allocator asked for. Without it
+   * we have to stick to the default layout for the caps.
+   */
+  if (video_meta && gst_buffer_pool_has_option (pool,
+          GST_BUFFER_POOL_OPTION_VIDEO_META)) {
+    gst_buffer_pool_config_add_option (config,
+        GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+    if (params.align && gst_buffer_pool_has_option (pool,
+            GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)) {
+      gst_video_alignment_reset (&align);
+      for (i = 0; i < GST_VIDEO_INFO_N_PLANES (&info); i++) {
+        align.stride_align[i] = params.align;
+      }
+
+      gst_buffer_pool_config_add_option (config,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+      gst_buffer_pool_config_set_video_alignment (config, &align);
+    }
+  }
+
+  if (!gst_buffer_pool_set_config (pool, config)) {
+    /* The pool may have adjusted the config, take it if it still fits. */
+    config = gst_buffer_pool_get_config (pool);
+    if (!gst_buffer_pool_config_validate_params (config, caps, size, min, max)) {
+      gst_structure_free (config);
+      GST_ELEMENT_ERROR (conv, RESOURCE, SETTINGS,
+          ("Failed to configure output buffer pool"), (NULL));
+      gst_object_unref (pool);
+      if (allocator) {
+        gst_object_unref (allocator);
+      }
+      return FALSE;
+    }
+
+    gst_buffer_pool_set_config (pool, config);
+  }
+
+  GST_DEBUG_OBJECT (conv, "using %s pool, video meta %d, alignment %" G_GSIZE_FORMAT,
+      update_pool ? "downstream" : "our own", video_meta, params.align);
+
+  if (update_pool) {
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  } else {
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+  }
+
+  gst_object_unref (pool);
+  if (allocator) {
+    gst_object_unref (allocator);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_color_conv_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+
+  /* Forwards the query downstream in passthrough. */
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->propose_allocation (trans,
+          decide_query, query)) {
+    return FALSE;
+  }
+
+  if (!decide_query) {
+    return TRUE;
+  }
+
+  /*
+   * Native buffers are allocated by the decoder. Tell it how many of them
+   * we hold on to while converting so it does not starve.
+   */
+  gst_query_add_allocation_pool (query, NULL, sizeof (buffer_handle_t),
+      conv->in_flight, 0);
+
+  return TRUE;
+}
+#else
+static GstBuffer *
+gst_color_conv_acquire_fd_buffer (GstColorConv * conv, gint size)
+{
+  GstBuffer *buf;
+
+  if (conv->fd_failed) {
+    return NULL;
+  }
+
+  if (conv->fd_pool
+      && gst_color_conv_fd_pool_get_size (conv->fd_pool) != (gsize) size) {
+    GST_DEBUG_OBJECT (conv, "output size changed, dropping memfd pool");
+    gst_color_conv_fd_pool_destroy (conv->fd_pool);
+    conv->fd_pool = NULL;
+  }
+
+  if (!conv->fd_pool) {
+    conv->fd_pool = gst_color_conv_fd_pool_new (size);
+  }
+
+  buf = gst_color_conv_fd_pool_acquire (conv->fd_pool);
+  if (!buf) {
+    /*
+     * Missing memfd or sealing support does not come back, do not retry
+     * the syscalls on every frame.
+     */
+    GST_WARNING_OBJECT (conv, "memfd allocation failed, using system memory "
+        "until restarted");
+    gst_color_conv_fd_pool_destroy (conv->fd_pool);
+    conv->fd_pool = NULL;
+    conv->fd_failed = TRUE;
+  }
+
+  return buf;
+}
+
+static GstFlowReturn
+gst_color_conv_prepare_output_buffer (GstBaseTransform *
+    trans, GstBuffer * input, gint size, GstCaps * caps, GstBuffer ** buf)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  GstColorConvOutputMemory output_memory;
+
+  GST_DEBUG_OBJECT (trans, "prepare output buffer %" GST_PTR_FORMAT, caps);
+
+  if (IS_NATIVE_CAPS (caps)) {
+    /* We just ref the buffer because we will push it as it is. */
+    *buf = gst_buffer_ref (input);
+    return GST_FLOW_OK;
+  }
+
+  /*
+   * Without a stream unchanged input gets the last frame itself as output,
+   * transform then only counts it. The checksum is kept for transform.
+   * Input past its deadline is left unlocked for transform to drop.
+   */
+  if (conv->checksum_sample && conv->checksum_valid && !conv->stream
+      && IS_NATIVE_BUFFER (input) && !(g_atomic_int_get (&conv->deadline)
+          && gst_color_conv_too_late (conv, input))) {
+    gst_color_conv_ensure_layout (conv, input);
+
+    if (!gst_color_conv_checksum_input (conv, input, &conv->input_checksum)) {
+      return GST_FLOW_ERROR;
+    }
+
+    conv->input_checksummed = TRUE;
+
+    if (conv->input_checksum == conv->checksum) {
+      *buf = gst_buffer_create_sub (conv->last_out, 0,
+          GST_BUFFER_SIZE (conv->last_out));
+      gst_buffer_set_caps (*buf, caps);
+      /* The base class adds the flags of the input. */
+      GST_BUFFER_FLAG_UNSET (*buf, GST_BUFFER_FLAG_DISCONT);
+      return GST_FLOW_OK;
+    }
+  }
+
+  GST_OBJECT_LOCK (conv);
+  output_memory = conv->output_memory;
+  GST_OBJECT_UNLOCK (conv);
+
+  *buf = NULL;
+  if (output_memory == GST_COLOR_CONV_OUTPUT_MEMORY_MEMFD) {
+    *buf = gst_color_conv_acquire_fd_buffer (conv, size);
+  }
+
+  if (!*buf) {
+    *buf = gst_buffer_new_and_alloc (size);
+  }
+
+  if (!*buf) {
+    GST_ELEMENT_ERROR (trans, LIBRARY, FAILED,
+        ("Could not allocate buffer"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  gst_buffer_set_caps (*buf, caps);
+
+  return GST_FLOW_OK;
+}
+#endif
+
+static gboolean
+gst_color_conv_accept_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+
+  GST_DEBUG_OBJECT (conv, "accept caps: direction %i, caps %" GST_PTR_FORMAT,
+      direction, caps);
+
+  if (!conv->backend) {
+    if (!gst_color_conv_start (trans)) {
+      return FALSE;
+    }
+  }
+
+  if (IS_NATIVE_CAPS (caps)) {
+    GST_DEBUG_OBJECT (conv, "Cannot check format for native caps.");
+#if 0
+    int format;
+    int hal_format = conv->backend->get_hal_format (conv->backend->handle);
+    if (gst_structure_get_int (gst_caps_get_structure (caps, 0), "format",
+            &format)) {
+      GST_WARNING_OBJECT (trans, "failed to get format");
+      return FALSE;
+    }
+
+    if (format != hal_format) {
+      GST_WARNING_OBJECT (trans,
+          "backend format (0x%x) is not similar to caps format (0x%x)",
+          hal_format, format);
+      return FALSE;
+    }
+#endif
+  } else {
+    GstVideoFormat fmt;
+    if (!gst_color_conv_parse_caps (caps, &fmt, NULL, NULL)) {
+      GST_WARNING_OBJECT (trans, "failed to parse caps %" GST_PTR_FORMAT, caps);
+      return FALSE;
+    }
+
+    if (fmt != GST_VIDEO_FORMAT_I420) {
+      GST_WARNING_OBJECT (trans, "Only I420 is supported");
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+gst_color_conv_fixate_structure (GstBaseTransform * trans, GstStructure * in,
+    GstStructure * out)
+{
+  GstColorConv *conv = GST_COLOR_CONV (trans);
+  int width;
+  int height;
+  int fps_n;
+  int fps_d;
+  guint decimation;
+  gboolean swap;
+
+  GST_OBJECT_LOCK (conv);
+  decimation = conv->decimation;
+  swap = TRANSPOSED (gst_color_conv_orientation (conv->rotation, conv->flip));
+  GST_OBJECT_UNLOCK (conv);
+
+  /* Either side may be the I420 one, rotating by 90 degrees swaps sizes. */
+  swap = swap && IS_NATIVE_STRUCTURE (in) != IS_NATIVE_STRUCTURE (out);
+
+  /* We care about width, height, format and framerate */
+  if (gst_structure_get_int (in, "width", &width)) {
+    gst_structure_set (out, swap ? "height" : "width", G_TYPE_INT, width,
+        NULL);
+  }
+
+  if (gst_structure_get_int (in, "height", &height)) {
+    gst_structure_set (out, swap ? "width" : "height", G_TYPE_INT, height,
+        NULL);
+  }
+
+  if (gst_structure_get_fraction (in, "framerate", &fps_n, &fps_d)) {
+    /* Only the converted output is decimated. */
+    if (!IS_NATIVE_STRUCTURE (out) && IS_NATIVE_STRUCTURE (in)) {
+      gst_util_fraction_multiply (fps_n, fps_d, 1, decimation, &fps_n, &fps_d);
+    }
+
+    gst_structure_set (out, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+  }
+}
+
+#if GST_CHECK_VERSION (1,0,0)
+static GstCaps *
+gst_color_conv_fixate_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+{
+  GST_DEBUG_OBJECT (trans, "fixate caps");
+
+  GST_LOG_OBJECT (trans, "caps %" GST_PTR_FORMAT, caps);
+  GST_LOG_OBJECT (trans, "othercaps %" GST_PTR_FORMAT, othercaps);
+
+  othercaps = gst_caps_make_writable (gst_caps_truncate (othercaps));
+
+  gst_color_conv_fixate_structure (trans, gst_caps_get_structure (caps, 0),
+      gst_caps_get_structure (othercaps, 0));
+
+  othercaps = gst_caps_fixate (othercaps);
+
+  GST_LOG_OBJECT (trans, "caps after fixating %" GST_PTR_FORMAT, othercaps);
+
+  return othercaps;
+}
+#else
+static void
+gst_color_conv_fixate_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+{
+  GST_DEBUG_OBJECT (trans, "fixate caps");
+
+  GST_LOG_OBJECT (trans, "caps %" GST_PTR_FORMAT, caps);
+  GST_LOG_OBJECT (trans, "othercaps %" GST_PTR_FORMAT, othercaps);
+
+  gst_color_conv_fixate_structure (trans, gst_caps_get_structure (caps, 0),
+      gst_caps_get_structure (othercaps, 0));
+
+  GST_LOG_OBJECT (trans, "caps after fixating %" GST_PTR_FORMAT, othercaps);
+}
+#endif
+
+#if GST_CHECK_VERSION (1,0,0)
+static void *
+gst_color_conv_get_buffer_data (GstColorConv * conv, GstBuffer * buffer,
+    gboolean * was_locked)
+{
+  buffer_handle_t handle = NULL;
+  int err;
+  void *data;
+
+  GST_DEBUG_OBJECT (conv, "get buffer data");
+
+  /*
+   * On 1.x the input buffer only carries the gralloc handle, nobody
+   * else can have locked it so we always do it ourselves.
+   */
+  *was_locked = FALSE;
+  gst_buffer_extract (buffer, 0, &handle, sizeof (handle));
+
+  err = conv->gralloc->lock (conv->gralloc, handle,
+      g_atomic_int_get (&conv->cur_lock_usage), 0, 0, conv->width,
+      conv->height, &data);
+
+  if (err != 0) {
+    GST_ELEMENT_ERROR (conv, LIBRARY, FAILED,
+        ("Could not lock native buffer handle"), (NULL));
+    return NULL;
+  }
+
+  return data;
+}
+
+static gboolean
+gst_color_conv_unlock_buffer (GstColorConv * conv, GstBuffer * buffer,
+    gboolean was_locked)
+{
+  buffer_handle_t handle = NULL;
+
+  GST_DEBUG_OBJECT (conv, "unlock buffer");
+
+  if (was_locked) {
+    GST_LOG_OBJECT (conv, "buffer was already locked");
+    /* nothing */
+    return TRUE;
+  }
+
+  gst_buffer_extract (buffer, 0, &handle, sizeof (handle));
+
+  return conv->gralloc->unlock (conv->gralloc, handle) == 0;
+}
+#else
+static void *
+gst_color_conv_get_buffer_data (GstColorConv * conv, GstBuffer * buffer,
+    gboolean * was_locked)
+{
+  GstNativeBuffer *native;
+  GstGralloc *gralloc;
+  int width;
+  int height;
+  buffer_handle_t *handle;
+  int err;
+  void *data;
+
+  GST_DEBUG_OBJECT (conv, "get buffer data");
+
+  /*
+   * All input here is GstNativeBuffer
+   *
+   * If we have native caps then we lock manually because the format the buffer
+   * carries might not correspond to any known GStreamer video format
+   *
+   * If we have non native caps then we can safely lock the buffer using gst_native_buffer_lock ()
+   */
+
+  native = GST_NATIVE_BUFFER (buffer);
+
+  if (!IS_NATIVE_CAPS (buffer->caps)) {
+    GST_LOG_OBJECT (conv, "buffer does not have native caps");
+
+    *was_locked = gst_native_buffer_is_locked (native);
+    if (*was_locked) {
+      GST_DEBUG_OBJECT (conv, "buffer already locked");
+      return GST_BUFFER_DATA (buffer);
+    }
+
+    GstVideoFormat fmt = GST_VIDEO_FORMAT_UNKNOWN;
+    if (!gst_video_format_parse_caps (buffer->caps, &fmt, NULL, NULL)) {
+      GST_ELEMENT_ERROR (conv, STREAM, FORMAT, ("failed to get format"),
+          (NULL));
+      return NULL;
+    }
+
+    if (!gst_native_buffer_lock (native, fmt,
+            g_atomic_int_get (&conv->cur_lock_usage))) {
+      GST_ELEMENT_ERROR (conv, LIBRARY, FAILED,
+          ("Could not lock native buffer handle"), (NULL));
+      return NULL;
+    }
+
+    *was_locked = FALSE;
+    return GST_BUFFER_DATA (buffer);
+  }
+
+  *was_locked = gst_native_buffer_is_locked (native);
+  if (*was_locked) {
+    GST_LOG_OBJECT (conv, "buffer already locked");
+    return GST_BUFFER_DATA (buffer);
+  }
+
+  GST_LOG_OBJECT (conv, "locking manually");
+
+  *was_locked = FALSE;
+  gralloc = gst_native_buffer_get_gralloc (native);
+  width = gst_native_buffer_get_width (native);
+  height = gst_native_buffer_get_height (native);
+  handle = gst_native_buffer_get_handle (native);
+
+  err = gralloc->gralloc->lock (gralloc->gralloc,
+      *handle, g_atomic_int_get (&conv->cur_lock_usage), 0, 0, width, height,
+      &data);
+
+  if (err != 0) {
+    GST_ELEMENT_ERROR (conv, LIBRARY, FAILED,
+        ("Could not lock native buffer handle"), (NULL));
+    return NULL;
+  }
+
+  return data;
+}
+
+static gboolean
+gst_color_conv_unlock_buffer (GstColorConv * conv, GstBuffer * buffer,
+    gboolean was_locked)
+{
+  int err;
+  GstGralloc *gralloc;
+  buffer_handle_t *handle;
+  GstNativeBuffer *native;
+
+  GST_DEBUG_OBJECT (conv, "unlock buffer");
+
+  native = GST_NATIVE_BUFFER (buffer);
+
+  if (was_locked) {
+    GST_LOG_OBJECT (conv, "buffer was already locked");
+    /* nothing */
+    return TRUE;
+  }
+
+  if (!IS_NATIVE_CAPS (buffer->caps)) {
+    return gst_native_buffer_unlock (native);
+  }
+
+  gralloc = gst_native_buffer_get_gralloc (native);
+  handle = gst_native_buffer_get_handle (native);
+
+  err = gralloc->gralloc->unlock (gralloc->gralloc, *handle);
+
+  if (err != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+#endif
+
+static GstFlowReturn
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+#else
+gst_color_conv_chain (GstPad * pad, GstBuffer * buffer)
+#endif
+{
+  GstFlowReturn ret;
+  GstFlowReturn push_ret;
+  GstFlowReturn native_ret = GST_FLOW_NOT_LINKED;
+  GstPad *native;
+  GstBuffer *inbuf = NULL;
+  gboolean snapshot;
+  GstColorConv *conv = GST_COLOR_CONV (GST_PAD_PARENT (pad));
+
+  /* The display branch goes first so it never waits for a conversion. */
+  native = gst_color_conv_get_native_pad (conv);
+  if (native) {
+    native_ret = gst_pad_push (native, gst_buffer_ref (buffer));
+    gst_object_unref (native);
+  }
+
+  /*
+   * Converted or captured after the base class, which negotiates on 0.10.
+   * I420 output is posted as it is pushed instead.
+   */
+  snapshot = g_atomic_int_get (&conv->snapshot_frames) > 0
+      && !conv->snapshot_output;
+  if (G_UNLIKELY (snapshot || conv->capture)) {
+    inbuf = gst_buffer_ref (buffer);
+  }
+
+  if (conv->decimation_count % conv->cur_decimation != 0) {
+    GST_LOG_OBJECT (conv, "decimating frame");
+    gst_buffer_unref (buffer);
+    ret = GST_FLOW_OK;
+  } else {
+    /* Base class transforms and pushes from here. */
+#if GST_CHECK_VERSION (1,0,0)
+    ret = conv->base_chain (pad, parent, buffer);
+#else
+    ret = conv->base_chain (pad, buffer);
+#endif
+  }
+
+  /* Counted after set_caps, which 0.10 calls from the chain above. */
+  conv->decimation_count++;
+
+  if (G_UNLIKELY (inbuf)) {
+    if (conv->capture) {
+      gst_color_conv_capture_frame (conv, inbuf);
+    }
+
+    if (snapshot) {
+      push_ret = gst_color_conv_snapshot_frame (conv, inbuf);
+      if (ret == GST_FLOW_OK) {
+        ret = push_ret;
+      }
+    }
+
+    gst_buffer_unref (inbuf);
+  }
+
+  /* Downstream's flow comes back through the push task. */
+  if (conv->stream && ret == GST_FLOW_OK) {
+    ret = g_atomic_int_get (&conv->push_ret);
+  }
+
+  /*
+   * Like tee, upstream only hears about a failure once every linked
+   * branch failed, an unlinked one counts only if both are.
+   */
+  if (native_ret == GST_FLOW_OK) {
+    ret = GST_FLOW_OK;
+  } else if (ret == GST_FLOW_NOT_LINKED) {
+    ret = native_ret;
+  }
+
+  if (G_UNLIKELY (conv->trace_push_start)) {
+    gst_color_conv_trace_record (conv->trace, GST_COLOR_CONV_TRACE_PUSH,
+        conv->trace_frame, conv->trace_push_start, g_get_monotonic_time ());
+    conv->trace_push_start = 0;
+  }
+
+  return ret;
+}
+
+/*
+ * How many conversions after start the warm-up ends with. The first frames
+ * in flight are not measured: they pay for the layout and read probes, the
+ * first lock of the input and cold pages on every lane. Called with the
+ * object lock held.
+ */
+static guint
+gst_color_conv_warmup_end (GstColorConv * conv)
+{
+  return conv->queue_depth + 1 + LATENCY_WARMUP_FRAMES;
+}
+
+/*
+ * Takes one conversion of @latency microseconds into the worst case of
+ * the warm-up frames. After the last of them that worst case is reported
+ * for good, and unless a latency is configured a latency message has the
+ * pipeline query it. Called from the streaming and lane threads.
+ */
+static void
+gst_color_conv_update_latency (GstColorConv * conv, gint64 latency)
+{
+  GstClockTime measured;
+  guint end;
+  gboolean warm;
+
+  GST_OBJECT_LOCK (conv);
+  end = gst_color_conv_warmup_end (conv);
+  if (conv->latency_frames == end) {
+    GST_OBJECT_UNLOCK (conv);
+    return;
+  }
+
+  if (conv->latency_frames++ > conv->queue_depth) {
+    conv->measured_latency = MAX (conv->measured_latency,
+        (GstClockTime) latency * GST_USECOND);
+  }
+  measured = conv->measured_latency;
+  warm = conv->latency_frames == end && !conv->latency;
+  GST_OBJECT_UNLOCK (conv);
+
+  if (warm) {
+    GST_DEBUG_OBJECT (conv, "worst conversion latency %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (measured));
+    gst_element_post_message (GST_ELEMENT (conv),
+        gst_message_new_latency (GST_OBJECT (conv)));
+  }
+}
+
+/*
+ * The conversion latency queries get: the configured one, or else the
+ * worst of the warm-up frames once they are done. Called with the object
+ * lock held.
+ */
+static GstClockTime
+gst_color_conv_reported_latency (GstColorConv * conv)
+{
+  if (conv->latency) {
+    return conv->latency;
+  }
+
+  if (conv->latency_frames == gst_color_conv_warmup_end (conv)) {
+    return conv->measured_latency;
+  }
+
+  return 0;
+}
+
+/*
+ * Adds the conversion latency to upstream's: the configured one, or else
+ * the worst of the warm-up frames. With a stream a frame may wait behind
+ * a full queue of them when the lanes fall behind. Without a configured
+ * latency nothing is added before the warm-up, which ends with a latency
+ * message.
+ */
+static gboolean
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+#else
+gst_color_conv_src_query (GstPad * pad, GstQuery * query)
+#endif
+{
+  GstColorConv *conv = GST_COLOR_CONV (GST_PAD_PARENT (pad));
+  GstClockTime min, max;
+  GstClockTime latency;
+  GstClockTime frame;
+  gboolean live;
+  guint depth;
+
+#if GST_CHECK_VERSION (1,0,0)
+  if (!conv->base_src_query (pad, parent, query)) {
+#else
+  if (!conv->base_src_query (pad, query)) {
+#endif
+    return FALSE;
+  }
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY) {
+    return TRUE;
+  }
+
+  GST_OBJECT_LOCK (conv);
+  latency = gst_color_conv_reported_latency (conv);
+  frame = GST_CLOCK_TIME_IS_VALID (conv->frame_duration) ?
+      conv->frame_duration : latency;
+  depth = conv->queue_depth;
+  GST_OBJECT_UNLOCK (conv);
+
+  gst_query_parse_latency (query, &live, &min, &max);
+
+  if (latency) {
+    min += latency;
+    if (GST_CLOCK_TIME_IS_VALID (max)) {
+      max += latency + depth * frame;
+    }
+  }
+
+  GST_DEBUG_OBJECT (conv, "latency min %" GST_TIME_FORMAT " max %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+
+  gst_query_set_latency (query, live, min, max);
+
+  return TRUE;
+}
+
+/*
+ * Deactivating the src pad waits for whatever streams from it, the push
+ * task has to be woken up and stopped first.
+ */
+static gboolean
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_src_activate (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+#else
+gst_color_conv_src_activate (GstPad * pad, gboolean active)
+#endif
+{
+  GstColorConv *conv = GST_COLOR_CONV (GST_PAD_PARENT (pad));
+
+  if (!active && conv->stream) {
+    gst_color_conv_stop_pushing (conv);
+  }
+
+#if GST_CHECK_VERSION (1,0,0)
+  return conv->base_src_activate (pad, parent, mode, active);
+#else
+  return conv->base_src_activate ? conv->base_src_activate (pad, active) :
+      TRUE;
+#endif
+}
+
+static gboolean
+gst_color_conv_dump_trace (GstColorConv * conv, const gchar * filename)
+{
+  gchar *file;
+  gboolean ret;
+
+  GST_OBJECT_LOCK (conv);
+  file = g_strdup (filename ? filename : conv->trace_file);
+  GST_OBJECT_UNLOCK (conv);
+
+  if (!file || !conv->trace) {
+    GST_DEBUG_OBJECT (conv, "nothing to dump");
+    g_free (file);
+    return FALSE;
+  }
+
+  ret = gst_color_conv_trace_dump (conv->trace, GST_OBJECT_NAME (conv), file);
+  if (!ret) {
+    GST_WARNING_OBJECT (conv, "failed to write trace to %s", file);
+  } else {
+    GST_INFO_OBJECT (conv, "wrote trace to %s", file);
+  }
+
+  g_free (file);
+
+  return ret;
+}
+
+static void
+gst_color_conv_snapshot (GstColorConv * conv, guint frames)
+{
+  GST_DEBUG_OBJECT (conv, "snapshot of %u frames requested", frames);
+
+  g_atomic_int_add (&conv->snapshot_frames,
+      MIN (frames, (guint) G_MAXINT / 2));
+}
+
+/*
+ * Converts @inbuf to a new I420 buffer for a snapshot message while the
+ * src pad pushes native buffers. With a stream the conversion runs on a
+ * lane like any other so the vendor converter is never entered from two
+ * threads.
+ */
+static GstFlowReturn
+gst_color_conv_snapshot_frame (GstColorConv * conv, GstBuffer * inbuf)
+{
+  GstColorConvPlanes planes;
+  GstBuffer *outbuf;
+  gboolean ret;
+  int width;
+  int height;
+#if GST_CHECK_VERSION (1,0,0)
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
+  int i;
+#endif
+
+  /* The first caps on 0.10 came with this very frame. */
+  if (conv->snapshot_output) {
+    return GST_FLOW_OK;
   }
 
-  if (!gst_structure_get_int (s, "height", &height)) {
-    GST_ELEMENT_ERROR (conv, STREAM, FORMAT, ("failed to get height"), (NULL));
-    return GST_FLOW_ERROR;
+  if (conv->width <= 0 || conv->height <= 0 || !IS_NATIVE_BUFFER (inbuf)) {
+    GST_DEBUG_OBJECT (conv, "cannot convert yet, keeping snapshot pending");
+    return GST_FLOW_OK;
   }
 
-  copy_buffer = (width != GST_ROUND_UP_4 (width));
-  if (copy_buffer) {
-    GST_INFO_OBJECT (conv, "manually padding buffer width from %d to %d", width, GST_ROUND_UP_4 (width));
-    out_data = g_malloc (GST_BUFFER_SIZE (outbuf));
-  } else {
-    out_data = GST_BUFFER_DATA (outbuf);
-  }
+  /* Native output skips the transform, which probes otherwise. */
+  gst_color_conv_ensure_layout (conv, inbuf);
 
-  if (!out_data) {
-    GST_ELEMENT_ERROR (conv, RESOURCE, NOT_FOUND, ("failed to allocate memory for output data"), (NULL));
-    return GST_FLOW_ERROR;
-  }
+  width = ORIENTED_WIDTH (conv->orient, conv->width, conv->height);
+  height = ORIENTED_HEIGHT (conv->orient, conv->width, conv->height);
+  gst_color_conv_planes_padded (&planes, width, height);
 
-  /* lock */
-  in_data = gst_color_conv_get_buffer_data (conv, inbuf, &in_locked);
-  if (!in_data) {
-    if (copy_buffer) {
-      g_free (out_data);
-    }
+#if GST_CHECK_VERSION (1,0,0)
+  outbuf = gst_buffer_new_allocate (NULL, planes.size, NULL);
 
-    return GST_FLOW_ERROR;
+  for (i = 0; i < 3; i++) {
+    offset[i] = planes.offset[i];
+    stride[i] = planes.stride[i];
   }
 
-  /* Convert */
-  GST_LOG_OBJECT (conv, "sending buffer to backend for conversion");
-  ret =
-      conv->backend->convert (conv->backend->handle, width,
-      height, in_data, out_data);
+  gst_buffer_add_video_meta_full (outbuf, GST_VIDEO_FRAME_FLAG_NONE,
+      GST_VIDEO_FORMAT_I420, width, height, 3, offset, stride);
+#else
+  outbuf = gst_buffer_new_and_alloc (planes.size);
+#endif
 
-  /* unlock */
-  if (!gst_color_conv_unlock_buffer (conv, inbuf, in_locked)) {
-    GST_WARNING_OBJECT (conv, "failed to unlock inbuf");
-  }
+  GST_BUFFER_TIMESTAMP (outbuf) = GST_BUFFER_TIMESTAMP (inbuf);
+  GST_BUFFER_DURATION (outbuf) = GST_BUFFER_DURATION (inbuf);
 
-  if (!ret) {
-    GST_ELEMENT_ERROR (conv, LIBRARY, ENCODE, ("failed to convert"), (NULL));
+  g_atomic_int_add (&conv->snapshot_frames, -1);
 
-    if (copy_buffer) {
-      g_free (out_data);
-    }
+  if (conv->stream) {
+    ret = gst_color_conv_submit_job (conv, inbuf, outbuf, TRUE);
+    gst_buffer_unref (outbuf);
 
-    return GST_FLOW_ERROR;
+    return ret ? GST_FLOW_OK : GST_FLOW_WRONG_STATE;
   }
 
-  if (copy_buffer) {
-    gst_color_conv_copy_buffer (outbuf, out_data, width, height);
-    g_free (out_data);
+  if (!gst_color_conv_convert_frame (conv, inbuf, outbuf, conv->width,
+          conv->height, conv->lane, conv->trace_frame)) {
+    gst_buffer_unref (outbuf);
+    return GST_FLOW_ERROR;
   }
 
+  gst_color_conv_post_snapshot (conv, outbuf);
+
   return GST_FLOW_OK;
 }
 
-static GstFlowReturn
-gst_color_conv_prepare_output_buffer (GstBaseTransform *
-    trans, GstBuffer * input, gint size, GstCaps * caps, GstBuffer ** buf)
+/*
+ * Posts @buffer, about to be pushed, if a snapshot is pending. Only the
+ * thread pushing converted frames takes snapshots from them.
+ */
+static void
+gst_color_conv_snapshot_output (GstColorConv * conv, GstBuffer * buffer)
 {
-  GST_DEBUG_OBJECT (trans, "prepare output buffer %" GST_PTR_FORMAT, caps);
-
-  if (IS_NATIVE_CAPS (caps)) {
-    /* We just ref the buffer because we will push it as it is. */
-    *buf = gst_buffer_ref (input);
-    return GST_FLOW_OK;
-  }
-
-  *buf = gst_buffer_new_and_alloc (size);
-  if (!*buf) {
-    GST_ELEMENT_ERROR (trans, LIBRARY, FAILED,
-        ("Could not allocate buffer"), (NULL));
-    return GST_FLOW_ERROR;
+  if (G_LIKELY (g_atomic_int_get (&conv->snapshot_frames) <= 0)) {
+    return;
   }
 
-  gst_buffer_set_caps (*buf, caps);
+  g_atomic_int_add (&conv->snapshot_frames, -1);
 
-  return GST_FLOW_OK;
+#if GST_CHECK_VERSION (1,0,0)
+  gst_color_conv_post_snapshot (conv, gst_buffer_ref (buffer));
+#else
+  /* Gets its own caps without touching the ones pushed. */
+  gst_color_conv_post_snapshot (conv,
+      gst_buffer_make_metadata_writable (gst_buffer_ref (buffer)));
+#endif
 }
 
-static gboolean
-gst_color_conv_accept_caps (GstBaseTransform * trans,
-    GstPadDirection direction, GstCaps * caps)
+/* Posts a converted snapshot frame on the bus, takes @buffer */
+static void
+gst_color_conv_post_snapshot (GstColorConv * conv, GstBuffer * buffer)
 {
-  GstColorConv *conv = GST_COLOR_CONV (trans);
-
-  GST_DEBUG_OBJECT (conv, "accept caps: direction %i, caps %" GST_PTR_FORMAT,
-      direction, caps);
+  GstStructure *s;
+  GstCaps *caps;
+  int width = ORIENTED_WIDTH (conv->orient, conv->width, conv->height);
+  int height = ORIENTED_HEIGHT (conv->orient, conv->width, conv->height);
+#if GST_CHECK_VERSION (1,0,0)
+  GstSample *sample;
 
-  if (!conv->backend) {
-    if (!gst_color_conv_start (trans)) {
-      return FALSE;
-    }
-  }
+  caps = gst_caps_new_simple ("video/x-raw",
+      "format", G_TYPE_STRING, "I420",
+      "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+      "framerate", GST_TYPE_FRACTION, 0, 1, NULL);
 
-  if (IS_NATIVE_CAPS (caps)) {
-    GST_DEBUG_OBJECT (conv, "Cannot check format for native caps.");
-#if 0
-    int format;
-    int hal_format = conv->backend->get_hal_format (conv->backend->handle);
-    if (gst_structure_get_int (gst_caps_get_structure (caps, 0), "format",
-            &format)) {
-      GST_WARNING_OBJECT (trans, "failed to get format");
-      return FALSE;
-    }
+  sample = gst_sample_new (buffer, caps, &GST_BASE_TRANSFORM (conv)->segment,
+      NULL);
+  s = gst_structure_new (SNAPSHOT_MESSAGE, "sample", GST_TYPE_SAMPLE, sample,
+      NULL);
+  gst_sample_unref (sample);
+#else
+  caps = gst_caps_new_simple ("video/x-raw-yuv",
+      "format", GST_TYPE_FOURCC, GST_MAKE_FOURCC ('I', '4', '2', '0'),
+      "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+      "framerate", GST_TYPE_FRACTION, 0, 1, NULL);
 
-    if (format != hal_format) {
-      GST_WARNING_OBJECT (trans,
-          "backend format (0x%x) is not similar to caps format (0x%x)",
-          hal_format, format);
-      return FALSE;
-    }
+  gst_buffer_set_caps (buffer, caps);
+  s = gst_structure_new (SNAPSHOT_MESSAGE, "buffer", GST_TYPE_BUFFER, buffer,
+      NULL);
 #endif
-  } else {
-    GstVideoFormat fmt;
-    if (!gst_video_format_parse_caps (caps, &fmt, NULL, NULL)) {
-      GST_WARNING_OBJECT (trans, "failed to parse caps %" GST_PTR_FORMAT, caps);
-      return FALSE;
-    }
 
-    if (fmt != GST_VIDEO_FORMAT_I420) {
-      GST_WARNING_OBJECT (trans, "Only I420 is supported");
-      return FALSE;
-    }
-  }
+  gst_caps_unref (caps);
+  gst_buffer_unref (buffer);
 
-  return TRUE;
+  GST_DEBUG_OBJECT (conv, "posting %dx%d snapshot", width, height);
+
+  gst_element_post_message (GST_ELEMENT (conv),
+      gst_message_new_element (GST_OBJECT (conv), s));
 }
 
+/*
+ * Appends the input frame to the capture file. This runs on the streaming
+ * thread, possibly while a lane reads the same buffer, which only ever
+ * takes read locks.
+ */
 static void
-gst_color_conv_fixate_caps (GstBaseTransform * trans,
-    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+gst_color_conv_capture_frame (GstColorConv * conv, GstBuffer * buffer)
 {
-  GstStructure *in;
-  GstStructure *out;
-  int width;
-  int height;
-  int fps_n;
-  int fps_d;
+  GstColorConvCaptureFrame frame;
+  gboolean was_locked;
+  gboolean written;
+  void *data;
 
-  GST_DEBUG_OBJECT (trans, "fixate caps");
+  if (conv->width <= 0 || conv->height <= 0 || !IS_NATIVE_BUFFER (buffer)) {
+    return;
+  }
 
-  GST_LOG_OBJECT (trans, "caps %" GST_PTR_FORMAT, caps);
-  GST_LOG_OBJECT (trans, "othercaps %" GST_PTR_FORMAT, othercaps);
+  /* Native output skips the transform, which probes otherwise. */
+  gst_color_conv_ensure_layout (conv, buffer);
 
-  /* We care about width, height, format and framerate */
-  in = gst_caps_get_structure (caps, 0);
-  out = gst_caps_get_structure (othercaps, 0);
+  memset (&frame, 0, sizeof (frame));
+  frame.hal_format = conv->hal_format;
+  frame.width = conv->width;
+  frame.height = conv->height;
+  frame.timestamp = GST_BUFFER_TIMESTAMP (buffer);
 
-  if (gst_structure_get_int (in, "width", &width)) {
-    gst_structure_set (out, "width", G_TYPE_INT, width, NULL);
+  /*
+   * Without a layout gralloc reported, or in a format the kernels do not
+   * know, only the vendor converter knows what it reads. The frame is
+   * kept as opaque, with the data it would have been assumed to read.
+   */
+  if (conv->cpu_layout && gst_color_conv_can_convert (conv->hal_format)) {
+    frame.stride = conv->layout.stride;
+    frame.uv_offset = conv->layout.uv_offset;
+    frame.uv_stride = conv->layout.uv_stride;
+    frame.size = gst_color_conv_layout_size (&conv->layout, conv->hal_format,
+        conv->width, conv->height);
+  } else {
+    frame.flags = GST_COLOR_CONV_CAPTURE_FRAME_OPAQUE;
+    frame.size = gst_color_conv_input_size (conv->hal_format, conv->width,
+        conv->height);
   }
 
-  if (gst_structure_get_int (in, "height", &height)) {
-    gst_structure_set (out, "height", G_TYPE_INT, height, NULL);
-  }
+  if (frame.size) {
+    data = gst_color_conv_get_buffer_data (conv, buffer, &was_locked);
+    if (!data) {
+      return;
+    }
 
-  if (gst_structure_get_fraction (in, "framerate", &fps_n, &fps_d)) {
-    gst_structure_set (out, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+    written = gst_color_conv_capture_writer_add (conv->capture, &frame, data);
+
+    if (!gst_color_conv_unlock_buffer (conv, buffer, was_locked)) {
+      GST_WARNING_OBJECT (conv, "failed to unlock captured buffer");
+    }
+  } else {
+    written = gst_color_conv_capture_writer_add (conv->capture, &frame, NULL);
   }
 
-  GST_LOG_OBJECT (trans, "caps after fixating %" GST_PTR_FORMAT, othercaps);
+  if (!written) {
+    GST_WARNING_OBJECT (conv, "failed to write capture frame");
+    gst_color_conv_stop_capture (conv);
+  } else if (conv->cur_capture_frames > 0
+      && gst_color_conv_capture_writer_get_frames (conv->capture) >=
+      conv->cur_capture_frames) {
+    gst_color_conv_stop_capture (conv);
+  }
 }
 
-static void *
-gst_color_conv_get_buffer_data (GstColorConv * conv, GstBuffer * buffer,
-    gboolean * was_locked)
+static void
+gst_color_conv_stop_capture (GstColorConv * conv)
 {
-  GstNativeBuffer *native;
-  GstGralloc *gralloc;
-  int width;
-  int height;
-  buffer_handle_t *handle;
-  int err;
-  void *data;
+  guint frames = gst_color_conv_capture_writer_get_frames (conv->capture);
 
-  GST_DEBUG_OBJECT (conv, "get buffer data");
+  if (!gst_color_conv_capture_writer_free (conv->capture)) {
+    GST_WARNING_OBJECT (conv, "failed to finish capture file");
+  } else {
+    GST_INFO_OBJECT (conv, "captured %u frames", frames);
+  }
 
-  /*
-   * All input here is GstNativeBuffer
-   *
-   * If we have native caps then we lock manually because the format the buffer
-   * carries might not correspond to any known GStreamer video format
-   *
-   * If we have non native caps then we can safely lock the buffer using gst_native_buffer_lock ()
-   */
+  conv->capture = NULL;
+}
 
-  native = GST_NATIVE_BUFFER (buffer);
+/*
+ * Maps the output buffer for writing and works out where its planes are.
+ * On 1.x the layout comes from the GstVideoMeta if downstream negotiated
+ * one, otherwise it is the default layout for the caps.
+ */
+static gboolean
+gst_color_conv_map_output (GstColorConv * conv, GstBuffer * buffer,
+    int width, int height, GstColorConvFrame * frame)
+{
+#if GST_CHECK_VERSION (1,0,0)
+  GstVideoMeta *meta;
+  int i;
+#endif
 
-  if (!IS_NATIVE_CAPS (buffer->caps)) {
-    GST_LOG_OBJECT (conv, "buffer does not have native caps");
+  frame->buffer = buffer;
 
-    *was_locked = gst_native_buffer_is_locked (native);
-    if (*was_locked) {
-      GST_DEBUG_OBJECT (conv, "buffer already locked");
-      return GST_BUFFER_DATA (buffer);
-    }
+  /* Only the samples the converters produced are valid. */
+  gst_color_conv_planes_padded (&frame->planes, width, height);
 
-    GstVideoFormat fmt = GST_VIDEO_FORMAT_UNKNOWN;
-    if (!gst_video_format_parse_caps (buffer->caps, &fmt, NULL, NULL)) {
-      GST_ELEMENT_ERROR (conv, STREAM, FORMAT, ("failed to get format"),
-          (NULL));
-      return NULL;
-    }
+#if GST_CHECK_VERSION (1,0,0)
+  if (!gst_buffer_map (buffer, &frame->map, GST_MAP_WRITE)) {
+    return FALSE;
+  }
 
-    if (!gst_native_buffer_lock (native, fmt, BUFFER_LOCK_USAGE)) {
-      GST_ELEMENT_ERROR (conv, LIBRARY, FAILED,
-          ("Could not lock native buffer handle"), (NULL));
-      return NULL;
-    }
+  meta = gst_buffer_get_video_meta (buffer);
 
-    *was_locked = FALSE;
-    return GST_BUFFER_DATA (buffer);
+  for (i = 0; i < 3; i++) {
+    if (meta) {
+      frame->planes.stride[i] = meta->stride[i];
+      frame->planes.offset[i] = meta->offset[i];
+    } else {
+      frame->planes.stride[i] = GST_VIDEO_INFO_PLANE_STRIDE (&conv->out_info, i);
+      frame->planes.offset[i] = GST_VIDEO_INFO_PLANE_OFFSET (&conv->out_info, i);
+    }
   }
 
-  *was_locked = gst_native_buffer_is_locked (native);
-  if (*was_locked) {
-    GST_LOG_OBJECT (conv, "buffer already locked");
-    return GST_BUFFER_DATA (buffer);
-  }
+  frame->planes.size = frame->map.size;
+  frame->data = frame->map.data;
+#else
+  frame->data = GST_BUFFER_DATA (buffer);
+#endif
 
-  GST_LOG_OBJECT (conv, "locking manually");
+  return frame->data != NULL;
+}
 
-  *was_locked = FALSE;
-  gralloc = gst_native_buffer_get_gralloc (native);
-  width = gst_native_buffer_get_width (native);
-  height = gst_native_buffer_get_height (native);
-  handle = gst_native_buffer_get_handle (native);
+static void
+gst_color_conv_unmap_output (GstColorConvFrame * frame)
+{
+#if GST_CHECK_VERSION (1,0,0)
+  gst_buffer_unmap (frame->buffer, &frame->map);
+#endif
+}
 
-  err = gralloc->gralloc->lock (gralloc->gralloc,
-      *handle, BUFFER_LOCK_USAGE, 0, 0, width, height, &data);
+/* Returns a reference to the native pad, if requested */
+static GstPad *
+gst_color_conv_get_native_pad (GstColorConv * conv)
+{
+  GstPad *pad = NULL;
 
-  if (err != 0) {
-    GST_ELEMENT_ERROR (conv, LIBRARY, FAILED,
-        ("Could not lock native buffer handle"), (NULL));
-    return NULL;
+  GST_OBJECT_LOCK (conv);
+  if (conv->native_pad) {
+    pad = gst_object_ref (conv->native_pad);
   }
+  GST_OBJECT_UNLOCK (conv);
 
-  return data;
+  return pad;
 }
 
+#if GST_CHECK_VERSION (1,0,0)
 static gboolean
-gst_color_conv_unlock_buffer (GstColorConv * conv, GstBuffer * buffer,
-    gboolean was_locked)
+gst_color_conv_store_sticky_event (GstPad * pad, GstEvent ** event,
+    gpointer user_data)
 {
-  int err;
-  GstGralloc *gralloc;
-  buffer_handle_t *handle;
-  GstNativeBuffer *native;
+  gst_pad_store_sticky_event (GST_PAD (user_data), *event);
 
-  GST_DEBUG_OBJECT (conv, "unlock buffer");
+  return TRUE;
+}
+#endif
 
-  native = GST_NATIVE_BUFFER (buffer);
+/* Upstream events of the display branch go to the decoder, as with tee. */
+static gboolean
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_native_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+#else
+gst_color_conv_native_event (GstPad * pad, GstEvent * event)
+#endif
+{
+  GstColorConv *conv = GST_COLOR_CONV (GST_PAD_PARENT (pad));
 
-  if (was_locked) {
-    GST_LOG_OBJECT (conv, "buffer was already locked");
-    /* nothing */
-    return TRUE;
+  return gst_pad_push_event (GST_BASE_TRANSFORM_SINK_PAD (conv), event);
+}
+
+/*
+ * Queries are answered upstream, nothing on the display branch depends
+ * on the conversion. The caps are the input's.
+ */
+static gboolean
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_native_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+#else
+gst_color_conv_native_query (GstPad * pad, GstQuery * query)
+#endif
+{
+  GstColorConv *conv = GST_COLOR_CONV (GST_PAD_PARENT (pad));
+
+#if GST_CHECK_VERSION (1,0,0)
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CAPS
+      || GST_QUERY_TYPE (query) == GST_QUERY_ACCEPT_CAPS) {
+    return gst_pad_query_default (pad, parent, query);
   }
+#endif
 
-  if (!IS_NATIVE_CAPS (buffer->caps)) {
-    return gst_native_buffer_unlock (native);
+  return gst_pad_peer_query (GST_BASE_TRANSFORM_SINK_PAD (conv), query);
+}
+
+static GstIterator *
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_native_iterate_links (GstPad * pad, GstObject * parent)
+#else
+gst_color_conv_native_iterate_links (GstPad * pad)
+#endif
+{
+  GstColorConv *conv = GST_COLOR_CONV (GST_PAD_PARENT (pad));
+  GstIterator *it;
+#if GST_CHECK_VERSION (1,0,0)
+  GValue val = G_VALUE_INIT;
+
+  g_value_init (&val, GST_TYPE_PAD);
+  g_value_set_object (&val, GST_BASE_TRANSFORM_SINK_PAD (conv));
+  it = gst_iterator_new_single (GST_TYPE_PAD, &val);
+  g_value_unset (&val);
+#else
+  it = gst_iterator_new_single (GST_TYPE_PAD,
+      GST_BASE_TRANSFORM_SINK_PAD (conv),
+      (GstCopyFunction) gst_object_ref, (GFreeFunc) gst_object_unref);
+#endif
+
+  return it;
+}
+
+static GstPad *
+#if GST_CHECK_VERSION (1,0,0)
+gst_color_conv_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+#else
+gst_color_conv_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name)
+#endif
+{
+  GstColorConv *conv = GST_COLOR_CONV (element);
+  GstPad *pad;
+
+  GST_OBJECT_LOCK (conv);
+  if (conv->native_pad) {
+    GST_OBJECT_UNLOCK (conv);
+    GST_WARNING_OBJECT (conv, "native pad already requested");
+    return NULL;
   }
+  GST_OBJECT_UNLOCK (conv);
 
-  gralloc = gst_native_buffer_get_gralloc (native);
-  handle = gst_native_buffer_get_handle (native);
+  pad = gst_pad_new_from_static_template (&native_template, "native");
+  gst_pad_use_fixed_caps (pad);
+  gst_pad_set_event_function (pad,
+      GST_DEBUG_FUNCPTR (gst_color_conv_native_event));
+  gst_pad_set_query_function (pad,
+      GST_DEBUG_FUNCPTR (gst_color_conv_native_query));
+  gst_pad_set_iterate_internal_links_function (pad,
+      GST_DEBUG_FUNCPTR (gst_color_conv_native_iterate_links));
 
-  err = gralloc->gralloc->unlock (gralloc->gralloc, *handle);
+#if GST_CHECK_VERSION (1,0,0)
+  /* Replay caps and segment so the first buffer can go out right away. */
+  gst_pad_sticky_events_foreach (GST_BASE_TRANSFORM_SINK_PAD (conv),
+      gst_color_conv_store_sticky_event, pad);
+#endif
 
-  if (err != 0) {
-    return FALSE;
+  gst_pad_set_active (pad, GST_STATE (conv) > GST_STATE_READY);
+
+  if (!gst_element_add_pad (element, pad)) {
+    gst_object_unref (pad);
+    return NULL;
   }
 
-  return TRUE;
+  GST_OBJECT_LOCK (conv);
+  conv->native_pad = pad;
+  GST_OBJECT_UNLOCK (conv);
+
+  GST_DEBUG_OBJECT (conv, "added native pad");
+
+  return pad;
 }
 
 static void
-gst_color_conv_copy_buffer (GstBuffer * buff, guint8 *data, int width, int height)
+gst_color_conv_release_pad (GstElement * element, GstPad * pad)
 {
-  int stride = GST_ROUND_UP_4 (width);
-  int strideUV = stride/2;
-  guint8 *p = data;
-  guint8 *dst = GST_BUFFER_DATA (buff);
-  int i;
-  int x;
+  GstColorConv *conv = GST_COLOR_CONV (element);
 
-  /* Y */
-  for (i = height; i > 0; i--) {
-    memcpy(dst, p, width);
-    dst += stride;
-    p += width;
+  GST_OBJECT_LOCK (conv);
+  if (pad != conv->native_pad) {
+    GST_OBJECT_UNLOCK (conv);
+    return;
   }
 
-  /* U and V */
-  for (x = 0; x < 2; x++) {
-    for (i = height / 2; i > 0; i--) {
-      memcpy(dst, p, width / 2);
-      dst += strideUV;
-      p += width/2;
-    }
-  }
+  conv->native_pad = NULL;
+  GST_OBJECT_UNLOCK (conv);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+
+  GST_DEBUG_OBJECT (conv, "removed native pad");
 }
@@ -22,11 +22,56 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
+#include "gstcolorconvcompat.h"
 #include "gstcolorconvbackend.h"
+#include "gstcolorconvkernels.h"
+#if !GST_CHECK_VERSION (1,0,0)
+#include "gstcolorconvfdbuffer.h"
+#endif
+#include "gstcolorconvtrace.h"
+#include "gstcolorconvscheduler.h"
+#include "gstcolorconvtune.h"
+#include "gstcolorconvcapture.h"
 #include <gmodule.h>
 
 G_BEGIN_DECLS
 
+typedef enum {
+  GST_COLOR_CONV_OUTPUT_MEMORY_SYSTEM,
+  GST_COLOR_CONV_OUTPUT_MEMORY_MEMFD,
+} GstColorConvOutputMemory;
+
+typedef enum {
+  GST_COLOR_CONV_SCHEDULING_VENDOR,
+  GST_COLOR_CONV_SCHEDULING_CPU,
+  GST_COLOR_CONV_SCHEDULING_HYBRID,
+} GstColorConvScheduling;
+
+typedef enum {
+  GST_COLOR_CONV_READ_STRATEGY_AUTO,
+  GST_COLOR_CONV_READ_STRATEGY_DIRECT,
+  GST_COLOR_CONV_READ_STRATEGY_BOUNCE,
+} GstColorConvReadStrategy;
+
+typedef enum {
+  GST_COLOR_CONV_ROTATION_NONE,
+  GST_COLOR_CONV_ROTATION_90,
+  GST_COLOR_CONV_ROTATION_180,
+  GST_COLOR_CONV_ROTATION_270,
+} GstColorConvRotation;
+
+typedef enum {
+  GST_COLOR_CONV_FLIP_NONE,
+  GST_COLOR_CONV_FLIP_HORIZONTAL,
+  GST_COLOR_CONV_FLIP_VERTICAL,
+} GstColorConvFlip;
+
+typedef enum {
+  GST_COLOR_CONV_SKIP_UNCHANGED_NONE,
+  GST_COLOR_CONV_SKIP_UNCHANGED_SAMPLED,
+  GST_COLOR_CONV_SKIP_UNCHANGED_FULL,
+} GstColorConvSkipUnchanged;
+
 #define GST_TYPE_COLOR_CONV \
   (gst_color_conv_get_type())
 #define GST_COLOR_CONV(obj) \
@@ -48,10 +93,153 @@ struct _GstColorConv {
 
   GstColorConvBackend *backend;
   GModule *mod;
+
+  /* swapped by tuning, read with g_atomic_pointer_get () elsewhere */
+  const GstColorConvKernels *kernels;
+
+  GstColorConvRange range;
+  gboolean apply_luts;
+  GstColorConvLuts luts;
+
+  /* output orientation, GstColorConvOrient flags picked in set_caps */
+  GstColorConvRotation rotation;
+  GstColorConvFlip flip;
+  guint orient;
+
+  int width;
+  int height;
+
+#if GST_CHECK_VERSION (1,0,0)
+  const gralloc_module_t *gralloc;
+  GstVideoInfo out_info;
+  guint in_flight;
+#else
+  GstColorConvOutputMemory output_memory;
+  GstColorConvFdPool *fd_pool;
+  /* memfd allocation failed once, system memory until the next start */
+  gboolean fd_failed;
+#endif
+
+  gint tracing;
+  gchar *trace_file;
+  GstColorConvTrace *trace;
+  guint64 trace_frame;
+  gint64 trace_push_start;
+  GstPadChainFunction base_chain;
+  GstPadQueryFunction base_src_query;
+  GstPadActivateModeFunction base_src_activate;
+
+  int hal_format;
+  GstColorConvScheduling scheduling;
+  guint cpu_threads;
+  gboolean shared_scheduler;
+  guint frames_in_flight;
+  GstColorConvScheduling cur_scheduling;
+  GstColorConvLane lane;
+  gint fallbacks;
+
+  /* input plane layout, probed on the first frame after set_caps */
+  GstColorConvLayout layout;
+  gboolean layout_probed;
+  /* the CPU kernels can read the input */
+  gboolean cpu_layout;
+
+  /* input read path, cur_ values are picked on start or by the probe */
+  guint lock_usage;
+  GstColorConvReadStrategy read_strategy;
+  gdouble read_cost_threshold;
+  gint cur_lock_usage;
+  gint bounce;
+  guint read_probe;
+  gdouble cur_read_cost_threshold;
+  /* bounce buffers, one per conversion that can run at once */
+  GAsyncQueue *bounce_pool;
+  /* packed frames for padding or orienting, kept until the caps change */
+  GAsyncQueue *scratch_pool;
+
+  /*
+   * autotuned CPU conversion, looked up in set_caps or measured by
+   * tune_thread, which sets tuned once the streaming thread can pick up
+   * tuning for the tune_ size
+   */
+  GstColorConvTuneCache *tune_cache;
+  gboolean tune;
+  gboolean auto_threads;
+  GThread *tune_thread;
+  gint tuned;
+  gboolean tune_ret;
+  int tune_format;
+  int tune_width;
+  int tune_height;
+  GstColorConvTuning tuning;
+
+  /* request pad getting every input buffer untouched */
+  GstPad *native_pad;
+  guint decimation;
+  guint cur_decimation;
+  guint decimation_count;
+
+  /*
+   * repeated input re-emits the last output, checksum_sample is the
+   * sampling picked in set_caps or 0 when off
+   */
+  GstColorConvSkipUnchanged skip_unchanged;
+  guint checksum_sample;
+  gboolean checksum_valid;
+  guint64 checksum;
+  GstBuffer *last_out;
+  gint skipped_frames;
+  guint64 checksum_time;
+#if !GST_CHECK_VERSION (1,0,0)
+  /* input checksum prepare_output_buffer took for the next transform */
+  gboolean input_checksummed;
+  guint64 input_checksum;
+#endif
+
+  /*
+   * configured conversion latency, the worst measured over the warm-up
+   * frames and how many frames were converted since start, the frame
+   * duration, the pipeline latency from the last latency event and the
+   * frames a stream holds at most, all under the object lock, for latency
+   * queries and deadline drops
+   */
+  GstClockTime latency;
+  GstClockTime measured_latency;
+  guint latency_frames;
+  GstClockTime frame_duration;
+  GstClockTime pipeline_latency;
+  guint queue_depth;
+  gint deadline;
+  gint late_frames;
+
+  /*
+   * frames still to post snapshot messages of, taken from the output
+   * once that is I420 already
+   */
+  gint snapshot_frames;
+  gboolean snapshot_output;
+
+  /* raw input frames written for offline replay */
+  gchar *capture_file;
+  guint capture_frames;
+  guint cur_capture_frames;
+  GstColorConvCaptureWriter *capture;
+
+  /*
+   * hybrid or shared scheduling, the src pad task pushes the jobs in
+   * submission order and keeps the flow it got until the next flush
+   */
+  GstColorConvStream *stream;
+  gint push_ret;
+  gboolean push_discont;
 };
 
 struct _GstColorConvClass {
   GstBaseTransformClass parent_class;
+
+  /* actions */
+  gboolean (* dump_trace) (GstColorConv * conv, const gchar * filename);
+  void (* snapshot) (GstColorConv * conv, guint frames);
 };
 
 GType gst_color_conv_get_type (void);
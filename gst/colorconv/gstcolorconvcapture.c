@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvcapture.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ALIGN_UP(x) \
+  (((x) + GST_COLOR_CONV_CAPTURE_ALIGN - 1) & \
+      ~((guint64) GST_COLOR_CONV_CAPTURE_ALIGN - 1))
+
+G_STATIC_ASSERT (sizeof (GstColorConvCaptureHeader) ==
+    GST_COLOR_CONV_CAPTURE_ALIGN);
+G_STATIC_ASSERT (sizeof (GstColorConvCaptureFrame) ==
+    GST_COLOR_CONV_CAPTURE_ALIGN);
+
+struct _GstColorConvCaptureWriter
+{
+  FILE *file;
+  guint frames;
+};
+
+struct _GstColorConvCaptureReader
+{
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+  gsize offset;
+};
+
+/*
+ * Creates the capture file at path, replacing any existing one. Returns
+ * NULL if it cannot be written.
+ */
+GstColorConvCaptureWriter *
+gst_color_conv_capture_writer_new (const gchar * path)
+{
+  GstColorConvCaptureWriter *writer;
+  GstColorConvCaptureHeader header;
+  FILE *file = fopen (path, "wb");
+
+  if (!file) {
+    return NULL;
+  }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, GST_COLOR_CONV_CAPTURE_MAGIC, sizeof (header.magic));
+  header.version = GST_COLOR_CONV_CAPTURE_VERSION;
+  header.frame_header_size = sizeof (GstColorConvCaptureFrame);
+
+  if (fwrite (&header, sizeof (header), 1, file) != 1) {
+    fclose (file);
+    return NULL;
+  }
+
+  writer = g_new0 (GstColorConvCaptureWriter, 1);
+  writer->file = file;
+
+  return writer;
+}
+
+/*
+ * Appends one frame of frame->size bytes, data may be NULL if that is 0.
+ * A failed write leaves a short record at the end, which readers stop at.
+ */
+gboolean
+gst_color_conv_capture_writer_add (GstColorConvCaptureWriter * writer,
+    const GstColorConvCaptureFrame * frame, const guint8 * data)
+{
+  static const guint8 zeros[GST_COLOR_CONV_CAPTURE_ALIGN] = { 0, };
+  GstColorConvCaptureFrame header = *frame;
+  gsize padding = ALIGN_UP (frame->size) - frame->size;
+
+  memset (header.reserved, 0, sizeof (header.reserved));
+
+  if (fwrite (&header, sizeof (header), 1, writer->file) != 1
+      || fwrite (data, 1, frame->size, writer->file) != frame->size
+      || fwrite (zeros, 1, padding, writer->file) != padding) {
+    return FALSE;
+  }
+
+  writer->frames++;
+
+  return TRUE;
+}
+
+/*
+ * Where the planes of a captured frame are, to convert it with
+ * gst_color_conv_convert_layout (). Returns FALSE for opaque frames and
+ * frames too short for their layout, which the CPU cannot read.
+ */
+gboolean
+gst_color_conv_capture_frame_layout (const GstColorConvCaptureFrame * frame,
+    GstColorConvLayout * layout)
+{
+  gsize size;
+
+  if (frame->flags & GST_COLOR_CONV_CAPTURE_FRAME_OPAQUE) {
+    return FALSE;
+  }
+
+  layout->stride = frame->stride;
+  layout->uv_offset = frame->uv_offset;
+  layout->uv_stride = frame->uv_stride;
+
+  if (frame->hal_format == GST_COLOR_CONV_FORMAT_NV12
+      || frame->hal_format == GST_COLOR_CONV_FORMAT_NV21) {
+    if (!gst_color_conv_layout_valid (layout, frame->width, frame->height)) {
+      return FALSE;
+    }
+  }
+
+  size = gst_color_conv_layout_size (layout, frame->hal_format, frame->width,
+      frame->height);
+
+  return size > 0 && size <= frame->size;
+}
+
+guint
+gst_color_conv_capture_writer_get_frames (GstColorConvCaptureWriter * writer)
+{
+  return writer->frames;
+}
+
+/*
+ * Closes the file, returns FALSE if the buffered frames could not be
+ * written out.
+ */
+gboolean
+gst_color_conv_capture_writer_free (GstColorConvCaptureWriter * writer)
+{
+  gboolean ret = fclose (writer->file) == 0;
+
+  g_free (writer);
+
+  return ret;
+}
+
+/*
+ * Maps the capture file at path read only.
+ */
+GstColorConvCaptureReader *
+gst_color_conv_capture_reader_new (const gchar * path, GError ** error)
+{
+  GstColorConvCaptureReader *reader;
+  const GstColorConvCaptureHeader *header;
+  GMappedFile *file = g_mapped_file_new (path, FALSE, error);
+
+  if (!file) {
+    return NULL;
+  }
+
+  header = (const GstColorConvCaptureHeader *) g_mapped_file_get_contents
+      (file);
+
+  if (g_mapped_file_get_length (file) < sizeof (GstColorConvCaptureHeader)
+      || memcmp (header->magic, GST_COLOR_CONV_CAPTURE_MAGIC,
+          sizeof (header->magic)) != 0) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "%s is not a colorconv capture", path);
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  if (header->version != GST_COLOR_CONV_CAPTURE_VERSION
+      || header->frame_header_size != sizeof (GstColorConvCaptureFrame)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "%s has unsupported capture version %u", path, header->version);
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  reader = g_new0 (GstColorConvCaptureReader, 1);
+  reader->file = file;
+  reader->data = (const guint8 *) g_mapped_file_get_contents (file);
+  reader->size = g_mapped_file_get_length (file);
+  reader->offset = sizeof (GstColorConvCaptureHeader);
+
+  return reader;
+}
+
+/*
+ * Returns the next frame, its data points into the mapping and stays
+ * valid until the reader is freed. Returns FALSE at the end of the file or
+ * at a truncated record.
+ */
+gboolean
+gst_color_conv_capture_reader_next (GstColorConvCaptureReader * reader,
+    GstColorConvCaptureFrame * frame, const guint8 ** data)
+{
+  gsize start = reader->offset + sizeof (GstColorConvCaptureFrame);
+
+  if (start > reader->size) {
+    return FALSE;
+  }
+
+  memcpy (frame, reader->data + reader->offset, sizeof (*frame));
+
+  if (frame->size > reader->size - start) {
+    return FALSE;
+  }
+
+  *data = reader->data + start;
+  reader->offset = MIN (start + ALIGN_UP (frame->size), reader->size);
+
+  return TRUE;
+}
+
+void
+gst_color_conv_capture_reader_rewind (GstColorConvCaptureReader * reader)
+{
+  reader->offset = sizeof (GstColorConvCaptureHeader);
+}
+
+void
+gst_color_conv_capture_reader_free (GstColorConvCaptureReader * reader)
+{
+  g_mapped_file_unref (reader->file);
+  g_free (reader);
+}
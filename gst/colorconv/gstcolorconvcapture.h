@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_CAPTURE_H__
+#define __GST_COLOR_CONV_CAPTURE_H__
+
+#include <glib.h>
+#include "gstcolorconvkernels.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Capture files hold raw decoder output as the converters see it. A file
+ * header is followed by one record per frame: a frame header and the
+ * frame data, both padded to GST_COLOR_CONV_CAPTURE_ALIGN bytes so the
+ * data of a mapped file can be handed to the converters in place. All
+ * fields are in host byte order.
+ */
+#define GST_COLOR_CONV_CAPTURE_MAGIC "CCONVCAP"
+#define GST_COLOR_CONV_CAPTURE_VERSION 2
+#define GST_COLOR_CONV_CAPTURE_ALIGN 64
+
+/*
+ * The layout of the frame is not known, its data is the size the vendor
+ * converter was assumed to read, if any. Only that converter can take it.
+ */
+#define GST_COLOR_CONV_CAPTURE_FRAME_OPAQUE (1 << 0)
+
+typedef struct {
+  gchar magic[8];
+  guint32 version;
+  guint32 frame_header_size;
+  guint8 reserved[48];
+} GstColorConvCaptureHeader;
+
+typedef struct {
+  guint32 hal_format;
+  guint32 width;
+  guint32 height;
+  /* bytes between luma rows, tiled formats are laid out by the format */
+  guint32 stride;
+  guint64 size;
+  guint64 timestamp;
+  /* where interleaved chroma rows start and the bytes between them */
+  guint32 uv_offset;
+  guint32 uv_stride;
+  guint32 flags;
+  guint8 reserved[20];
+} GstColorConvCaptureFrame;
+
+typedef struct _GstColorConvCaptureWriter GstColorConvCaptureWriter;
+typedef struct _GstColorConvCaptureReader GstColorConvCaptureReader;
+
+GstColorConvCaptureWriter *gst_color_conv_capture_writer_new (const gchar * path);
+gboolean gst_color_conv_capture_writer_add (GstColorConvCaptureWriter * writer,
+    const GstColorConvCaptureFrame * frame, const guint8 *data);
+gboolean gst_color_conv_capture_frame_layout
+    (const GstColorConvCaptureFrame * frame, GstColorConvLayout * layout);
+
+guint gst_color_conv_capture_writer_get_frames (GstColorConvCaptureWriter * writer);
+gboolean gst_color_conv_capture_writer_free (GstColorConvCaptureWriter * writer);
+
+GstColorConvCaptureReader *gst_color_conv_capture_reader_new (const gchar * path,
+    GError ** error);
+gboolean gst_color_conv_capture_reader_next (GstColorConvCaptureReader * reader,
+    GstColorConvCaptureFrame * frame, const guint8 **data);
+void gst_color_conv_capture_reader_rewind (GstColorConvCaptureReader * reader);
+void gst_color_conv_capture_reader_free (GstColorConvCaptureReader * reader);
+
+G_END_DECLS
+
+#endif /* __GST_COLOR_CONV_CAPTURE_H__ */
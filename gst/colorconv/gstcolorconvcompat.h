@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_COMPAT_H__
+#define __GST_COLOR_CONV_COMPAT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+/*
+ * Small shims so gstcolorconv.c builds against both GStreamer 0.10 and 1.x.
+ * Anything bigger than a rename is handled inline with GST_CHECK_VERSION.
+ */
+
+G_BEGIN_DECLS
+
+#if GST_CHECK_VERSION (1,0,0)
+
+#include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
+#include <hardware/gralloc.h>
+
+/* Same caps name as libgstnativebuffer uses on 0.10. Each buffer holds a
+ * single buffer_handle_t, see the pad templates in gstcolorconv.c. */
+#define GST_NATIVE_BUFFER_NAME "video/x-android-buffer"
+
+#define GST_COLOR_CONV_CAPS_I420 GST_VIDEO_CAPS_MAKE ("I420")
+
+#define GST_FLOW_WRONG_STATE GST_FLOW_FLUSHING
+
+#define gst_element_class_set_details_simple gst_element_class_set_metadata
+
+static inline gboolean
+gst_color_conv_parse_caps (GstCaps * caps, GstVideoFormat * fmt, int *width,
+    int *height)
+{
+  GstVideoInfo info;
+
+  if (!gst_video_info_from_caps (&info, caps)) {
+    return FALSE;
+  }
+
+  if (fmt) {
+    *fmt = GST_VIDEO_INFO_FORMAT (&info);
+  }
+
+  if (width) {
+    *width = GST_VIDEO_INFO_WIDTH (&info);
+  }
+
+  if (height) {
+    *height = GST_VIDEO_INFO_HEIGHT (&info);
+  }
+
+  return TRUE;
+}
+
+#else
+
+#include <gst/gstnativebuffer.h>
+
+#define GST_COLOR_CONV_CAPS_I420 GST_VIDEO_CAPS_YUV ("{ I420 }")
+
+#define gst_color_conv_parse_caps gst_video_format_parse_caps
+
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_COLOR_CONV_COMPAT_H__ */
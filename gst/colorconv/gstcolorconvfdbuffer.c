@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvfdbuffer.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+GST_DEBUG_CATEGORY_EXTERN (colorconv_debug);
+#define GST_CAT_DEFAULT colorconv_debug
+
+/* Keep a few spare buffers around. Downstream rarely holds more than that. */
+#define MAX_FREE_BUFFERS 8
+
+struct _GstColorConvFdPool {
+  gint refcount;
+
+  GMutex lock;
+  gboolean flushing;
+  gsize size;
+  GSList *free;
+  guint n_free;
+};
+
+static GstBufferClass *fd_buffer_parent_class = NULL;
+
+static void gst_color_conv_fd_pool_unref (GstColorConvFdPool * pool);
+
+static int
+gst_color_conv_memfd_create (const char *name)
+{
+#ifdef HAVE_MEMFD_CREATE
+  return memfd_create (name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#elif defined (SYS_memfd_create)
+  return syscall (SYS_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+static void
+gst_color_conv_fd_buffer_release (GstColorConvFdBuffer * buf)
+{
+  if (GST_BUFFER_DATA (buf)) {
+    munmap (GST_BUFFER_DATA (buf), buf->size);
+    GST_BUFFER_DATA (buf) = NULL;
+  }
+
+  if (buf->fd != -1) {
+    close (buf->fd);
+    buf->fd = -1;
+  }
+}
+
+static gboolean
+gst_color_conv_fd_pool_recycle (GstColorConvFdPool * pool,
+    GstColorConvFdBuffer * buf)
+{
+  gboolean recycled = FALSE;
+
+  g_mutex_lock (&pool->lock);
+
+  if (!pool->flushing && pool->n_free < MAX_FREE_BUFFERS) {
+    /* resurrect the buffer, it will be finalized again once the pool goes */
+    gst_caps_replace (&GST_BUFFER_CAPS (buf), NULL);
+    GST_BUFFER_FLAGS (buf) = 0;
+    gst_buffer_ref (GST_BUFFER_CAST (buf));
+
+    pool->free = g_slist_prepend (pool->free, buf);
+    pool->n_free++;
+    recycled = TRUE;
+  }
+
+  g_mutex_unlock (&pool->lock);
+
+  return recycled;
+}
+
+static void
+gst_color_conv_fd_buffer_finalize (GstColorConvFdBuffer * buf)
+{
+  GstColorConvFdPool *pool = buf->pool;
+
+  if (pool && gst_color_conv_fd_pool_recycle (pool, buf)) {
+    return;
+  }
+
+  gst_color_conv_fd_buffer_release (buf);
+
+  if (pool) {
+    buf->pool = NULL;
+    gst_color_conv_fd_pool_unref (pool);
+  }
+
+  GST_MINI_OBJECT_CLASS (fd_buffer_parent_class)->finalize (GST_MINI_OBJECT
+      (buf));
+}
+
+static void
+gst_color_conv_fd_buffer_init (GstColorConvFdBuffer * buf, gpointer g_class)
+{
+  buf->fd = -1;
+  buf->size = 0;
+  buf->pool = NULL;
+}
+
+static void
+gst_color_conv_fd_buffer_class_init (gpointer g_class, gpointer class_data)
+{
+  GstMiniObjectClass *mini_object_class = GST_MINI_OBJECT_CLASS (g_class);
+
+  fd_buffer_parent_class = g_type_class_peek_parent (g_class);
+
+  mini_object_class->finalize =
+      (GstMiniObjectFinalizeFunction) gst_color_conv_fd_buffer_finalize;
+}
+
+GType
+gst_color_conv_fd_buffer_get_type (void)
+{
+  static GType fd_buffer_type = 0;
+
+  if (G_UNLIKELY (fd_buffer_type == 0)) {
+    static const GTypeInfo info = {
+      sizeof (GstBufferClass),
+      NULL,
+      NULL,
+      gst_color_conv_fd_buffer_class_init,
+      NULL,
+      NULL,
+      sizeof (GstColorConvFdBuffer),
+      0,
+      (GInstanceInitFunc) gst_color_conv_fd_buffer_init,
+      NULL
+    };
+
+    fd_buffer_type = g_type_register_static (GST_TYPE_BUFFER,
+        GST_COLOR_CONV_FD_BUFFER_TYPE_NAME, &info, 0);
+  }
+
+  return fd_buffer_type;
+}
+
+static GstColorConvFdBuffer *
+gst_color_conv_fd_buffer_new (GstColorConvFdPool * pool)
+{
+  GstColorConvFdBuffer *buf;
+  void *data;
+  int fd;
+
+  fd = gst_color_conv_memfd_create ("gstcolorconv");
+  if (fd == -1) {
+    GST_WARNING ("failed to create memfd: %s", g_strerror (errno));
+    return NULL;
+  }
+
+  if (ftruncate (fd, pool->size) == -1) {
+    GST_WARNING ("failed to size memfd to %" G_GSIZE_FORMAT ": %s",
+        pool->size, g_strerror (errno));
+    close (fd);
+    return NULL;
+  }
+
+  /*
+   * The size is fixed from now on. We can not seal writes because recycled
+   * buffers are written again.
+   */
+  if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+    GST_WARNING ("failed to seal memfd: %s", g_strerror (errno));
+    close (fd);
+    return NULL;
+  }
+
+  data = mmap (NULL, pool->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    GST_WARNING ("failed to map memfd: %s", g_strerror (errno));
+    close (fd);
+    return NULL;
+  }
+
+  buf = (GstColorConvFdBuffer *)
+      gst_mini_object_new (GST_TYPE_COLOR_CONV_FD_BUFFER);
+  buf->fd = fd;
+  buf->size = pool->size;
+  GST_BUFFER_DATA (buf) = data;
+  GST_BUFFER_SIZE (buf) = pool->size;
+
+  g_atomic_int_inc (&pool->refcount);
+  buf->pool = pool;
+
+  GST_LOG ("allocated memfd buffer %p fd %d", buf, fd);
+
+  return buf;
+}
+
+GstColorConvFdPool *
+gst_color_conv_fd_pool_new (gsize size)
+{
+  GstColorConvFdPool *pool = g_slice_new0 (GstColorConvFdPool);
+
+  pool->refcount = 1;
+  g_mutex_init (&pool->lock);
+  pool->size = size;
+
+  return pool;
+}
+
+gsize
+gst_color_conv_fd_pool_get_size (GstColorConvFdPool * pool)
+{
+  return pool->size;
+}
+
+GstBuffer *
+gst_color_conv_fd_pool_acquire (GstColorConvFdPool * pool)
+{
+  GstColorConvFdBuffer *buf = NULL;
+
+  g_mutex_lock (&pool->lock);
+
+  if (pool->free) {
+    buf = pool->free->data;
+    pool->free = g_slist_delete_link (pool->free, pool->free);
+    pool->n_free--;
+  }
+
+  g_mutex_unlock (&pool->lock);
+
+  if (!buf) {
+    buf = gst_color_conv_fd_buffer_new (pool);
+  }
+
+  return GST_BUFFER_CAST (buf);
+}
+
+static void
+gst_color_conv_fd_pool_unref (GstColorConvFdPool * pool)
+{
+  if (g_atomic_int_dec_and_test (&pool->refcount)) {
+    g_mutex_clear (&pool->lock);
+    g_slice_free (GstColorConvFdPool, pool);
+  }
+}
+
+void
+gst_color_conv_fd_pool_destroy (GstColorConvFdPool * pool)
+{
+  GSList *free;
+
+  g_mutex_lock (&pool->lock);
+  pool->flushing = TRUE;
+  free = pool->free;
+  pool->free = NULL;
+  pool->n_free = 0;
+  g_mutex_unlock (&pool->lock);
+
+  /* Buffers still downstream are released as they come back. */
+  g_slist_foreach (free, (GFunc) gst_mini_object_unref, NULL);
+  g_slist_free (free);
+
+  gst_color_conv_fd_pool_unref (pool);
+}
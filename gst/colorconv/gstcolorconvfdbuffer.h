@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_FD_BUFFER_H__
+#define __GST_COLOR_CONV_FD_BUFFER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Output buffers backed by a sealed memfd region. The memfd can not be
+ * resized (F_SEAL_SHRINK | F_SEAL_GROW) so a consumer in another process
+ * that receives the fd can safely mmap GST_BUFFER_SIZE bytes of it.
+ *
+ * Consumers that do not link against the plugin can look the type up by
+ * name and read the fd straight from the structure:
+ *
+ *   if (g_type_is_a (G_TYPE_FROM_INSTANCE (buf),
+ *           g_type_from_name (GST_COLOR_CONV_FD_BUFFER_TYPE_NAME)))
+ *     fd = GST_COLOR_CONV_FD_BUFFER_FD (buf);
+ */
+#define GST_COLOR_CONV_FD_BUFFER_TYPE_NAME "GstColorConvFdBuffer"
+
+#define GST_TYPE_COLOR_CONV_FD_BUFFER (gst_color_conv_fd_buffer_get_type())
+#define GST_IS_COLOR_CONV_FD_BUFFER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_COLOR_CONV_FD_BUFFER))
+#define GST_COLOR_CONV_FD_BUFFER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_COLOR_CONV_FD_BUFFER, GstColorConvFdBuffer))
+#define GST_COLOR_CONV_FD_BUFFER_FD(obj) \
+  (((GstColorConvFdBuffer *) (obj))->fd)
+
+typedef struct _GstColorConvFdBuffer GstColorConvFdBuffer;
+typedef struct _GstColorConvFdPool GstColorConvFdPool;
+
+struct _GstColorConvFdBuffer {
+  GstBuffer buffer;
+
+  int fd;
+  gsize size;
+
+  /* private */
+  GstColorConvFdPool *pool;
+};
+
+GType gst_color_conv_fd_buffer_get_type (void);
+
+GstColorConvFdPool *gst_color_conv_fd_pool_new (gsize size);
+gsize gst_color_conv_fd_pool_get_size (GstColorConvFdPool * pool);
+GstBuffer *gst_color_conv_fd_pool_acquire (GstColorConvFdPool * pool);
+void gst_color_conv_fd_pool_destroy (GstColorConvFdPool * pool);
+
+G_END_DECLS
+
+#endif /* __GST_COLOR_CONV_FD_BUFFER_H__ */
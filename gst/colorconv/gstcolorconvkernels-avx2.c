@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvkernels.h"
+#include "gstcolorconvkernels-x86.h"
+#include <immintrin.h>
+
+static void
+copy_avx2 (guint8 *dst, const guint8 *src, int n)
+{
+  int x;
+
+  for (x = 0; x + 128 <= n; x += 128) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (src + x));
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (src + x + 32));
+    __m256i c = _mm256_loadu_si256 ((const __m256i *) (src + x + 64));
+    __m256i d = _mm256_loadu_si256 ((const __m256i *) (src + x + 96));
+    _mm256_storeu_si256 ((__m256i *) (dst + x), a);
+    _mm256_storeu_si256 ((__m256i *) (dst + x + 32), b);
+    _mm256_storeu_si256 ((__m256i *) (dst + x + 64), c);
+    _mm256_storeu_si256 ((__m256i *) (dst + x + 96), d);
+  }
+
+  memcpy (dst + x, src + x, n - x);
+}
+
+/*
+ * MOVNTDQA pulls whole write combining lines at once on uncached
+ * mappings, on normal memory it behaves like a regular load. It needs
+ * aligned sources, so copy up to the first 32 byte boundary first.
+ */
+static void
+stream_copy_avx2 (guint8 *dst, const guint8 *src, int n)
+{
+  int x = (32 - ((guintptr) src & 31)) & 31;
+
+  x = MIN (x, n);
+  memcpy (dst, src, x);
+
+  for (; x + 128 <= n; x += 128) {
+    __m256i a = _mm256_stream_load_si256 ((__m256i *) (src + x));
+    __m256i b = _mm256_stream_load_si256 ((__m256i *) (src + x + 32));
+    __m256i c = _mm256_stream_load_si256 ((__m256i *) (src + x + 64));
+    __m256i d = _mm256_stream_load_si256 ((__m256i *) (src + x + 96));
+    _mm256_storeu_si256 ((__m256i *) (dst + x), a);
+    _mm256_storeu_si256 ((__m256i *) (dst + x + 32), b);
+    _mm256_storeu_si256 ((__m256i *) (dst + x + 64), c);
+    _mm256_storeu_si256 ((__m256i *) (dst + x + 96), d);
+  }
+
+  memcpy (dst + x, src + x, n - x);
+}
+
+static void
+deinterleave_avx2 (guint8 *u, guint8 *v, const guint8 *uv, int n)
+{
+  const __m256i mask = _mm256_set1_epi16 (0x00ff);
+  int x;
+
+  /*
+   * Same as the SSE2 version, but packing works per 128 bit lane so the
+   * 64 bit quarters come out as a0 b0 a1 b1 and need reordering.
+   */
+  for (x = 0; x + 32 <= n; x += 32) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (uv + 2 * x));
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (uv + 2 * x + 32));
+    __m256i pu = _mm256_packus_epi16 (_mm256_and_si256 (a, mask),
+        _mm256_and_si256 (b, mask));
+    __m256i pv = _mm256_packus_epi16 (_mm256_srli_epi16 (a, 8),
+        _mm256_srli_epi16 (b, 8));
+    _mm256_storeu_si256 ((__m256i *) (u + x),
+        _mm256_permute4x64_epi64 (pu, _MM_SHUFFLE (3, 1, 2, 0)));
+    _mm256_storeu_si256 ((__m256i *) (v + x),
+        _mm256_permute4x64_epi64 (pv, _MM_SHUFFLE (3, 1, 2, 0)));
+  }
+
+  for (; x < n; x++) {
+    u[x] = uv[2 * x];
+    v[x] = uv[2 * x + 1];
+  }
+}
+
+static void
+reverse_avx2 (guint8 *dst, const guint8 *src, int n)
+{
+  const __m256i shuffle = _mm256_setr_epi8 (15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0);
+  int x;
+
+  /* Byte shuffles stay within 128 bit lanes, swap those afterwards. */
+  for (x = 0; x + 32 <= n; x += 32) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (src + n - x - 32));
+    a = _mm256_shuffle_epi8 (a, shuffle);
+    _mm256_storeu_si256 ((__m256i *) (dst + x),
+        _mm256_permute4x64_epi64 (a, _MM_SHUFFLE (1, 0, 3, 2)));
+  }
+
+  for (; x < n; x++) {
+    dst[x] = src[n - 1 - x];
+  }
+}
+
+/*
+ * Even blocks are summed in the low 128 bit lane and odd ones in the high
+ * lane. Over 2 * pairs blocks block i weighs 2 * pairs - i in the second
+ * sums, which comes out as twice the lane's second sums for even blocks
+ * and as that minus the lane's first sums for odd ones.
+ */
+static void
+checksum_avx2 (guint32 sums[8], const guint8 *src, int n)
+{
+  __m256i s1 = _mm256_setzero_si256 ();
+  __m256i s2 = _mm256_setzero_si256 ();
+  guint32 pairs = n / 32;
+  guint32 a[8];
+  guint32 b[8];
+  int x, lane;
+
+  for (x = 0; x + 32 <= n; x += 32) {
+    s1 = _mm256_add_epi32 (s1,
+        _mm256_loadu_si256 ((const __m256i *) (src + x)));
+    s2 = _mm256_add_epi32 (s2, s1);
+  }
+
+  _mm256_storeu_si256 ((__m256i *) a, s1);
+  _mm256_storeu_si256 ((__m256i *) b, s2);
+
+  for (lane = 0; lane < 4; lane++) {
+    sums[4 + lane] += 2 * pairs * sums[lane] + 2 * b[lane] +
+        2 * b[4 + lane] - a[4 + lane];
+    sums[lane] += a[lane] + a[4 + lane];
+  }
+
+  gst_color_conv_checksum_sse2 (sums, src + x, n - x);
+}
+
+const GstColorConvKernels gst_color_conv_kernels_avx2 = {
+  "avx2",
+  copy_avx2,
+  stream_copy_avx2,
+  deinterleave_avx2,
+  gst_color_conv_lut_row,
+  reverse_avx2,
+  gst_color_conv_transpose_sse2,
+  checksum_avx2,
+};
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvkernels.h"
+#include <arm_neon.h>
+
+static void
+copy_neon (guint8 *dst, const guint8 *src, int n)
+{
+  int x;
+
+  for (x = 0; x + 64 <= n; x += 64) {
+    uint8x16_t a = vld1q_u8 (src + x);
+    uint8x16_t b = vld1q_u8 (src + x + 16);
+    uint8x16_t c = vld1q_u8 (src + x + 32);
+    uint8x16_t d = vld1q_u8 (src + x + 48);
+    vst1q_u8 (dst + x, a);
+    vst1q_u8 (dst + x + 16, b);
+    vst1q_u8 (dst + x + 32, c);
+    vst1q_u8 (dst + x + 48, d);
+  }
+
+  memcpy (dst + x, src + x, n - x);
+}
+
+static void
+deinterleave_neon (guint8 *u, guint8 *v, const guint8 *uv, int n)
+{
+  int x;
+
+  for (x = 0; x + 16 <= n; x += 16) {
+    uint8x16x2_t pairs = vld2q_u8 (uv + 2 * x);
+    vst1q_u8 (u + x, pairs.val[0]);
+    vst1q_u8 (v + x, pairs.val[1]);
+  }
+
+  for (; x < n; x++) {
+    u[x] = uv[2 * x];
+    v[x] = uv[2 * x + 1];
+  }
+}
+
+static void
+reverse_neon (guint8 *dst, const guint8 *src, int n)
+{
+  int x;
+
+  for (x = 0; x + 16 <= n; x += 16) {
+    uint8x16_t a = vrev64q_u8 (vld1q_u8 (src + n - x - 16));
+    vst1q_u8 (dst + x, vcombine_u8 (vget_high_u8 (a), vget_low_u8 (a)));
+  }
+
+  for (; x < n; x++) {
+    dst[x] = src[n - 1 - x];
+  }
+}
+
+static void
+transpose_neon (guint8 *dst, int dst_stride, const guint8 *src,
+    int src_stride)
+{
+  uint8x8x2_t t01, t23, t45, t67;
+  uint16x4x2_t u02, u13, u46, u57;
+  uint32x2x2_t v04, v15, v26, v37;
+
+  /* Transpose 2x2 blocks of bytes, then of halfwords, then of words. */
+  t01 = vtrn_u8 (vld1_u8 (src), vld1_u8 (src + src_stride));
+  t23 = vtrn_u8 (vld1_u8 (src + 2 * src_stride),
+      vld1_u8 (src + 3 * src_stride));
+  t45 = vtrn_u8 (vld1_u8 (src + 4 * src_stride),
+      vld1_u8 (src + 5 * src_stride));
+  t67 = vtrn_u8 (vld1_u8 (src + 6 * src_stride),
+      vld1_u8 (src + 7 * src_stride));
+
+  u02 = vtrn_u16 (vreinterpret_u16_u8 (t01.val[0]),
+      vreinterpret_u16_u8 (t23.val[0]));
+  u13 = vtrn_u16 (vreinterpret_u16_u8 (t01.val[1]),
+      vreinterpret_u16_u8 (t23.val[1]));
+  u46 = vtrn_u16 (vreinterpret_u16_u8 (t45.val[0]),
+      vreinterpret_u16_u8 (t67.val[0]));
+  u57 = vtrn_u16 (vreinterpret_u16_u8 (t45.val[1]),
+      vreinterpret_u16_u8 (t67.val[1]));
+
+  v04 = vtrn_u32 (vreinterpret_u32_u16 (u02.val[0]),
+      vreinterpret_u32_u16 (u46.val[0]));
+  v26 = vtrn_u32 (vreinterpret_u32_u16 (u02.val[1]),
+      vreinterpret_u32_u16 (u46.val[1]));
+  v15 = vtrn_u32 (vreinterpret_u32_u16 (u13.val[0]),
+      vreinterpret_u32_u16 (u57.val[0]));
+  v37 = vtrn_u32 (vreinterpret_u32_u16 (u13.val[1]),
+      vreinterpret_u32_u16 (u57.val[1]));
+
+  vst1_u8 (dst, vreinterpret_u8_u32 (v04.val[0]));
+  vst1_u8 (dst + dst_stride, vreinterpret_u8_u32 (v15.val[0]));
+  vst1_u8 (dst + 2 * dst_stride, vreinterpret_u8_u32 (v26.val[0]));
+  vst1_u8 (dst + 3 * dst_stride, vreinterpret_u8_u32 (v37.val[0]));
+  vst1_u8 (dst + 4 * dst_stride, vreinterpret_u8_u32 (v04.val[1]));
+  vst1_u8 (dst + 5 * dst_stride, vreinterpret_u8_u32 (v15.val[1]));
+  vst1_u8 (dst + 6 * dst_stride, vreinterpret_u8_u32 (v26.val[1]));
+  vst1_u8 (dst + 7 * dst_stride, vreinterpret_u8_u32 (v37.val[1]));
+}
+
+static void
+checksum_neon (guint32 sums[8], const guint8 *src, int n)
+{
+  uint32x4_t s1 = vld1q_u32 (sums);
+  uint32x4_t s2 = vld1q_u32 (sums + 4);
+  int x;
+
+  for (x = 0; x + 16 <= n; x += 16) {
+    s1 = vaddq_u32 (s1, vreinterpretq_u32_u8 (vld1q_u8 (src + x)));
+    s2 = vaddq_u32 (s2, s1);
+  }
+
+  vst1q_u32 (sums, s1);
+  vst1q_u32 (sums + 4, s2);
+}
+
+const GstColorConvKernels gst_color_conv_kernels_neon = {
+  "neon",
+  copy_neon,
+  copy_neon,
+  deinterleave_neon,
+  gst_color_conv_lut_row,
+  reverse_neon,
+  transpose_neon,
+  checksum_neon,
+};
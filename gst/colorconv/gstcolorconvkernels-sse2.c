@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvkernels.h"
+#include "gstcolorconvkernels-x86.h"
+
+static void
+copy_sse2 (guint8 *dst, const guint8 *src, int n)
+{
+  int x;
+
+  for (x = 0; x + 64 <= n; x += 64) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src + x));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src + x + 16));
+    __m128i c = _mm_loadu_si128 ((const __m128i *) (src + x + 32));
+    __m128i d = _mm_loadu_si128 ((const __m128i *) (src + x + 48));
+    _mm_storeu_si128 ((__m128i *) (dst + x), a);
+    _mm_storeu_si128 ((__m128i *) (dst + x + 16), b);
+    _mm_storeu_si128 ((__m128i *) (dst + x + 32), c);
+    _mm_storeu_si128 ((__m128i *) (dst + x + 48), d);
+  }
+
+  memcpy (dst + x, src + x, n - x);
+}
+
+static void
+deinterleave_sse2 (guint8 *u, guint8 *v, const guint8 *uv, int n)
+{
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  int x;
+
+  /* Mask out the even bytes, shift down the odd ones, pack both. */
+  for (x = 0; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (uv + 2 * x));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (uv + 2 * x + 16));
+    __m128i ua = _mm_and_si128 (a, mask);
+    __m128i ub = _mm_and_si128 (b, mask);
+    __m128i va = _mm_srli_epi16 (a, 8);
+    __m128i vb = _mm_srli_epi16 (b, 8);
+    _mm_storeu_si128 ((__m128i *) (u + x), _mm_packus_epi16 (ua, ub));
+    _mm_storeu_si128 ((__m128i *) (v + x), _mm_packus_epi16 (va, vb));
+  }
+
+  for (; x < n; x++) {
+    u[x] = uv[2 * x];
+    v[x] = uv[2 * x + 1];
+  }
+}
+
+static void
+reverse_sse2 (guint8 *dst, const guint8 *src, int n)
+{
+  int x;
+
+  /* Reverse the dwords, the words in them, then the bytes in those. */
+  for (x = 0; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src + n - x - 16));
+    a = _mm_shuffle_epi32 (a, _MM_SHUFFLE (0, 1, 2, 3));
+    a = _mm_shufflelo_epi16 (a, _MM_SHUFFLE (2, 3, 0, 1));
+    a = _mm_shufflehi_epi16 (a, _MM_SHUFFLE (2, 3, 0, 1));
+    a = _mm_or_si128 (_mm_slli_epi16 (a, 8), _mm_srli_epi16 (a, 8));
+    _mm_storeu_si128 ((__m128i *) (dst + x), a);
+  }
+
+  for (; x < n; x++) {
+    dst[x] = src[n - 1 - x];
+  }
+}
+
+const GstColorConvKernels gst_color_conv_kernels_sse2 = {
+  "sse2",
+  copy_sse2,
+  copy_sse2,
+  deinterleave_sse2,
+  gst_color_conv_lut_row,
+  reverse_sse2,
+  gst_color_conv_transpose_sse2,
+  gst_color_conv_checksum_sse2,
+};
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvkernels.h"
+#include "gstcolorconvkernels-x86.h"
+#include <tmmintrin.h>
+
+static void
+deinterleave_ssse3 (guint8 *u, guint8 *v, const guint8 *uv, int n)
+{
+  const __m128i shuffle = _mm_setr_epi8 (0, 2, 4, 6, 8, 10, 12, 14,
+      1, 3, 5, 7, 9, 11, 13, 15);
+  int x;
+
+  /* Gather U into the low and V into the high half of each register. */
+  for (x = 0; x + 16 <= n; x += 16) {
+    __m128i a = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (uv +
+                2 * x)), shuffle);
+    __m128i b = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (uv +
+                2 * x + 16)), shuffle);
+    _mm_storeu_si128 ((__m128i *) (u + x), _mm_unpacklo_epi64 (a, b));
+    _mm_storeu_si128 ((__m128i *) (v + x), _mm_unpackhi_epi64 (a, b));
+  }
+
+  for (; x < n; x++) {
+    u[x] = uv[2 * x];
+    v[x] = uv[2 * x + 1];
+  }
+}
+
+/* SSSE3 adds nothing for plain copies. */
+static void
+copy_ssse3 (guint8 *dst, const guint8 *src, int n)
+{
+  memcpy (dst, src, n);
+}
+
+static void
+reverse_ssse3 (guint8 *dst, const guint8 *src, int n)
+{
+  const __m128i shuffle = _mm_setr_epi8 (15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0);
+  int x;
+
+  for (x = 0; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src + n - x - 16));
+    _mm_storeu_si128 ((__m128i *) (dst + x), _mm_shuffle_epi8 (a, shuffle));
+  }
+
+  for (; x < n; x++) {
+    dst[x] = src[n - 1 - x];
+  }
+}
+
+const GstColorConvKernels gst_color_conv_kernels_ssse3 = {
+  "ssse3",
+  copy_ssse3,
+  copy_ssse3,
+  deinterleave_ssse3,
+  gst_color_conv_lut_row,
+  reverse_ssse3,
+  gst_color_conv_transpose_sse2,
+  gst_color_conv_checksum_sse2,
+};
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_KERNELS_X86_H__
+#define __GST_COLOR_CONV_KERNELS_X86_H__
+
+#include <emmintrin.h>
+
+/*
+ * 8x8 byte transpose shared by the x86 kernel sets. SSSE3 and AVX2 have
+ * nothing that beats three rounds of SSE2 unpacks at this block size.
+ */
+static inline void
+gst_color_conv_transpose_sse2 (guint8 *dst, int dst_stride,
+    const guint8 *src, int src_stride)
+{
+  __m128i r0, r1, r2, r3, c0, c1, c2, c3;
+
+  /* Interleave row pairs, then pairs of pairs, then quads. */
+  r0 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) src),
+      _mm_loadl_epi64 ((const __m128i *) (src + src_stride)));
+  r1 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (src +
+              2 * src_stride)),
+      _mm_loadl_epi64 ((const __m128i *) (src + 3 * src_stride)));
+  r2 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (src +
+              4 * src_stride)),
+      _mm_loadl_epi64 ((const __m128i *) (src + 5 * src_stride)));
+  r3 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (src +
+              6 * src_stride)),
+      _mm_loadl_epi64 ((const __m128i *) (src + 7 * src_stride)));
+
+  c0 = _mm_unpacklo_epi16 (r0, r1);
+  c1 = _mm_unpackhi_epi16 (r0, r1);
+  c2 = _mm_unpacklo_epi16 (r2, r3);
+  c3 = _mm_unpackhi_epi16 (r2, r3);
+
+  /* Each register now holds two output rows. */
+  r0 = _mm_unpacklo_epi32 (c0, c2);
+  r1 = _mm_unpackhi_epi32 (c0, c2);
+  r2 = _mm_unpacklo_epi32 (c1, c3);
+  r3 = _mm_unpackhi_epi32 (c1, c3);
+
+  _mm_storel_epi64 ((__m128i *) dst, r0);
+  _mm_storel_epi64 ((__m128i *) (dst + dst_stride),
+      _mm_unpackhi_epi64 (r0, r0));
+  _mm_storel_epi64 ((__m128i *) (dst + 2 * dst_stride), r1);
+  _mm_storel_epi64 ((__m128i *) (dst + 3 * dst_stride),
+      _mm_unpackhi_epi64 (r1, r1));
+  _mm_storel_epi64 ((__m128i *) (dst + 4 * dst_stride), r2);
+  _mm_storel_epi64 ((__m128i *) (dst + 5 * dst_stride),
+      _mm_unpackhi_epi64 (r2, r2));
+  _mm_storel_epi64 ((__m128i *) (dst + 6 * dst_stride), r3);
+  _mm_storel_epi64 ((__m128i *) (dst + 7 * dst_stride),
+      _mm_unpackhi_epi64 (r3, r3));
+}
+
+/* Four 32 bit lane sums, SSE2 does them one 16 byte block at a time */
+static inline void
+gst_color_conv_checksum_sse2 (guint32 sums[8], const guint8 *src, int n)
+{
+  __m128i s1 = _mm_loadu_si128 ((const __m128i *) sums);
+  __m128i s2 = _mm_loadu_si128 ((const __m128i *) (sums + 4));
+  int x;
+
+  for (x = 0; x + 16 <= n; x += 16) {
+    s1 = _mm_add_epi32 (s1, _mm_loadu_si128 ((const __m128i *) (src + x)));
+    s2 = _mm_add_epi32 (s2, s1);
+  }
+
+  _mm_storeu_si128 ((__m128i *) sums, s1);
+  _mm_storeu_si128 ((__m128i *) (sums + 4), s2);
+}
+
+#endif /* __GST_COLOR_CONV_KERNELS_X86_H__ */
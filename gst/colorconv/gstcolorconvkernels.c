@@ -0,0 +1,904 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvkernels.h"
+
+#if defined (__arm__) && defined (HAVE_GETAUXVAL)
+#include <sys/auxv.h>
+#ifndef HWCAP_ARM_NEON
+#define HWCAP_ARM_NEON (1 << 12)
+#endif
+#endif
+
+#define ROUND_UP_2(x) (((x) + 1) & ~1)
+#define ROUND_UP_4(x) (((x) + 3) & ~3)
+
+/* QOMX_COLOR_FormatYUV420PackedSemiPlanar64x32Tile2m8ka */
+#define TILE_WIDTH 64
+#define TILE_HEIGHT 32
+#define TILE_SIZE (TILE_WIDTH * TILE_HEIGHT)
+#define TILE_GROUP_SIZE (4 * TILE_SIZE)
+
+#define READ_COST_RUNS 3
+
+/* FNV-1a parameters for folding the checksum lanes */
+#define CHECKSUM_BASIS G_GUINT64_CONSTANT (14695981039346656037)
+#define CHECKSUM_PRIME G_GUINT64_CONSTANT (1099511628211)
+
+#define KERNELS_ENV "COLORCONV_KERNELS"
+
+/* Transposes walk the plane in tiles of 8x8 blocks that stay in cache */
+#define TRANSPOSE_BLOCK 8
+#define TRANSPOSE_TILE 64
+
+static void
+copy_scalar (guint8 *dst, const guint8 *src, int n)
+{
+  memcpy (dst, src, n);
+}
+
+static void
+deinterleave_scalar (guint8 *u, guint8 *v, const guint8 *uv, int n)
+{
+  int x;
+
+  for (x = 0; x < n; x++) {
+    u[x] = uv[2 * x];
+    v[x] = uv[2 * x + 1];
+  }
+}
+
+static void
+reverse_scalar (guint8 *dst, const guint8 *src, int n)
+{
+  int x;
+
+  for (x = 0; x < n; x++) {
+    dst[x] = src[n - 1 - x];
+  }
+}
+
+static void
+transpose_scalar (guint8 *dst, int dst_stride, const guint8 *src,
+    int src_stride)
+{
+  int x, y;
+
+  for (y = 0; y < TRANSPOSE_BLOCK; y++) {
+    for (x = 0; x < TRANSPOSE_BLOCK; x++) {
+      dst[x * dst_stride + y] = src[y * src_stride + x];
+    }
+  }
+}
+
+static void
+checksum_scalar (guint32 sums[8], const guint8 *src, int n)
+{
+  guint32 words[4];
+  int x, lane;
+
+  for (x = 0; x + 16 <= n; x += 16) {
+    memcpy (words, src + x, sizeof (words));
+
+    for (lane = 0; lane < 4; lane++) {
+      sums[lane] += words[lane];
+      sums[4 + lane] += sums[lane];
+    }
+  }
+}
+
+const GstColorConvKernels gst_color_conv_kernels_scalar = {
+  "scalar",
+  copy_scalar,
+  copy_scalar,
+  deinterleave_scalar,
+  gst_color_conv_lut_row,
+  reverse_scalar,
+  transpose_scalar,
+  checksum_scalar,
+};
+
+/* Best first */
+static const GstColorConvKernels *all_kernels[] = {
+#ifdef HAVE_NEON_KERNELS
+  &gst_color_conv_kernels_neon,
+#endif
+#ifdef HAVE_AVX2_KERNELS
+  &gst_color_conv_kernels_avx2,
+#endif
+#ifdef HAVE_SSSE3_KERNELS
+  &gst_color_conv_kernels_ssse3,
+#endif
+#ifdef HAVE_SSE2_KERNELS
+  &gst_color_conv_kernels_sse2,
+#endif
+  &gst_color_conv_kernels_scalar,
+};
+
+static gboolean
+kernels_supported (const GstColorConvKernels * kernels)
+{
+#ifdef HAVE_NEON_KERNELS
+  if (kernels == &gst_color_conv_kernels_neon) {
+#if defined (__aarch64__)
+    return TRUE;
+#elif defined (HAVE_GETAUXVAL)
+    return (getauxval (AT_HWCAP) & HWCAP_ARM_NEON) != 0;
+#else
+    return FALSE;
+#endif
+  }
+#endif
+
+#ifdef HAVE_AVX2_KERNELS
+  if (kernels == &gst_color_conv_kernels_avx2) {
+    return __builtin_cpu_supports ("avx2");
+  }
+#endif
+
+#ifdef HAVE_SSSE3_KERNELS
+  if (kernels == &gst_color_conv_kernels_ssse3) {
+    return __builtin_cpu_supports ("ssse3");
+  }
+#endif
+
+#ifdef HAVE_SSE2_KERNELS
+  if (kernels == &gst_color_conv_kernels_sse2) {
+    return __builtin_cpu_supports ("sse2");
+  }
+#endif
+
+  return kernels == &gst_color_conv_kernels_scalar;
+}
+
+/*
+ * Fills list with the kernels this CPU can run, best first.
+ */
+guint
+gst_color_conv_kernels_get_supported (const GstColorConvKernels ** list,
+    guint size)
+{
+  guint i;
+  guint n = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (all_kernels) && n < size; i++) {
+    if (kernels_supported (all_kernels[i])) {
+      list[n++] = all_kernels[i];
+    }
+  }
+
+  return n;
+}
+
+/*
+ * Returns the named kernels if this CPU can run them, NULL otherwise.
+ */
+const GstColorConvKernels *
+gst_color_conv_kernels_get_by_name (const gchar * name)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (all_kernels); i++) {
+    if (!strcmp (all_kernels[i]->name, name)
+        && kernels_supported (all_kernels[i])) {
+      return all_kernels[i];
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Returns TRUE if COLORCONV_KERNELS picked the kernels, in which case
+ * autotuning must not replace them.
+ */
+gboolean
+gst_color_conv_kernels_forced (void)
+{
+  const gchar *forced = g_getenv (KERNELS_ENV);
+
+  return forced && gst_color_conv_kernels_get_by_name (forced) != NULL;
+}
+
+/*
+ * Returns the best kernels for this CPU. COLORCONV_KERNELS can force a
+ * specific set for benchmarking, unsupported names are ignored.
+ */
+const GstColorConvKernels *
+gst_color_conv_kernels_get (void)
+{
+  static gsize selected = 0;
+
+  if (g_once_init_enter (&selected)) {
+    const GstColorConvKernels *kernels = NULL;
+    const gchar *forced = g_getenv (KERNELS_ENV);
+
+    if (forced) {
+      kernels = gst_color_conv_kernels_get_by_name (forced);
+    }
+
+    if (!kernels) {
+      gst_color_conv_kernels_get_supported (&kernels, 1);
+    }
+
+    g_once_init_leave (&selected, (gsize) kernels);
+  }
+
+  return (const GstColorConvKernels *) selected;
+}
+
+/*
+ * BT.601/709 quantization: limited range luma spans [16, 235] and chroma
+ * spans [16, 240] centered on 128. Full range uses [0, 255] for both.
+ */
+static int
+div_round (int num, int den)
+{
+  return num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+static guint8
+range_remap (int value, int from_base, int from_range, int to_base,
+    int to_range)
+{
+  int v = to_base + div_round ((value - from_base) * to_range, from_range);
+
+  return CLAMP (v, 0, 255);
+}
+
+void
+gst_color_conv_range_build_luts (GstColorConvRange range, GstColorConvLuts luts)
+{
+  int i;
+
+  for (i = 0; i < 256; i++) {
+    switch (range) {
+      case GST_COLOR_CONV_RANGE_FULL_TO_LIMITED:
+        luts[0][i] = range_remap (i, 0, 255, 16, 219);
+        luts[1][i] = range_remap (i, 128, 255, 128, 224);
+        break;
+
+      case GST_COLOR_CONV_RANGE_LIMITED_TO_FULL:
+        luts[0][i] = range_remap (i, 16, 219, 0, 255);
+        luts[1][i] = range_remap (i, 128, 224, 128, 255);
+        break;
+
+      case GST_COLOR_CONV_RANGE_NONE:
+      default:
+        luts[0][i] = luts[1][i] = i;
+        break;
+    }
+  }
+
+  /* U and V share the same mapping. */
+  memcpy (luts[2], luts[1], 256);
+}
+
+void
+gst_color_conv_lut_row (guint8 *dst, const guint8 *src, const guint8 *lut, int n)
+{
+  int x;
+
+  /* Table lookups do not vectorize, unroll to keep the loads in flight. */
+  for (x = 0; x + 4 <= n; x += 4) {
+    guint8 a = lut[src[x]];
+    guint8 b = lut[src[x + 1]];
+    guint8 c = lut[src[x + 2]];
+    guint8 d = lut[src[x + 3]];
+    dst[x] = a;
+    dst[x + 1] = b;
+    dst[x + 2] = c;
+    dst[x + 3] = d;
+  }
+
+  for (; x < n; x++) {
+    dst[x] = lut[src[x]];
+  }
+}
+
+/*
+ * Layout written by the backends: tightly packed planes with the chroma
+ * planes subsampled by truncating, as II420ColorConverter produces.
+ */
+void
+gst_color_conv_planes_packed (GstColorConvPlanes * planes, int width, int height)
+{
+  planes->width[0] = planes->stride[0] = width;
+  planes->height[0] = height;
+  planes->offset[0] = 0;
+
+  planes->width[1] = planes->width[2] = width / 2;
+  planes->stride[1] = planes->stride[2] = width / 2;
+  planes->height[1] = planes->height[2] = height / 2;
+  planes->offset[1] = width * height;
+  planes->offset[2] = planes->offset[1] + (width / 2) * (height / 2);
+
+  planes->size = planes->offset[2] + (width / 2) * (height / 2);
+}
+
+/*
+ * Layout GStreamer expects for I420 buffers, see
+ * gst_video_format_get_row_stride () and gst_video_format_get_size ().
+ * Only the samples the backend produced are valid, hence the plane width
+ * and height stay truncated.
+ */
+void
+gst_color_conv_planes_padded (GstColorConvPlanes * planes, int width, int height)
+{
+  planes->width[0] = width;
+  planes->height[0] = height;
+  planes->stride[0] = ROUND_UP_4 (width);
+  planes->offset[0] = 0;
+
+  planes->width[1] = planes->width[2] = width / 2;
+  planes->height[1] = planes->height[2] = height / 2;
+  planes->stride[1] = planes->stride[2] = ROUND_UP_4 (ROUND_UP_2 (width) / 2);
+  planes->offset[1] = planes->stride[0] * ROUND_UP_2 (height);
+  planes->offset[2] =
+      planes->offset[1] + planes->stride[1] * (ROUND_UP_2 (height) / 2);
+
+  planes->size = planes->offset[2] + planes->stride[2] * (ROUND_UP_2 (height) / 2);
+}
+
+gboolean
+gst_color_conv_planes_equal (const GstColorConvPlanes * a,
+    const GstColorConvPlanes * b)
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    if (a->stride[i] != b->stride[i] || a->offset[i] != b->offset[i]) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/*
+ * Copies the visible samples of each plane from one layout to another,
+ * applying the range tables on the way if given. Repacking a frame onto
+ * itself with tables remaps it in place.
+ */
+void
+gst_color_conv_repack (const GstColorConvKernels * kernels,
+    guint8 *dst, const GstColorConvPlanes * dst_planes,
+    const guint8 *src, const GstColorConvPlanes * src_planes,
+    GstColorConvLuts luts)
+{
+  int plane;
+  int y;
+
+  for (plane = 0; plane < 3; plane++) {
+    guint8 *d = dst + dst_planes->offset[plane];
+    const guint8 *s = src + src_planes->offset[plane];
+    int width = MIN (dst_planes->width[plane], src_planes->width[plane]);
+    int height = MIN (dst_planes->height[plane], src_planes->height[plane]);
+
+    for (y = 0; y < height; y++) {
+      if (luts) {
+        kernels->lut (d, s, luts[plane], width);
+      } else if (d != s) {
+        kernels->copy (d, s, width);
+      }
+
+      d += dst_planes->stride[plane];
+      s += src_planes->stride[plane];
+    }
+  }
+}
+
+/*
+ * Writes the width x height plane at src transposed into dst. Tiles of
+ * TRANSPOSE_TILE square keep the destination rows a tile writes to in
+ * cache until the tile is done, edges that do not fill a whole block are
+ * done one sample at a time. A lut, if any, is applied to the rows of
+ * each tile before moving on.
+ */
+static void
+transpose_plane (const GstColorConvKernels * kernels, guint8 *dst,
+    int dst_stride, const guint8 *src, int src_stride, int width, int height,
+    const guint8 *lut)
+{
+  int tx, ty, x, y, bx, by;
+
+  for (ty = 0; ty < height; ty += TRANSPOSE_TILE) {
+    for (tx = 0; tx < width; tx += TRANSPOSE_TILE) {
+      int tw = MIN (TRANSPOSE_TILE, width - tx);
+      int th = MIN (TRANSPOSE_TILE, height - ty);
+
+      for (y = ty; y < ty + th; y += TRANSPOSE_BLOCK) {
+        for (x = tx; x < tx + tw; x += TRANSPOSE_BLOCK) {
+          if (y + TRANSPOSE_BLOCK <= height && x + TRANSPOSE_BLOCK <= width) {
+            kernels->transpose (dst + x * dst_stride + y, dst_stride,
+                src + y * src_stride + x, src_stride);
+            continue;
+          }
+
+          for (by = y; by < MIN (y + TRANSPOSE_BLOCK, height); by++) {
+            for (bx = x; bx < MIN (x + TRANSPOSE_BLOCK, width); bx++) {
+              dst[bx * dst_stride + by] = src[by * src_stride + bx];
+            }
+          }
+        }
+      }
+
+      if (lut) {
+        for (x = tx; x < tx + tw; x++) {
+          guint8 *row = dst + x * dst_stride + ty;
+
+          kernels->lut (row, row, lut, th);
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Copies the planes of src into dst in the given orientation, remapping
+ * them through luts on the way if given. dst planes have to be src planes
+ * with width and height swapped when transposing.
+ */
+void
+gst_color_conv_orient (const GstColorConvKernels * kernels,
+    guint8 *dst, const GstColorConvPlanes * dst_planes,
+    const guint8 *src, const GstColorConvPlanes * src_planes, guint orient,
+    GstColorConvLuts luts)
+{
+  int plane, y;
+
+  for (plane = 0; plane < 3; plane++) {
+    const guint8 *lut = luts ? luts[plane] : NULL;
+    guint8 *d = dst + dst_planes->offset[plane];
+    const guint8 *s = src + src_planes->offset[plane];
+    int dst_stride = dst_planes->stride[plane];
+    int src_stride = src_planes->stride[plane];
+    int width = src_planes->width[plane];
+    int height = src_planes->height[plane];
+
+    /* Mirroring vertically is walking the rows backwards. */
+    if (orient & GST_COLOR_CONV_ORIENT_VFLIP) {
+      s += (height - 1) * src_stride;
+      src_stride = -src_stride;
+    }
+
+    if (orient & GST_COLOR_CONV_ORIENT_TRANSPOSE) {
+      /* Source columns become destination rows, so mirror those. */
+      if (orient & GST_COLOR_CONV_ORIENT_HFLIP) {
+        d += (width - 1) * dst_stride;
+        dst_stride = -dst_stride;
+      }
+
+      transpose_plane (kernels, d, dst_stride, s, src_stride, width, height,
+          lut);
+      continue;
+    }
+
+    for (y = 0; y < height; y++) {
+      if (orient & GST_COLOR_CONV_ORIENT_HFLIP) {
+        kernels->reverse (d, s, width);
+        if (lut) {
+          kernels->lut (d, d, lut, width);
+        }
+      } else if (lut) {
+        kernels->lut (d, s, lut, width);
+      } else {
+        kernels->copy (d, s, width);
+      }
+
+      d += dst_stride;
+      s += src_stride;
+    }
+  }
+}
+
+static gsize
+tile_pos (gsize x, gsize y, gsize w, gsize h)
+{
+  gsize flim = x + (y & ~1) * w;
+
+  if (y & 1) {
+    flim += (x & ~3) + 2;
+  } else if ((h & 1) == 0 || y != (h - 1)) {
+    flim += (x + 2) & ~3;
+  }
+
+  return flim;
+}
+
+/*
+ * With a bounce buffer every row of tiles is first streamed into it and
+ * then detiled from cache, so the source is only read sequentially.
+ */
+static void
+convert_tiled (const GstColorConvKernels * kernels, int width, int height,
+    const guint8 *in, guint8 *y, guint8 *u, guint8 *v, guint8 *bounce)
+{
+  int tile_w = (width - 1) / TILE_WIDTH + 1;
+  int tile_w_align = (tile_w + 1) & ~1;
+  int tile_h_luma = (height - 1) / TILE_HEIGHT + 1;
+  int tile_h_chroma = (height / 2 - 1) / TILE_HEIGHT + 1;
+  gsize luma_size = tile_w_align * tile_h_luma * TILE_SIZE;
+  int tx, ty, row;
+
+  luma_size = (luma_size + TILE_GROUP_SIZE - 1) / TILE_GROUP_SIZE
+      * TILE_GROUP_SIZE;
+
+  /* Chroma tiles hold the chroma of two rows of luma tiles. */
+  for (ty = 0; ty < tile_h_luma; ty++) {
+    for (tx = 0; tx < tile_w; tx++) {
+      const guint8 *luma = in
+          + tile_pos (tx, ty, tile_w_align, tile_h_luma) * TILE_SIZE;
+      const guint8 *chroma = in + luma_size
+          + tile_pos (tx, ty / 2, tile_w_align, tile_h_chroma) * TILE_SIZE
+          + (ty & 1) * (TILE_SIZE / 2);
+      int tw = MIN (TILE_WIDTH, width - tx * TILE_WIDTH);
+      int th = MIN (TILE_HEIGHT, height - ty * TILE_HEIGHT);
+      int cx = tx * TILE_WIDTH / 2;
+      int cy = ty * TILE_HEIGHT / 2;
+
+      if (bounce) {
+        guint8 *staged = bounce + tx * (TILE_SIZE + TILE_SIZE / 2);
+
+        kernels->stream_copy (staged, luma, TILE_SIZE);
+        kernels->stream_copy (staged + TILE_SIZE, chroma, TILE_SIZE / 2);
+        luma = staged;
+        chroma = staged + TILE_SIZE;
+      }
+
+      for (row = 0; row < th; row++) {
+        kernels->copy (y + (ty * TILE_HEIGHT + row) * width + tx * TILE_WIDTH,
+            luma + row * TILE_WIDTH, tw);
+      }
+
+      for (row = 0; row < th / 2 && cy + row < height / 2; row++) {
+        kernels->deinterleave (u + (cy + row) * (width / 2) + cx,
+            v + (cy + row) * (width / 2) + cx, chroma + row * TILE_WIDTH,
+            tw / 2);
+      }
+    }
+  }
+}
+
+/* Copies rows of width bytes to packed ones, in one go if already packed */
+static void
+copy_rows (void (*copy) (guint8 * dst, const guint8 * src, int n),
+    guint8 *dst, const guint8 *src, int stride, int width, int rows)
+{
+  int row;
+
+  if (stride == width) {
+    copy (dst, src, width * rows);
+    return;
+  }
+
+  for (row = 0; row < rows; row++) {
+    copy (dst + row * width, src + row * stride, width);
+  }
+}
+
+static gboolean
+convert (const GstColorConvKernels * kernels, int format, int width,
+    int height, const GstColorConvLayout * layout, const guint8 *in,
+    guint8 *out, guint8 *bounce, int band_rows)
+{
+  GstColorConvLayout packed;
+  guint8 *u = out + width * height;
+  guint8 *v = u + (width / 2) * (height / 2);
+  const guint8 *uv;
+  int row, band;
+
+  if (!layout) {
+    gst_color_conv_layout_packed (&packed, width, height);
+    layout = &packed;
+  }
+
+  uv = in + layout->uv_offset;
+
+  switch (format) {
+    case GST_COLOR_CONV_FORMAT_NV21:
+      /* V comes first */
+      u = v;
+      v = out + width * height;
+      /* fall through */
+
+    case GST_COLOR_CONV_FORMAT_NV12:
+      if (!bounce) {
+        copy_rows (kernels->copy, out, in, layout->stride, width, height);
+
+        for (row = 0; row < height / 2; row++) {
+          kernels->deinterleave (u + row * (width / 2),
+              v + row * (width / 2), uv + row * layout->uv_stride, width / 2);
+        }
+
+        return TRUE;
+      }
+
+      /* Luma goes straight to the output, chroma is staged in bands. */
+      copy_rows (kernels->stream_copy, out, in, layout->stride, width, height);
+
+      for (band = 0; band < height / 2; band += band_rows) {
+        int rows = MIN (band_rows, height / 2 - band);
+
+        copy_rows (kernels->stream_copy, bounce,
+            uv + band * layout->uv_stride, layout->uv_stride, width, rows);
+
+        for (row = 0; row < rows; row++) {
+          kernels->deinterleave (u + (band + row) * (width / 2),
+              v + (band + row) * (width / 2), bounce + row * width,
+              width / 2);
+        }
+      }
+
+      return TRUE;
+
+    case GST_COLOR_CONV_FORMAT_TILED:
+      convert_tiled (kernels, width, height, in, out, u, v, bounce);
+      return TRUE;
+
+    default:
+      return FALSE;
+  }
+}
+
+gboolean
+gst_color_conv_can_convert (int format)
+{
+  switch (format) {
+    case GST_COLOR_CONV_FORMAT_NV12:
+    case GST_COLOR_CONV_FORMAT_NV21:
+    case GST_COLOR_CONV_FORMAT_TILED:
+      return TRUE;
+
+    default:
+      return FALSE;
+  }
+}
+
+/*
+ * Converts decoder output to packed I420, the same contract as the
+ * backend convert () call.
+ */
+gboolean
+gst_color_conv_convert (const GstColorConvKernels * kernels, int format,
+    int width, int height, const guint8 *in, guint8 *out)
+{
+  return convert (kernels, format, width, height, NULL, in, out, NULL, 0);
+}
+
+/* Fills in the layout of semi-planar input without any padding */
+void
+gst_color_conv_layout_packed (GstColorConvLayout * layout, int width,
+    int height)
+{
+  layout->stride = width;
+  layout->uv_offset = width * height;
+  layout->uv_stride = width;
+}
+
+/*
+ * Whether a layout gralloc reported can be read by the converters: rows
+ * at least width long and chroma after the last luma row.
+ */
+gboolean
+gst_color_conv_layout_valid (const GstColorConvLayout * layout, int width,
+    int height)
+{
+  return layout->stride >= width && layout->uv_stride >= width
+      && layout->uv_offset >= layout->stride * (height - 1) + width;
+}
+
+/*
+ * Bytes from the start of the input to the end of the last row the
+ * converters read, 0 if the format is not supported. Tiled input ignores
+ * the layout.
+ */
+gsize
+gst_color_conv_layout_size (const GstColorConvLayout * layout, int format,
+    int width, int height)
+{
+  switch (format) {
+    case GST_COLOR_CONV_FORMAT_NV12:
+    case GST_COLOR_CONV_FORMAT_NV21:
+      return layout->uv_offset + (gsize) layout->uv_stride * (height / 2 - 1)
+          + width;
+
+    default:
+      return gst_color_conv_input_size (format, width, height);
+  }
+}
+
+/*
+ * gst_color_conv_convert () or, given a bounce buffer,
+ * gst_color_conv_convert_bounced () for semi-planar input laid out as
+ * described instead of packed.
+ */
+gboolean
+gst_color_conv_convert_layout (const GstColorConvKernels * kernels,
+    int format, int width, int height, const GstColorConvLayout * layout,
+    const guint8 *in, guint8 *out, guint8 *bounce, int band_rows)
+{
+  g_return_val_if_fail (!bounce || band_rows > 0, FALSE);
+
+  return convert (kernels, format, width, height, layout, in, out, bounce,
+      band_rows);
+}
+
+/*
+ * Size of the decoder output gst_color_conv_convert () reads, 0 if the
+ * format is not supported.
+ */
+gsize
+gst_color_conv_input_size (int format, int width, int height)
+{
+  int tile_w_align = (((width - 1) / TILE_WIDTH + 1) + 1) & ~1;
+  int tile_h_luma = (height - 1) / TILE_HEIGHT + 1;
+  int tile_h_chroma = (height / 2 - 1) / TILE_HEIGHT + 1;
+  gsize luma;
+  gsize chroma;
+
+  switch (format) {
+    case GST_COLOR_CONV_FORMAT_NV12:
+    case GST_COLOR_CONV_FORMAT_NV21:
+      return width * height + width * (height / 2);
+
+    case GST_COLOR_CONV_FORMAT_TILED:
+      luma = tile_w_align * tile_h_luma * TILE_SIZE;
+      chroma = tile_w_align * tile_h_chroma * TILE_SIZE;
+
+      return (luma + TILE_GROUP_SIZE - 1) / TILE_GROUP_SIZE * TILE_GROUP_SIZE
+          + (chroma + TILE_GROUP_SIZE - 1) / TILE_GROUP_SIZE * TILE_GROUP_SIZE;
+
+    default:
+      return 0;
+  }
+}
+
+/*
+ * Luma row pitch of the decoder output, for tiled input the width of a
+ * row of tiles. 0 if the format is not supported.
+ */
+int
+gst_color_conv_input_stride (int format, int width)
+{
+  switch (format) {
+    case GST_COLOR_CONV_FORMAT_NV12:
+    case GST_COLOR_CONV_FORMAT_NV21:
+      return width;
+
+    case GST_COLOR_CONV_FORMAT_TILED:
+      return ((((width - 1) / TILE_WIDTH + 1) + 1) & ~1) * TILE_WIDTH;
+
+    default:
+      return 0;
+  }
+}
+
+/*
+ * Size of the bounce buffer gst_color_conv_convert_bounced () needs when
+ * staging band_rows rows of chroma at a time. Tiled input is staged a row
+ * of tiles at a time whatever band_rows is.
+ */
+gsize
+gst_color_conv_bounce_size (int format, int width, int band_rows)
+{
+  switch (format) {
+    case GST_COLOR_CONV_FORMAT_NV12:
+    case GST_COLOR_CONV_FORMAT_NV21:
+      return band_rows * width;
+
+    case GST_COLOR_CONV_FORMAT_TILED:
+      return ((width - 1) / TILE_WIDTH + 1) * (TILE_SIZE + TILE_SIZE / 2);
+
+    default:
+      return 0;
+  }
+}
+
+/*
+ * Same as gst_color_conv_convert () but reads the input only through
+ * stream_copy into the small, cached bounce buffer. Faster when the input
+ * is mapped uncached or write combined and the kernels would otherwise do
+ * narrow strided loads from it.
+ */
+gboolean
+gst_color_conv_convert_bounced (const GstColorConvKernels * kernels,
+    int format, int width, int height, const guint8 *in, guint8 *out,
+    guint8 *bounce, int band_rows)
+{
+  g_return_val_if_fail (band_rows > 0, FALSE);
+
+  return convert (kernels, format, width, height, NULL, in, out, bounce,
+      band_rows);
+}
+
+/*
+ * Fletcher style checksum of the size bytes at in, for telling repeated
+ * frames apart from new ones. With sample above 1 only the first of every
+ * sample blocks of GST_COLOR_CONV_CHECKSUM_BLOCK bytes is read, changes
+ * confined to the others go unnoticed. All kernel sets agree on the
+ * result.
+ */
+guint64
+gst_color_conv_checksum (const GstColorConvKernels * kernels,
+    const guint8 *in, gsize size, guint sample)
+{
+  gsize step = (gsize) MAX (sample, 1) * GST_COLOR_CONV_CHECKSUM_BLOCK;
+  guint32 sums[8] = { 0, };
+  guint64 hash = CHECKSUM_BASIS;
+  gsize offset;
+  int i;
+
+  for (offset = 0; offset < size; offset += step) {
+    int n = MIN (GST_COLOR_CONV_CHECKSUM_BLOCK, size - offset);
+
+    kernels->checksum (sums, in + offset, n & ~15);
+
+    /* Only the last block can be short, pad it with zeros. */
+    if (n & 15) {
+      guint8 tail[16] = { 0, };
+
+      memcpy (tail, in + offset + (n & ~15), n & 15);
+      kernels->checksum (sums, tail, sizeof (tail));
+    }
+  }
+
+  for (i = 0; i < 8; i++) {
+    hash = (hash ^ sums[i]) * CHECKSUM_PRIME;
+  }
+
+  return hash;
+}
+
+/*
+ * Returns how many times slower copying n bytes out of src is than copying
+ * them from cache. Write combined gralloc mappings typically come out an
+ * order of magnitude slower. scratch must hold 2 * n bytes.
+ */
+gdouble
+gst_color_conv_read_cost (const GstColorConvKernels * kernels,
+    const guint8 *src, int n, guint8 *scratch)
+{
+  gint64 mapped = G_MAXINT64;
+  gint64 cached = G_MAXINT64;
+  int i;
+
+  /* Fault in scratch and give cacheable sources a chance to be cached. */
+  kernels->copy (scratch, src, n);
+  kernels->copy (scratch + n, scratch, n);
+
+  for (i = 0; i < READ_COST_RUNS; i++) {
+    gint64 start = g_get_monotonic_time ();
+    gint64 middle;
+
+    kernels->copy (scratch + n, src, n);
+    middle = g_get_monotonic_time ();
+    kernels->copy (scratch + n, scratch, n);
+
+    mapped = MIN (mapped, middle - start);
+    cached = MIN (cached, g_get_monotonic_time () - middle);
+  }
+
+  return (gdouble) mapped / MAX (cached, 1);
+}
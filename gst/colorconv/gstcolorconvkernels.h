@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_KERNELS_H__
+#define __GST_COLOR_CONV_KERNELS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* OMX_COLOR_FORMATTYPE values reported by II420ColorConverter */
+#define GST_COLOR_CONV_FORMAT_NV12 0x15
+#define GST_COLOR_CONV_FORMAT_NV21 0x7FA30C00
+#define GST_COLOR_CONV_FORMAT_TILED 0x7FA30C03
+
+/* Interleaved chroma rows staged per bounce band unless tuned otherwise */
+#define GST_COLOR_CONV_BAND_ROWS 16
+
+/* Sampled checksums read one block of this many bytes in every few */
+#define GST_COLOR_CONV_CHECKSUM_BLOCK 4096
+
+/*
+ * Row kernels, one table per instruction set. The frame level helpers
+ * below are written in terms of these.
+ */
+typedef struct {
+  const gchar *name;
+
+  /* copy n bytes */
+  void (* copy) (guint8 *dst, const guint8 *src, int n);
+  /*
+   * copy n bytes out of uncached or write combined memory, sets without
+   * a streaming load reuse copy
+   */
+  void (* stream_copy) (guint8 *dst, const guint8 *src, int n);
+  /* split n interleaved sample pairs into two planes */
+  void (* deinterleave) (guint8 *u, guint8 *v, const guint8 *uv, int n);
+  /* dst[i] = lut[src[i]] */
+  void (* lut) (guint8 *dst, const guint8 *src, const guint8 *lut, int n);
+  /* dst[i] = src[n - 1 - i] */
+  void (* reverse) (guint8 *dst, const guint8 *src, int n);
+  /* transpose one 8x8 block, strides may be negative */
+  void (* transpose) (guint8 *dst, int dst_stride, const guint8 *src,
+      int src_stride);
+  /*
+   * add n bytes, n a multiple of 16, to four 32 bit lane sums: for every
+   * 16 bytes sums[0..3] += the words and then sums[4..7] += sums[0..3]
+   */
+  void (* checksum) (guint32 sums[8], const guint8 *src, int n);
+} GstColorConvKernels;
+
+extern const GstColorConvKernels gst_color_conv_kernels_scalar;
+#ifdef HAVE_SSE2_KERNELS
+extern const GstColorConvKernels gst_color_conv_kernels_sse2;
+#endif
+#ifdef HAVE_SSSE3_KERNELS
+extern const GstColorConvKernels gst_color_conv_kernels_ssse3;
+#endif
+#ifdef HAVE_AVX2_KERNELS
+extern const GstColorConvKernels gst_color_conv_kernels_avx2;
+#endif
+#ifdef HAVE_NEON_KERNELS
+extern const GstColorConvKernels gst_color_conv_kernels_neon;
+#endif
+
+const GstColorConvKernels *gst_color_conv_kernels_get (void);
+gboolean gst_color_conv_kernels_forced (void);
+const GstColorConvKernels *gst_color_conv_kernels_get_by_name (const gchar * name);
+guint gst_color_conv_kernels_get_supported (const GstColorConvKernels ** list,
+    guint size);
+
+typedef enum {
+  GST_COLOR_CONV_RANGE_NONE,
+  GST_COLOR_CONV_RANGE_FULL_TO_LIMITED,
+  GST_COLOR_CONV_RANGE_LIMITED_TO_FULL,
+} GstColorConvRange;
+
+/*
+ * Output orientation relative to the decoded frame, applied in this
+ * order: mirror horizontally, mirror vertically, transpose.
+ */
+typedef enum {
+  GST_COLOR_CONV_ORIENT_HFLIP = (1 << 0),
+  GST_COLOR_CONV_ORIENT_VFLIP = (1 << 1),
+  GST_COLOR_CONV_ORIENT_TRANSPOSE = (1 << 2),
+} GstColorConvOrient;
+
+/* One 256 entry table per I420 plane: Y, U, V */
+typedef guint8 GstColorConvLuts[3][256];
+
+/* Position of the three I420 planes inside a frame */
+typedef struct {
+  int width[3];
+  int height[3];
+  int stride[3];
+  int offset[3];
+  int size;
+} GstColorConvPlanes;
+
+void gst_color_conv_planes_packed (GstColorConvPlanes * planes, int width, int height);
+void gst_color_conv_planes_padded (GstColorConvPlanes * planes, int width, int height);
+gboolean gst_color_conv_planes_equal (const GstColorConvPlanes * a,
+    const GstColorConvPlanes * b);
+
+/*
+ * Where the luma and interleaved chroma rows of semi-planar input are,
+ * from the start of the buffer. Decoders pad rows and planes to their
+ * alignment, gralloc reports the real values. Tiled input has the layout
+ * its format defines and ignores this.
+ */
+typedef struct {
+  int stride;
+  int uv_offset;
+  int uv_stride;
+} GstColorConvLayout;
+
+void gst_color_conv_layout_packed (GstColorConvLayout * layout, int width,
+    int height);
+gboolean gst_color_conv_layout_valid (const GstColorConvLayout * layout,
+    int width, int height);
+gsize gst_color_conv_layout_size (const GstColorConvLayout * layout,
+    int format, int width, int height);
+
+gboolean gst_color_conv_can_convert (int format);
+gboolean gst_color_conv_convert (const GstColorConvKernels * kernels, int format,
+    int width, int height, const guint8 *in, guint8 *out);
+gsize gst_color_conv_input_size (int format, int width, int height);
+int gst_color_conv_input_stride (int format, int width);
+gsize gst_color_conv_bounce_size (int format, int width, int band_rows);
+gboolean gst_color_conv_convert_bounced (const GstColorConvKernels * kernels,
+    int format, int width, int height, const guint8 *in, guint8 *out,
+    guint8 *bounce, int band_rows);
+gboolean gst_color_conv_convert_layout (const GstColorConvKernels * kernels,
+    int format, int width, int height, const GstColorConvLayout * layout,
+    const guint8 *in, guint8 *out, guint8 *bounce, int band_rows);
+guint64 gst_color_conv_checksum (const GstColorConvKernels * kernels,
+    const guint8 *in, gsize size, guint sample);
+gdouble gst_color_conv_read_cost (const GstColorConvKernels * kernels,
+    const guint8 *src, int n, guint8 *scratch);
+
+void gst_color_conv_repack (const GstColorConvKernels * kernels,
+    guint8 *dst, const GstColorConvPlanes * dst_planes,
+    const guint8 *src, const GstColorConvPlanes * src_planes,
+    GstColorConvLuts luts);
+
+void gst_color_conv_orient (const GstColorConvKernels * kernels,
+    guint8 *dst, const GstColorConvPlanes * dst_planes,
+    const guint8 *src, const GstColorConvPlanes * src_planes, guint orient,
+    GstColorConvLuts luts);
+
+void gst_color_conv_range_build_luts (GstColorConvRange range, GstColorConvLuts luts);
+
+void gst_color_conv_lut_row (guint8 *dst, const guint8 *src, const guint8 *lut, int n);
+
+G_END_DECLS
+
+#endif /* __GST_COLOR_CONV_KERNELS_H__ */
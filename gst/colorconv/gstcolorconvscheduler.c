@@ -0,0 +1,637 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvscheduler.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Hands jobs to whichever lane is idle. The vendor converter is not
+ * reentrant so it gets a single thread, the CPU lane gets as many
+ * threads as requested.
+ *
+ * Every element instance submits through its own stream. Jobs may finish
+ * in any order but are popped from the stream in the order they were
+ * submitted, and count as in flight until the owner releases them.
+ * Submitting blocks while max_jobs are in flight. When a lane frees up it
+ * takes the head job of the stream that is furthest below its share of
+ * the lanes, earliest deadline first between equals. The shared scheduler
+ * lets every instance in the process use one core bounded pool this way.
+ */
+
+/* Overrides the number of CPU lanes of the shared scheduler */
+#define SHARED_THREADS_ENV "COLORCONV_SHARED_THREADS"
+
+typedef struct {
+  GstColorConvStream *stream;
+  gpointer job;
+  gint64 deadline;
+  GstColorConvLane lane;
+  gboolean done;
+} GstColorConvTask;
+
+struct _GstColorConvScheduler {
+  gint refcount;
+
+  GMutex lock;
+  GCond cond;
+  GList *streams;
+
+  GThreadPool *vendor_pool;
+  gboolean vendor_busy;
+
+  GThreadPool *cpu_pool;
+  guint cpu_lanes;
+  guint cpu_busy;
+};
+
+struct _GstColorConvStream {
+  GstColorConvScheduler *sched;
+
+  gboolean vendor;
+  gboolean cpu;
+  guint max_jobs;
+  GstColorConvRunFunc func;
+  gpointer user_data;
+
+  /* protected by the scheduler lock */
+  gboolean flushing;
+  /* tasks waiting for a lane */
+  GQueue tasks;
+  guint running;
+  /* tasks not popped yet, in submission order */
+  GQueue order;
+  /* jobs submitted and not released yet */
+  guint pending;
+};
+
+/* Protects the shared scheduler and every reference count. */
+static GMutex shared_lock;
+static GstColorConvScheduler *shared = NULL;
+
+static gboolean
+gst_color_conv_stream_can_run (GstColorConvStream * stream,
+    GstColorConvLane lane)
+{
+  if (g_queue_is_empty (&stream->tasks)) {
+    return FALSE;
+  }
+
+  return lane == GST_COLOR_CONV_LANE_VENDOR ? stream->vendor : stream->cpu;
+}
+
+/* The lanes the stream's jobs may run on, its share is taken from these */
+static guint
+gst_color_conv_stream_lanes (GstColorConvStream * stream)
+{
+  GstColorConvScheduler *sched = stream->sched;
+
+  return (stream->vendor && sched->vendor_pool ? 1 : 0)
+      + (stream->cpu ? sched->cpu_lanes : 0);
+}
+
+/*
+ * Picks the stream whose head job runs next on the lane. Streams running
+ * fewer jobs than their share of the lanes they may use go first so a
+ * busy stream cannot take all of them, then the earliest deadline wins.
+ * Must be called with the lock held.
+ */
+static GstColorConvStream *
+gst_color_conv_scheduler_pick (GstColorConvScheduler * sched,
+    GstColorConvLane lane)
+{
+  GstColorConvStream *best = NULL;
+  gboolean best_fair = FALSE;
+  gint64 best_deadline = 0;
+  guint waiting = 0;
+  GList *l;
+
+  for (l = sched->streams; l; l = l->next) {
+    if (gst_color_conv_stream_can_run (l->data, lane)) {
+      waiting++;
+    }
+  }
+
+  if (!waiting) {
+    return NULL;
+  }
+
+  for (l = sched->streams; l; l = l->next) {
+    GstColorConvStream *stream = l->data;
+    GstColorConvTask *task;
+    guint share;
+    gboolean fair;
+
+    if (!gst_color_conv_stream_can_run (stream, lane)) {
+      continue;
+    }
+
+    task = g_queue_peek_head (&stream->tasks);
+    share = (gst_color_conv_stream_lanes (stream) + waiting - 1) / waiting;
+    fair = stream->running < share;
+
+    if (!best || (fair && !best_fair)
+        || (fair == best_fair && task->deadline < best_deadline)) {
+      best = stream;
+      best_fair = fair;
+      best_deadline = task->deadline;
+    }
+  }
+
+  return best;
+}
+
+/*
+ * Starts queued jobs on every idle lane, the vendor lane first. Must be
+ * called with the lock held.
+ */
+static void
+gst_color_conv_scheduler_dispatch (GstColorConvScheduler * sched)
+{
+  GstColorConvStream *stream;
+  GstColorConvTask *task;
+
+  while (sched->vendor_pool && !sched->vendor_busy
+      && (stream = gst_color_conv_scheduler_pick (sched,
+              GST_COLOR_CONV_LANE_VENDOR))) {
+    task = g_queue_pop_head (&stream->tasks);
+    task->lane = GST_COLOR_CONV_LANE_VENDOR;
+    stream->running++;
+    sched->vendor_busy = TRUE;
+
+    g_thread_pool_push (sched->vendor_pool, task, NULL);
+  }
+
+  while (sched->cpu_busy < sched->cpu_lanes
+      && (stream = gst_color_conv_scheduler_pick (sched,
+              GST_COLOR_CONV_LANE_CPU))) {
+    task = g_queue_pop_head (&stream->tasks);
+    task->lane = GST_COLOR_CONV_LANE_CPU;
+    stream->running++;
+    sched->cpu_busy++;
+
+    g_thread_pool_push (sched->cpu_pool, task, NULL);
+  }
+}
+
+static void
+gst_color_conv_scheduler_run (gpointer data, gpointer user_data)
+{
+  GstColorConvTask *task = data;
+  GstColorConvStream *stream = task->stream;
+  GstColorConvScheduler *sched = user_data;
+
+  stream->func (task->job, task->lane, stream->user_data);
+
+  g_mutex_lock (&sched->lock);
+
+  if (task->lane == GST_COLOR_CONV_LANE_VENDOR) {
+    sched->vendor_busy = FALSE;
+  } else {
+    sched->cpu_busy--;
+  }
+
+  stream->running--;
+  task->done = TRUE;
+  gst_color_conv_scheduler_dispatch (sched);
+
+  g_cond_broadcast (&sched->cond);
+  g_mutex_unlock (&sched->lock);
+}
+
+GstColorConvScheduler *
+gst_color_conv_scheduler_new (gboolean vendor_lane, guint cpu_lanes)
+{
+  GstColorConvScheduler *sched;
+
+  g_return_val_if_fail (vendor_lane || cpu_lanes > 0, NULL);
+
+  sched = g_slice_new0 (GstColorConvScheduler);
+  sched->refcount = 1;
+  g_mutex_init (&sched->lock);
+  g_cond_init (&sched->cond);
+  sched->cpu_lanes = cpu_lanes;
+
+  if (vendor_lane) {
+    sched->vendor_pool = g_thread_pool_new (gst_color_conv_scheduler_run,
+        sched, 1, TRUE, NULL);
+  }
+
+  if (cpu_lanes > 0) {
+    sched->cpu_pool = g_thread_pool_new (gst_color_conv_scheduler_run,
+        sched, cpu_lanes, TRUE, NULL);
+  }
+
+  return sched;
+}
+
+/*
+ * Returns a reference to the process wide scheduler, created on first
+ * use with the vendor lane and one CPU lane per online core.
+ */
+GstColorConvScheduler *
+gst_color_conv_scheduler_get_shared (void)
+{
+  GstColorConvScheduler *sched;
+
+  g_mutex_lock (&shared_lock);
+
+  if (!shared) {
+    const gchar *env = g_getenv (SHARED_THREADS_ENV);
+    long cores = env ? atol (env) : sysconf (_SC_NPROCESSORS_ONLN);
+
+    shared = gst_color_conv_scheduler_new (TRUE, CLAMP (cores, 1, 64));
+  } else {
+    shared->refcount++;
+  }
+
+  sched = shared;
+
+  g_mutex_unlock (&shared_lock);
+
+  return sched;
+}
+
+GstColorConvScheduler *
+gst_color_conv_scheduler_ref (GstColorConvScheduler * sched)
+{
+  g_mutex_lock (&shared_lock);
+  sched->refcount++;
+  g_mutex_unlock (&shared_lock);
+
+  return sched;
+}
+
+/*
+ * Waits for the running jobs to finish when dropping the last reference.
+ * Every stream has to be freed by then.
+ */
+void
+gst_color_conv_scheduler_unref (GstColorConvScheduler * sched)
+{
+  g_mutex_lock (&shared_lock);
+
+  if (--sched->refcount > 0) {
+    g_mutex_unlock (&shared_lock);
+    return;
+  }
+
+  if (sched == shared) {
+    shared = NULL;
+  }
+
+  g_mutex_unlock (&shared_lock);
+
+  g_warn_if_fail (sched->streams == NULL);
+
+  if (sched->vendor_pool) {
+    g_thread_pool_free (sched->vendor_pool, FALSE, TRUE);
+  }
+
+  if (sched->cpu_pool) {
+    g_thread_pool_free (sched->cpu_pool, FALSE, TRUE);
+  }
+
+  g_cond_clear (&sched->cond);
+  g_mutex_clear (&sched->lock);
+  g_slice_free (GstColorConvScheduler, sched);
+}
+
+/*
+ * Adds a stream whose jobs may run on the vendor lane, the CPU lanes or
+ * both, with at most max_jobs of them queued or running at a time.
+ */
+GstColorConvStream *
+gst_color_conv_stream_new (GstColorConvScheduler * sched, gboolean vendor,
+    gboolean cpu, guint max_jobs, GstColorConvRunFunc func,
+    gpointer user_data)
+{
+  GstColorConvStream *stream;
+
+  g_return_val_if_fail (vendor || cpu, NULL);
+  g_return_val_if_fail (!vendor || sched->vendor_pool, NULL);
+  g_return_val_if_fail (!cpu || sched->cpu_pool, NULL);
+  g_return_val_if_fail (max_jobs > 0, NULL);
+
+  stream = g_slice_new0 (GstColorConvStream);
+  stream->sched = gst_color_conv_scheduler_ref (sched);
+  stream->vendor = vendor;
+  stream->cpu = cpu;
+  stream->max_jobs = max_jobs;
+  stream->func = func;
+  stream->user_data = user_data;
+  g_queue_init (&stream->tasks);
+  g_queue_init (&stream->order);
+
+  g_mutex_lock (&sched->lock);
+  sched->streams = g_list_append (sched->streams, stream);
+  g_mutex_unlock (&sched->lock);
+
+  return stream;
+}
+
+/*
+ * Waits for the queued and running jobs of the stream to finish. Jobs
+ * not popped by then are lost, flush the stream first to get them back.
+ */
+void
+gst_color_conv_stream_free (GstColorConvStream * stream)
+{
+  GstColorConvScheduler *sched = stream->sched;
+  GstColorConvTask *task;
+
+  g_mutex_lock (&sched->lock);
+
+  while (!g_queue_is_empty (&stream->tasks) || stream->running > 0) {
+    g_cond_wait (&sched->cond, &sched->lock);
+  }
+
+  sched->streams = g_list_remove (sched->streams, stream);
+
+  g_mutex_unlock (&sched->lock);
+
+  g_warn_if_fail (g_queue_is_empty (&stream->order));
+  while ((task = g_queue_pop_head (&stream->order))) {
+    g_slice_free (GstColorConvTask, task);
+  }
+
+  gst_color_conv_scheduler_unref (sched);
+  g_slice_free (GstColorConvStream, stream);
+}
+
+/*
+ * Blocks while max_jobs are in flight, then adds a task for the job to
+ * the order jobs are popped in. Returns NULL when flushing. Must be called
+ * with the lock held.
+ */
+static GstColorConvTask *
+gst_color_conv_stream_add (GstColorConvStream * stream, gpointer job)
+{
+  GstColorConvScheduler *sched = stream->sched;
+  GstColorConvTask *task;
+
+  while (!stream->flushing && stream->pending >= stream->max_jobs) {
+    g_cond_wait (&sched->cond, &sched->lock);
+  }
+
+  if (stream->flushing) {
+    return NULL;
+  }
+
+  task = g_slice_new0 (GstColorConvTask);
+  task->stream = stream;
+  task->job = job;
+
+  g_queue_push_tail (&stream->order, task);
+  stream->pending++;
+
+  return task;
+}
+
+/*
+ * Queues the job, which must not be NULL, to run on a lane. Blocks while
+ * the stream has max_jobs in flight. deadline is in g_get_monotonic_time () units, jobs without
+ * one (-1) are due when submitted. Returns FALSE without queueing the job
+ * when flushing.
+ */
+gboolean
+gst_color_conv_stream_submit (GstColorConvStream * stream, gpointer job,
+    gint64 deadline)
+{
+  GstColorConvScheduler *sched = stream->sched;
+  GstColorConvTask *task;
+
+  g_return_val_if_fail (job != NULL, FALSE);
+
+  g_mutex_lock (&sched->lock);
+
+  task = gst_color_conv_stream_add (stream, job);
+  if (!task) {
+    g_mutex_unlock (&sched->lock);
+    return FALSE;
+  }
+
+  task->deadline = deadline >= 0 ? deadline : g_get_monotonic_time ();
+
+  g_queue_push_tail (&stream->tasks, task);
+  gst_color_conv_scheduler_dispatch (sched);
+
+  g_mutex_unlock (&sched->lock);
+
+  return TRUE;
+}
+
+/*
+ * Like gst_color_conv_stream_submit () for a job that needs no lane, it
+ * pops as soon as the jobs submitted before it did.
+ */
+gboolean
+gst_color_conv_stream_append (GstColorConvStream * stream, gpointer job)
+{
+  GstColorConvScheduler *sched = stream->sched;
+  GstColorConvTask *task;
+
+  g_return_val_if_fail (job != NULL, FALSE);
+
+  g_mutex_lock (&sched->lock);
+
+  task = gst_color_conv_stream_add (stream, job);
+  if (task) {
+    task->done = TRUE;
+    g_cond_broadcast (&sched->cond);
+  }
+
+  g_mutex_unlock (&sched->lock);
+
+  return task != NULL;
+}
+
+/*
+ * Blocks until the oldest job not popped yet has run and returns it, or
+ * returns NULL once flushing. The job stays in flight until released.
+ */
+gpointer
+gst_color_conv_stream_pop (GstColorConvStream * stream)
+{
+  GstColorConvScheduler *sched = stream->sched;
+  GstColorConvTask *task;
+  gpointer job;
+
+  g_mutex_lock (&sched->lock);
+
+  while (!stream->flushing && (!(task = g_queue_peek_head (&stream->order))
+          || !task->done)) {
+    g_cond_wait (&sched->cond, &sched->lock);
+  }
+
+  if (stream->flushing) {
+    g_mutex_unlock (&sched->lock);
+    return NULL;
+  }
+
+  g_queue_pop_head (&stream->order);
+
+  g_mutex_unlock (&sched->lock);
+
+  job = task->job;
+  g_slice_free (GstColorConvTask, task);
+
+  return job;
+}
+
+/*
+ * Ends the life of a popped job, making room for the next submit.
+ */
+void
+gst_color_conv_stream_release (GstColorConvStream * stream)
+{
+  GstColorConvScheduler *sched = stream->sched;
+
+  g_mutex_lock (&sched->lock);
+  g_return_if_fail (stream->pending > 0);
+  stream->pending--;
+  g_cond_broadcast (&sched->cond);
+  g_mutex_unlock (&sched->lock);
+}
+
+/*
+ * Blocks until every submitted job has been popped and released. Returns
+ * FALSE if the stream started flushing meanwhile.
+ */
+gboolean
+gst_color_conv_stream_drain (GstColorConvStream * stream)
+{
+  GstColorConvScheduler *sched = stream->sched;
+  gboolean drained;
+
+  g_mutex_lock (&sched->lock);
+
+  while (!stream->flushing && stream->pending > 0) {
+    g_cond_wait (&sched->cond, &sched->lock);
+  }
+
+  drained = !stream->flushing;
+
+  g_mutex_unlock (&sched->lock);
+
+  return drained;
+}
+
+/*
+ * Drops every job not popped yet, calling free_func on each. Jobs still
+ * waiting for a lane never run, running ones are waited for. The stream
+ * has to be flushing so nothing new is submitted meanwhile. Popped jobs
+ * are still released by their owner.
+ */
+void
+gst_color_conv_stream_flush (GstColorConvStream * stream,
+    GDestroyNotify free_func)
+{
+  GstColorConvScheduler *sched = stream->sched;
+  GstColorConvTask *task;
+  GQueue dropped = G_QUEUE_INIT;
+
+  g_mutex_lock (&sched->lock);
+
+  g_warn_if_fail (stream->flushing);
+
+  /* Every task waiting for a lane is in the order queue as well. */
+  g_queue_clear (&stream->tasks);
+
+  while (stream->running > 0) {
+    g_cond_wait (&sched->cond, &sched->lock);
+  }
+
+  while ((task = g_queue_pop_head (&stream->order))) {
+    g_queue_push_tail (&dropped, task);
+    stream->pending--;
+  }
+
+  g_cond_broadcast (&sched->cond);
+  g_mutex_unlock (&sched->lock);
+
+  while ((task = g_queue_pop_head (&dropped))) {
+    if (free_func) {
+      free_func (task->job);
+    }
+
+    g_slice_free (GstColorConvTask, task);
+  }
+}
+
+/*
+ * Changes how many jobs the stream may have in flight. Submits blocked on
+ * the old limit are woken up if the new one lets them through.
+ */
+void
+gst_color_conv_stream_set_max_jobs (GstColorConvStream * stream,
+    guint max_jobs)
+{
+  GstColorConvScheduler *sched = stream->sched;
+
+  g_return_if_fail (max_jobs > 0);
+
+  g_mutex_lock (&sched->lock);
+  stream->max_jobs = max_jobs;
+  g_cond_broadcast (&sched->cond);
+  g_mutex_unlock (&sched->lock);
+}
+
+/*
+ * Changes the lanes later jobs of the stream may run on. Running jobs
+ * finish where they are.
+ */
+void
+gst_color_conv_stream_set_lanes (GstColorConvStream * stream,
+    gboolean vendor, gboolean cpu)
+{
+  GstColorConvScheduler *sched = stream->sched;
+
+  g_return_if_fail (vendor || cpu);
+  g_return_if_fail (!vendor || sched->vendor_pool);
+  g_return_if_fail (!cpu || sched->cpu_pool);
+
+  g_mutex_lock (&sched->lock);
+  stream->vendor = vendor;
+  stream->cpu = cpu;
+  gst_color_conv_scheduler_dispatch (sched);
+  g_mutex_unlock (&sched->lock);
+}
+
+/*
+ * Wakes up and fails pending submits, pops and drains while flushing.
+ * Jobs already queued still run unless the stream is flushed.
+ */
+void
+gst_color_conv_stream_set_flushing (GstColorConvStream * stream,
+    gboolean flushing)
+{
+  GstColorConvScheduler *sched = stream->sched;
+
+  g_mutex_lock (&sched->lock);
+  stream->flushing = flushing;
+  g_cond_broadcast (&sched->cond);
+  g_mutex_unlock (&sched->lock);
+}
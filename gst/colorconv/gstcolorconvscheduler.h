@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_SCHEDULER_H__
+#define __GST_COLOR_CONV_SCHEDULER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GST_COLOR_CONV_LANE_VENDOR,
+  GST_COLOR_CONV_LANE_CPU,
+} GstColorConvLane;
+
+typedef struct _GstColorConvScheduler GstColorConvScheduler;
+typedef struct _GstColorConvStream GstColorConvStream;
+
+/* Called from a lane thread for every submitted job */
+typedef void (* GstColorConvRunFunc) (gpointer job, GstColorConvLane lane,
+    gpointer user_data);
+
+GstColorConvScheduler *gst_color_conv_scheduler_new (gboolean vendor_lane,
+    guint cpu_lanes);
+GstColorConvScheduler *gst_color_conv_scheduler_get_shared (void);
+GstColorConvScheduler *gst_color_conv_scheduler_ref (GstColorConvScheduler * sched);
+void gst_color_conv_scheduler_unref (GstColorConvScheduler * sched);
+
+GstColorConvStream *gst_color_conv_stream_new (GstColorConvScheduler * sched,
+    gboolean vendor, gboolean cpu, guint max_jobs, GstColorConvRunFunc func,
+    gpointer user_data);
+void gst_color_conv_stream_free (GstColorConvStream * stream);
+
+gboolean gst_color_conv_stream_submit (GstColorConvStream * stream,
+    gpointer job, gint64 deadline);
+gboolean gst_color_conv_stream_append (GstColorConvStream * stream,
+    gpointer job);
+gpointer gst_color_conv_stream_pop (GstColorConvStream * stream);
+void gst_color_conv_stream_release (GstColorConvStream * stream);
+gboolean gst_color_conv_stream_drain (GstColorConvStream * stream);
+void gst_color_conv_stream_flush (GstColorConvStream * stream,
+    GDestroyNotify free_func);
+void gst_color_conv_stream_set_max_jobs (GstColorConvStream * stream,
+    guint max_jobs);
+void gst_color_conv_stream_set_lanes (GstColorConvStream * stream,
+    gboolean vendor, gboolean cpu);
+void gst_color_conv_stream_set_flushing (GstColorConvStream * stream,
+    gboolean flushing);
+
+G_END_DECLS
+
+#endif /* __GST_COLOR_CONV_SCHEDULER_H__ */
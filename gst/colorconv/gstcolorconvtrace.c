@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvtrace.h"
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * Fixed size ring of stage events. Writers claim a slot with an atomic
+ * increment and publish it by storing the slot sequence number last, so
+ * recording never blocks or allocates. The dumper copies a slot and only
+ * keeps it if the sequence number did not change while copying.
+ */
+
+typedef struct {
+  gint seq;
+  guint32 stage;
+  guint32 thread;
+  guint64 frame;
+  gint64 start;
+  gint64 end;
+} GstColorConvTraceEvent;
+
+struct _GstColorConvTrace {
+  GstColorConvTraceEvent *events;
+  guint mask;
+  gint head;
+};
+
+static const gchar *stage_names[GST_COLOR_CONV_TRACE_N_STAGES] = {
+  "lock",
+  "convert",
+  "repack",
+  "unlock",
+  "push",
+  "checksum",
+};
+
+GstColorConvTrace *
+gst_color_conv_trace_new (guint capacity)
+{
+  GstColorConvTrace *trace;
+  guint size = 1;
+
+  /* round up to a power of 2 so the slot is a mask away */
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  trace = g_new0 (GstColorConvTrace, 1);
+  trace->events = g_new0 (GstColorConvTraceEvent, size);
+  trace->mask = size - 1;
+
+  return trace;
+}
+
+void
+gst_color_conv_trace_free (GstColorConvTrace * trace)
+{
+  g_free (trace->events);
+  g_free (trace);
+}
+
+void
+gst_color_conv_trace_record (GstColorConvTrace * trace,
+    GstColorConvTraceStage stage, guint64 frame, gint64 start, gint64 end)
+{
+  guint idx = (guint) g_atomic_int_add (&trace->head, 1);
+  GstColorConvTraceEvent *event = &trace->events[idx & trace->mask];
+
+  g_atomic_int_set (&event->seq, 0);
+
+  event->stage = stage;
+  event->thread = (guint32) GPOINTER_TO_UINT (g_thread_self ());
+  event->frame = frame;
+  event->start = start;
+  event->end = end;
+
+  /* publish */
+  g_atomic_int_set (&event->seq, (gint) (idx + 1));
+}
+
+/* Writes str as a JSON string, element names are free form. */
+static void
+write_json_string (FILE * file, const gchar * str)
+{
+  const guchar *c;
+
+  fputc ('"', file);
+
+  for (c = (const guchar *) str; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf (file, "\\%c", *c);
+    } else if (*c < 0x20) {
+      fprintf (file, "\\u%04x", *c);
+    } else {
+      fputc (*c, file);
+    }
+  }
+
+  fputc ('"', file);
+}
+
+gboolean
+gst_color_conv_trace_dump (GstColorConvTrace * trace, const gchar * name,
+    const gchar * filename)
+{
+  FILE *file;
+  guint head;
+  guint idx;
+  guint first;
+  int pid = getpid ();
+
+  file = fopen (filename, "w");
+  if (!file) {
+    return FALSE;
+  }
+
+  head = (guint) g_atomic_int_get (&trace->head);
+  first = head > trace->mask + 1 ? head - (trace->mask + 1) : 0;
+
+  fprintf (file, "{\"traceEvents\":[\n");
+  fprintf (file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+      "\"args\":{\"name\":", pid);
+  write_json_string (file, name);
+  fprintf (file, "}}");
+
+  for (idx = first; idx != head; idx++) {
+    GstColorConvTraceEvent *slot = &trace->events[idx & trace->mask];
+    GstColorConvTraceEvent event;
+
+    if (g_atomic_int_get (&slot->seq) != (gint) (idx + 1)) {
+      continue;
+    }
+
+    event = *slot;
+
+    /* overwritten while we were copying it */
+    if (g_atomic_int_get (&slot->seq) != (gint) (idx + 1)
+        || event.stage >= GST_COLOR_CONV_TRACE_N_STAGES) {
+      continue;
+    }
+
+    fprintf (file, ",\n{\"name\":\"%s\",\"cat\":\"colorconv\",\"ph\":\"X\","
+        "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ","
+        "\"pid\":%d,\"tid\":%u,\"args\":{\"frame\":%" G_GUINT64_FORMAT "}}",
+        stage_names[event.stage], event.start, event.end - event.start, pid,
+        event.thread, event.frame);
+  }
+
+  fprintf (file, "\n]}\n");
+
+  if (fclose (file) != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
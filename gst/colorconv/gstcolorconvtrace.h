@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_TRACE_H__
+#define __GST_COLOR_CONV_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GST_COLOR_CONV_TRACE_LOCK,
+  GST_COLOR_CONV_TRACE_CONVERT,
+  GST_COLOR_CONV_TRACE_REPACK,
+  GST_COLOR_CONV_TRACE_UNLOCK,
+  GST_COLOR_CONV_TRACE_PUSH,
+  GST_COLOR_CONV_TRACE_CHECKSUM,
+  GST_COLOR_CONV_TRACE_N_STAGES,
+} GstColorConvTraceStage;
+
+typedef struct _GstColorConvTrace GstColorConvTrace;
+
+GstColorConvTrace *gst_color_conv_trace_new (guint capacity);
+void gst_color_conv_trace_free (GstColorConvTrace * trace);
+
+void gst_color_conv_trace_record (GstColorConvTrace * trace,
+    GstColorConvTraceStage stage, guint64 frame, gint64 start, gint64 end);
+
+gboolean gst_color_conv_trace_dump (GstColorConvTrace * trace,
+    const gchar * name, const gchar * filename);
+
+G_END_DECLS
+
+#endif /* __GST_COLOR_CONV_TRACE_H__ */
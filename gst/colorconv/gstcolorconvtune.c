@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcolorconvtune.h"
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+/*
+ * The cache is a text file with one line per tuned geometry:
+ *
+ *   <backend> <format> <width>x<height> <kernels> <threads>
+ *
+ * Files from another version are ignored and rewritten on the next save.
+ * Saving holds an exclusive flock () on a sidecar file with the same name
+ * plus TUNE_CACHE_LOCK_SUFFIX, so processes never drop each other's
+ * entries.
+ */
+#define TUNE_CACHE_VERSION 2
+#define TUNE_CACHE_ENV "COLORCONV_TUNE_CACHE"
+#define TUNE_CACHE_LOCK_SUFFIX ".lock"
+
+#define TUNE_RUNS 3
+#define TUNE_FRAMES 4
+#define TUNE_MAX_THREADS 4
+/* Fewer threads win unless more are this much faster per frame */
+#define TUNE_THREAD_GAIN 1.1
+
+struct _GstColorConvTuneCache
+{
+  gchar *path;
+  /* "<backend> <format> <width>x<height>" to GstColorConvTuning */
+  GHashTable *entries;
+};
+
+typedef struct
+{
+  const GstColorConvKernels *kernels;
+  int format;
+  int width;
+  int height;
+  const guint8 *in;
+  guint8 *out;
+} TuneWorker;
+
+static gchar *
+cache_key (const gchar * backend, int format, int width, int height)
+{
+  return g_strdup_printf ("%s 0x%x %dx%d", backend, format, width, height);
+}
+
+static GstColorConvTuning *
+tuning_copy (const GstColorConvTuning * tuning)
+{
+  GstColorConvTuning *copy = g_new (GstColorConvTuning, 1);
+
+  *copy = *tuning;
+
+  return copy;
+}
+
+static void
+cache_parse (GstColorConvTuneCache * cache, const gchar * contents)
+{
+  gchar **lines = g_strsplit (contents, "\n", -1);
+  gchar **line;
+  guint version = 0;
+
+  for (line = lines; *line; line++) {
+    gchar backend[256];
+    gchar name[32];
+    int format, width, height;
+    guint threads;
+    GstColorConvTuning *tuning;
+
+    if (**line == '#' || **line == '\0') {
+      continue;
+    }
+
+    if (!version) {
+      if (sscanf (*line, "version %u", &version) != 1
+          || version != TUNE_CACHE_VERSION) {
+        break;
+      }
+
+      continue;
+    }
+
+    if (sscanf (*line, "%255s %x %dx%d %31s %u", backend, &format, &width,
+            &height, name, &threads) != 6 || threads == 0) {
+      continue;
+    }
+
+    tuning = g_new (GstColorConvTuning, 1);
+    tuning->kernels = gst_color_conv_kernels_get_by_name (name);
+    tuning->threads = threads;
+
+    /* Kernels this CPU cannot run, the file may come from another device. */
+    if (!tuning->kernels) {
+      g_free (tuning);
+      continue;
+    }
+
+    g_hash_table_insert (cache->entries,
+        cache_key (backend, format, width, height), tuning);
+  }
+
+  g_strfreev (lines);
+}
+
+/*
+ * Where the cache lives: COLORCONV_TUNE_CACHE if set, otherwise under the
+ * user cache directory.
+ */
+gchar *
+gst_color_conv_tune_cache_path (void)
+{
+  const gchar *path = g_getenv (TUNE_CACHE_ENV);
+
+  if (path) {
+    return g_strdup (path);
+  }
+
+  return g_build_filename (g_get_user_cache_dir (), "gstcolorconv",
+      "tuning.txt", NULL);
+}
+
+/*
+ * Reads the cache at path. A missing or outdated file gives an empty
+ * cache that is written to path on save.
+ */
+GstColorConvTuneCache *
+gst_color_conv_tune_cache_load (const gchar * path)
+{
+  GstColorConvTuneCache *cache = g_new0 (GstColorConvTuneCache, 1);
+  gchar *contents;
+
+  cache->path = g_strdup (path);
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      g_free);
+
+  if (g_file_get_contents (path, &contents, NULL, NULL)) {
+    cache_parse (cache, contents);
+    g_free (contents);
+  }
+
+  return cache;
+}
+
+void
+gst_color_conv_tune_cache_free (GstColorConvTuneCache * cache)
+{
+  g_hash_table_destroy (cache->entries);
+  g_free (cache->path);
+  g_free (cache);
+}
+
+gboolean
+gst_color_conv_tune_cache_lookup (GstColorConvTuneCache * cache,
+    const gchar * backend, int format, int width, int height,
+    GstColorConvTuning * tuning)
+{
+  gchar *key = cache_key (backend, format, width, height);
+  GstColorConvTuning *found = g_hash_table_lookup (cache->entries, key);
+
+  g_free (key);
+
+  if (!found) {
+    return FALSE;
+  }
+
+  *tuning = *found;
+
+  return TRUE;
+}
+
+void
+gst_color_conv_tune_cache_store (GstColorConvTuneCache * cache,
+    const gchar * backend, int format, int width, int height,
+    const GstColorConvTuning * tuning)
+{
+  g_return_if_fail (tuning->kernels != NULL);
+
+  g_hash_table_insert (cache->entries,
+      cache_key (backend, format, width, height), tuning_copy (tuning));
+}
+
+/*
+ * Takes the exclusive lock on the cache at path, creating the lock file
+ * if needed. Returns its descriptor or -1.
+ */
+static int
+cache_lock (const gchar * path)
+{
+  gchar *lock_path = g_strconcat (path, TUNE_CACHE_LOCK_SUFFIX, NULL);
+  int fd;
+
+  fd = g_open (lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  g_free (lock_path);
+
+  if (fd < 0) {
+    return -1;
+  }
+
+  while (flock (fd, LOCK_EX) != 0) {
+    if (errno != EINTR) {
+      close (fd);
+      return -1;
+    }
+  }
+
+  return fd;
+}
+
+/*
+ * Writes the cache back, keeping entries other processes saved since it
+ * was loaded. Loading, merging and writing all happen under the cache
+ * lock, and the file is replaced atomically so readers that do not lock
+ * never see half of it.
+ */
+gboolean
+gst_color_conv_tune_cache_save (GstColorConvTuneCache * cache)
+{
+  GstColorConvTuneCache *merged;
+  GHashTableIter iter;
+  gpointer key, value;
+  GString *contents;
+  gchar *dir;
+  gboolean ret;
+  int lock;
+
+  dir = g_path_get_dirname (cache->path);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+
+  lock = cache_lock (cache->path);
+  if (lock < 0) {
+    return FALSE;
+  }
+
+  merged = gst_color_conv_tune_cache_load (cache->path);
+
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    g_hash_table_insert (merged->entries, g_strdup (key), tuning_copy (value));
+  }
+
+  contents = g_string_new ("# colorconv autotuning cache\n");
+  g_string_append_printf (contents, "version %d\n", TUNE_CACHE_VERSION);
+
+  g_hash_table_iter_init (&iter, merged->entries);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    GstColorConvTuning *tuning = value;
+
+    g_string_append_printf (contents, "%s %s %u\n", (const gchar *) key,
+        tuning->kernels->name, tuning->threads);
+  }
+
+  ret = g_file_set_contents (cache->path, contents->str, contents->len, NULL);
+
+  flock (lock, LOCK_UN);
+  close (lock);
+
+  g_string_free (contents, TRUE);
+  gst_color_conv_tune_cache_free (merged);
+
+  return ret;
+}
+
+/*
+ * Upper bound for the tuned thread count, also the number of CPU lanes a
+ * private scheduler needs to honour any tuning.
+ */
+guint
+gst_color_conv_tune_max_threads (void)
+{
+  long cores = sysconf (_SC_NPROCESSORS_ONLN);
+
+  return CLAMP (cores, 1, TUNE_MAX_THREADS);
+}
+
+/* Best of TUNE_RUNS conversions, the first one also faults in the buffers */
+static gint64
+time_convert (const GstColorConvKernels * kernels, int format, int width,
+    int height, const guint8 * in, guint8 * out)
+{
+  gint64 best = G_MAXINT64;
+  int i;
+
+  for (i = 0; i < TUNE_RUNS; i++) {
+    gint64 start = g_get_monotonic_time ();
+
+    gst_color_conv_convert (kernels, format, width, height, in, out);
+
+    best = MIN (best, g_get_monotonic_time () - start);
+  }
+
+  return best;
+}
+
+static gpointer
+tune_worker (gpointer data)
+{
+  TuneWorker *worker = data;
+  int i;
+
+  for (i = 0; i < TUNE_FRAMES; i++) {
+    gst_color_conv_convert (worker->kernels, worker->format, worker->width,
+        worker->height, worker->in, worker->out);
+  }
+
+  return NULL;
+}
+
+/* Wall time per frame with threads converting frames side by side */
+static gint64
+time_threads (const GstColorConvKernels * kernels, int format, int width,
+    int height, TuneWorker * workers, guint threads)
+{
+  GThread *thread[TUNE_MAX_THREADS];
+  gint64 start;
+  guint i;
+
+  for (i = 0; i < threads; i++) {
+    workers[i].kernels = kernels;
+    workers[i].format = format;
+    workers[i].width = width;
+    workers[i].height = height;
+  }
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < threads; i++) {
+    thread[i] = g_thread_new ("colorconv-tune", tune_worker, &workers[i]);
+  }
+
+  for (i = 0; i < threads; i++) {
+    g_thread_join (thread[i]);
+  }
+
+  return (g_get_monotonic_time () - start) / (threads * TUNE_FRAMES);
+}
+
+/*
+ * Measures the CPU conversion of synthetic frames: every kernel set this
+ * CPU runs and how many frames converting side by side still pay off, up
+ * to max_threads. Takes a few dozen frame times. Bounce bands are not
+ * tuned, they only pay off on uncached mappings which system memory
+ * cannot stand in for.
+ */
+gboolean
+gst_color_conv_tune (int format, int width, int height, guint max_threads,
+    GstColorConvTuning * tuning)
+{
+  const GstColorConvKernels *list[8];
+  TuneWorker workers[TUNE_MAX_THREADS];
+  gsize in_size = gst_color_conv_input_size (format, width, height);
+  gsize out_size = width * height + 2 * (width / 2) * (height / 2);
+  gint64 best = G_MAXINT64;
+  gint64 t;
+  guint n, i;
+
+  if (!in_size || width <= 0 || height <= 0) {
+    return FALSE;
+  }
+
+  max_threads = CLAMP (max_threads, 1, TUNE_MAX_THREADS);
+
+  for (i = 0; i < max_threads; i++) {
+    workers[i].in = g_malloc (in_size);
+    workers[i].out = g_malloc (out_size);
+    memset ((guint8 *) workers[i].in, 0x80 + i, in_size);
+    memset (workers[i].out, 0, out_size);
+  }
+
+  if (gst_color_conv_kernels_forced ()) {
+    list[0] = gst_color_conv_kernels_get ();
+    n = 1;
+  } else {
+    n = gst_color_conv_kernels_get_supported (list, G_N_ELEMENTS (list));
+  }
+
+  tuning->kernels = list[0];
+  for (i = 0; i < n; i++) {
+    t = time_convert (list[i], format, width, height, workers[0].in,
+        workers[0].out);
+    if (t < best) {
+      best = t;
+      tuning->kernels = list[i];
+    }
+  }
+
+  tuning->threads = 1;
+  best = time_threads (tuning->kernels, format, width, height, workers, 1);
+  for (i = 2; i <= max_threads; i++) {
+    t = time_threads (tuning->kernels, format, width, height, workers, i);
+    if (t * TUNE_THREAD_GAIN < best) {
+      best = t;
+      tuning->threads = i;
+    }
+  }
+
+  for (i = 0; i < max_threads; i++) {
+    g_free ((guint8 *) workers[i].in);
+    g_free (workers[i].out);
+  }
+
+  return TRUE;
+}
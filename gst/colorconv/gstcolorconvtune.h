@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_COLOR_CONV_TUNE_H__
+#define __GST_COLOR_CONV_TUNE_H__
+
+#include <glib.h>
+#include "gstcolorconvkernels.h"
+
+G_BEGIN_DECLS
+
+/* CPU conversion settings measured for one backend, format and size */
+typedef struct {
+  const GstColorConvKernels *kernels;
+  guint threads;
+} GstColorConvTuning;
+
+typedef struct _GstColorConvTuneCache GstColorConvTuneCache;
+
+gchar *gst_color_conv_tune_cache_path (void);
+GstColorConvTuneCache *gst_color_conv_tune_cache_load (const gchar * path);
+void gst_color_conv_tune_cache_free (GstColorConvTuneCache * cache);
+gboolean gst_color_conv_tune_cache_lookup (GstColorConvTuneCache * cache,
+    const gchar * backend, int format, int width, int height,
+    GstColorConvTuning * tuning);
+void gst_color_conv_tune_cache_store (GstColorConvTuneCache * cache,
+    const gchar * backend, int format, int width, int height,
+    const GstColorConvTuning * tuning);
+gboolean gst_color_conv_tune_cache_save (GstColorConvTuneCache * cache);
+
+guint gst_color_conv_tune_max_threads (void);
+gboolean gst_color_conv_tune (int format, int width, int height,
+    guint max_threads, GstColorConvTuning * tuning);
+
+G_END_DECLS
+
+#endif /* __GST_COLOR_CONV_TUNE_H__ */
@@ -32,6 +32,12 @@ plugin_init (GstPlugin * plugin)
       gst_color_conv_get_type ());
 }
 
+#if GST_CHECK_VERSION (1,0,0)
+GST_PLUGIN_DEFINE (GST_VERSION_MAJOR, GST_VERSION_MINOR, colorconv,
+    "Color conversion elements", plugin_init, VERSION, "LGPL", PACKAGE_NAME,
+    "http://jollamobile.com/")
+#else
 GST_PLUGIN_DEFINE (GST_VERSION_MAJOR, GST_VERSION_MINOR, "colorconv",
     "Color conversion elements", plugin_init, VERSION, "LGPL", PACKAGE_NAME,
     "http://jollamobile.com/")
+#endif
@@ -15,6 +15,14 @@ BuildRequires:  pkgconfig(libgstnativebuffer)
 %description
 HW accelerated colorspace converter
 
+%package devel
+Summary:        HW accelerated colorspace converter development files
+Group:          Development/Libraries
+Requires:       %{name} = %{version}-%{release}
+
+%description devel
+Headers for consumers of the colorconv memfd output buffers
+
 %prep
 %setup -q
 
@@ -31,3 +39,7 @@ make
 %defattr(-,root,root,-)
 %{_libdir}/gstreamer-0.10/libgstcolorconv.so
 %{_libdir}/gstcolorconv/libgstcolorconvqcom.so*
+
+%files devel
+%defattr(-,root,root,-)
+%{_includedir}/gstreamer-0.10/gst/colorconv/gstcolorconvfdbuffer.h
@@ -0,0 +1,2094 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Golden output and throughput checks for the conversion paths.
+ *
+ * Every path is compared against the plain scalar reference below using
+ * the frames in frames/, named <format>-<width>x<height>.raw. The CPU
+ * paths run once per kernel set this machine supports. The qcom backend
+ * is only exercised when it can be loaded, point COLORCONV_BACKEND at it
+ * to override the install location.
+ *
+ * Throughput is only reported by default, timings on a shared machine
+ * are too noisy to fail on. Runs are compared with each other rather than
+ * with fixed numbers: COLORCONV_PERF_RECORD=<file> writes the measured
+ * numbers of one run, and a later run on the same machine with
+ * COLORCONV_PERF_GATE=1 and COLORCONV_PERF_BASELINE=<file> fails any path
+ * that dropped more than COLORCONV_PERF_THRESHOLD percent (default 25)
+ * below it.
+ *
+ * The scheduler is checked with jobs that only sleep, for the order they
+ * come back in and for draining and flushing a stream.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <glib.h>
+#include <gmodule.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gstcolorconvbackend.h"
+#include "gstcolorconvkernels.h"
+#include "gstcolorconvtune.h"
+#include "gstcolorconvcapture.h"
+#include "gstcolorconvtrace.h"
+#include "gstcolorconvscheduler.h"
+#include <glib/gstdio.h>
+
+/* OMX_COLOR_FORMATTYPE values reported by getDecoderOutputFormat () */
+#define OMX_COLOR_FormatYUV420SemiPlanar 0x15
+#define OMX_QCOM_COLOR_FormatYVU420SemiPlanar 0x7FA30C00
+#define QOMX_COLOR_FormatYUV420PackedSemiPlanar64x32Tile2m8ka 0x7FA30C03
+
+#define TILE_WIDTH 64
+#define TILE_HEIGHT 32
+#define TILE_SIZE (TILE_WIDTH * TILE_HEIGHT)
+#define TILE_GROUP_SIZE (4 * TILE_SIZE)
+
+#define ROUND_UP_2(x) (((x) + 1) & ~1)
+#define ROUND_UP_4(x) (((x) + 3) & ~3)
+
+/* Jobs per scheduler check, more than a stream holds */
+#define SCHED_JOBS 64
+#define SCHED_MAX_JOBS 8
+#define SCHED_LANES 4
+
+#define DEFAULT_PERF_THRESHOLD 25
+#define PERF_MIN_TIME (G_USEC_PER_SEC / 4)
+
+typedef struct {
+  const gchar *name;
+  int omx_format;
+} FrameFormat;
+
+static const FrameFormat formats[] = {
+  {"nv12", OMX_COLOR_FormatYUV420SemiPlanar},
+  {"nv21", OMX_QCOM_COLOR_FormatYVU420SemiPlanar},
+  {"tiled", QOMX_COLOR_FormatYUV420PackedSemiPlanar64x32Tile2m8ka},
+};
+
+typedef struct {
+  const FrameFormat *format;
+  int width;
+  int height;
+  guint8 *data;
+  gsize size;
+} Frame;
+
+static const GstColorConvKernels *kernels[8];
+static guint n_kernels = 0;
+
+static GHashTable *baseline = NULL;
+static FILE *record = NULL;
+
+/* Scalar reference */
+
+static void
+ref_padded_layout (int width, int height, int stride[3], int offset[3])
+{
+  /* gst_video_format_get_row_stride () and _get_component_offset () */
+  stride[0] = ROUND_UP_4 (width);
+  stride[1] = stride[2] = ROUND_UP_4 (ROUND_UP_2 (width) / 2);
+  offset[0] = 0;
+  offset[1] = stride[0] * ROUND_UP_2 (height);
+  offset[2] = offset[1] + stride[1] * (ROUND_UP_2 (height) / 2);
+}
+
+static guint8
+ref_range (int value, gboolean chroma, GstColorConvRange range)
+{
+  double v = value;
+
+  switch (range) {
+    case GST_COLOR_CONV_RANGE_FULL_TO_LIMITED:
+      v = chroma ? 128 + (v - 128) * 224.0 / 255.0 : 16 + v * 219.0 / 255.0;
+      break;
+
+    case GST_COLOR_CONV_RANGE_LIMITED_TO_FULL:
+      v = chroma ? 128 + (v - 128) * 255.0 / 224.0 : (v - 16) * 255.0 / 219.0;
+      break;
+
+    default:
+      break;
+  }
+
+  return (guint8) CLAMP ((int) (v + (v < 0 ? -0.5 : 0.5)), 0, 255);
+}
+
+/*
+ * Storage order of a plane of tiles, as documented for the Venus 64x32
+ * tiled format: pairs of tile rows are stored as 2x2 groups of tiles
+ * (one 8K macro tile), walking the pair left to right. The groups of a
+ * pair alternate between a "Z" (top two tiles, then the bottom two) and a
+ * mirrored "Z" (bottom two first). A last unpaired row of tiles is stored
+ * left to right. Returns the index of tile (x, y) at order[y * w + x].
+ */
+static gsize *
+ref_tile_order (int w, int h)
+{
+  gsize *order = g_new (gsize, w * h);
+  gsize index = 0;
+  int x, y, group;
+
+  for (y = 0; y + 1 < h; y += 2) {
+    for (group = 0; group < w / 2; group++) {
+      int first = group & 1 ? y + 1 : y;
+      int second = group & 1 ? y : y + 1;
+
+      for (x = 2 * group; x < 2 * group + 2; x++) {
+        order[first * w + x] = index++;
+      }
+
+      for (x = 2 * group; x < 2 * group + 2; x++) {
+        order[second * w + x] = index++;
+      }
+    }
+  }
+
+  for (; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      order[y * w + x] = index++;
+    }
+  }
+
+  return order;
+}
+
+static gsize
+ref_tiled_size (int width, int height, gsize * luma_size)
+{
+  int tile_w_align = (((width - 1) / TILE_WIDTH + 1) + 1) & ~1;
+  int tile_h_luma = (height - 1) / TILE_HEIGHT + 1;
+  int tile_h_chroma = (height / 2 - 1) / TILE_HEIGHT + 1;
+  gsize luma = tile_w_align * tile_h_luma * TILE_SIZE;
+  gsize chroma = tile_w_align * tile_h_chroma * TILE_SIZE;
+
+  luma = (luma + TILE_GROUP_SIZE - 1) / TILE_GROUP_SIZE * TILE_GROUP_SIZE;
+  chroma = (chroma + TILE_GROUP_SIZE - 1) / TILE_GROUP_SIZE * TILE_GROUP_SIZE;
+
+  if (luma_size) {
+    *luma_size = luma;
+  }
+
+  return luma + chroma;
+}
+
+/* Returns a linear NV12 frame for the tiled input */
+static guint8 *
+ref_detile (const guint8 * src, int width, int height)
+{
+  int tile_w = (width - 1) / TILE_WIDTH + 1;
+  int tile_w_align = (tile_w + 1) & ~1;
+  int tile_h_luma = (height - 1) / TILE_HEIGHT + 1;
+  int tile_h_chroma = (height / 2 - 1) / TILE_HEIGHT + 1;
+  gsize *luma_order = ref_tile_order (tile_w_align, tile_h_luma);
+  gsize *chroma_order = ref_tile_order (tile_w_align, tile_h_chroma);
+  guint8 *out = g_malloc0 (width * height + width * (height / 2));
+  guint8 *uv = out + width * height;
+  gsize luma_size;
+  int x, y;
+
+  ref_tiled_size (width, height, &luma_size);
+
+  /* Sample by sample, each tile holds 32 rows of 64 bytes. */
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
+      gsize tile = luma_order[(y / TILE_HEIGHT) * tile_w_align
+          + x / TILE_WIDTH];
+
+      out[y * width + x] = src[tile * TILE_SIZE
+          + (y % TILE_HEIGHT) * TILE_WIDTH + x % TILE_WIDTH];
+    }
+  }
+
+  /* Interleaved chroma rows are tiled the same way in their own plane. */
+  for (y = 0; y < height / 2; y++) {
+    for (x = 0; x < width; x++) {
+      gsize tile = chroma_order[(y / TILE_HEIGHT) * tile_w_align
+          + x / TILE_WIDTH];
+
+      uv[y * width + x] = src[luma_size + tile * TILE_SIZE
+          + (y % TILE_HEIGHT) * TILE_WIDTH + x % TILE_WIDTH];
+    }
+  }
+
+  g_free (chroma_order);
+  g_free (luma_order);
+
+  return out;
+}
+
+/* Returns packed I420, the layout the backends produce */
+static guint8 *
+ref_convert (const Frame * frame)
+{
+  int width = frame->width;
+  int height = frame->height;
+  guint8 *out = g_malloc0 (width * height + 2 * (width / 2) * (height / 2));
+  guint8 *u = out + width * height;
+  guint8 *v = u + (width / 2) * (height / 2);
+  guint8 *linear = NULL;
+  const guint8 *src = frame->data;
+  gboolean swap = frame->format->omx_format ==
+      OMX_QCOM_COLOR_FormatYVU420SemiPlanar;
+  int x, y;
+
+  if (frame->format->omx_format ==
+      QOMX_COLOR_FormatYUV420PackedSemiPlanar64x32Tile2m8ka) {
+    src = linear = ref_detile (frame->data, width, height);
+  }
+
+  memcpy (out, src, width * height);
+
+  for (y = 0; y < height / 2; y++) {
+    const guint8 *uv = src + width * height + y * width;
+
+    for (x = 0; x < width / 2; x++) {
+      u[y * (width / 2) + x] = uv[2 * x + (swap ? 1 : 0)];
+      v[y * (width / 2) + x] = uv[2 * x + (swap ? 0 : 1)];
+    }
+  }
+
+  g_free (linear);
+
+  return out;
+}
+
+/* Helpers */
+
+static void
+fill_pattern (guint8 * data, gsize size, guint32 seed)
+{
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = seed >> 16;
+  }
+}
+
+static void
+compare_bytes (const gchar * what, const guint8 * expected,
+    const guint8 * actual, gsize size, int tolerance)
+{
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    if (ABS ((int) expected[i] - (int) actual[i]) > tolerance) {
+      g_error ("%s: mismatch at byte %" G_GSIZE_FORMAT ": expected %d got %d",
+          what, i, expected[i], actual[i]);
+    }
+  }
+}
+
+static GList *
+load_frames (void)
+{
+  GList *frames = NULL;
+  GDir *dir;
+  const gchar *name;
+  GError *error = NULL;
+
+  dir = g_dir_open (FRAMES_DIR, 0, &error);
+  g_assert_no_error (error);
+
+  while ((name = g_dir_read_name (dir))) {
+    gchar fmt[16];
+    Frame *frame;
+    gchar *path;
+    guint i;
+    gsize expected;
+
+    frame = g_new0 (Frame, 1);
+    if (sscanf (name, "%15[a-z0-9]-%dx%d.raw", fmt, &frame->width,
+            &frame->height) != 3) {
+      g_free (frame);
+      continue;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (formats); i++) {
+      if (!strcmp (formats[i].name, fmt)) {
+        frame->format = &formats[i];
+      }
+    }
+    g_assert (frame->format != NULL);
+
+    path = g_build_filename (FRAMES_DIR, name, NULL);
+    g_file_get_contents (path, (gchar **) & frame->data, &frame->size, &error);
+    g_assert_no_error (error);
+    g_free (path);
+
+    if (frame->format->omx_format ==
+        QOMX_COLOR_FormatYUV420PackedSemiPlanar64x32Tile2m8ka) {
+      expected = ref_tiled_size (frame->width, frame->height, NULL);
+    } else {
+      expected = frame->width * frame->height +
+          frame->width * (frame->height / 2);
+    }
+    g_assert_cmpuint (frame->size, >=, expected);
+    g_assert_cmpuint (gst_color_conv_input_size (frame->format->omx_format,
+            frame->width, frame->height), ==, expected);
+
+    frames = g_list_prepend (frames, frame);
+  }
+
+  g_dir_close (dir);
+
+  return frames;
+}
+
+static void
+free_frame (Frame * frame)
+{
+  g_free (frame->data);
+  g_free (frame);
+}
+
+static GstColorConvBackend *
+load_backend (GModule ** mod)
+{
+  const gchar *path = g_getenv ("COLORCONV_BACKEND");
+  _gst_color_conv_backend_get sym;
+  GstColorConvBackend *backend;
+
+  if (!path) {
+    path = BACKEND_PATH;
+  }
+
+  *mod = g_module_open (path, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+  if (!*mod) {
+    g_test_message ("backend not available: %s", g_module_error ());
+    return NULL;
+  }
+
+  g_assert (g_module_symbol (*mod, BACKEND_SYMBOL_NAME, (gpointer *) & sym));
+
+  backend = g_new0 (GstColorConvBackend, 1);
+  g_assert (sym (backend));
+  g_assert (backend->start (backend->handle));
+
+  return backend;
+}
+
+static void
+unload_backend (GstColorConvBackend * backend, GModule * mod)
+{
+  if (backend) {
+    backend->stop (backend->handle);
+    backend->destroy (backend->handle);
+    g_free (backend);
+  }
+
+  if (mod) {
+    g_module_close (mod);
+  }
+}
+
+static gdouble
+perf_check (const gchar * name, int width, int height, gint64 elapsed,
+    guint iterations)
+{
+  gdouble mpix = (gdouble) width * height * iterations / elapsed;
+  gdouble *expected;
+  gdouble threshold = DEFAULT_PERF_THRESHOLD;
+  const gchar *env = g_getenv ("COLORCONV_PERF_THRESHOLD");
+
+  if (env) {
+    threshold = g_ascii_strtod (env, NULL);
+  }
+
+  g_test_message ("%s: %.1f Mpix/s", name, mpix);
+
+  if (record) {
+    fprintf (record, "%s %.1f\n", name, mpix);
+  }
+
+  expected = baseline ? g_hash_table_lookup (baseline, name) : NULL;
+  if (expected && mpix < *expected * (100 - threshold) / 100) {
+    g_error ("%s: %.1f Mpix/s is more than %.0f%% below the recorded %.1f",
+        name, mpix, threshold, *expected);
+  }
+
+  return mpix;
+}
+
+static void
+load_baseline (void)
+{
+  const gchar *gate = g_getenv ("COLORCONV_PERF_GATE");
+  const gchar *path = g_getenv ("COLORCONV_PERF_BASELINE");
+  GError *error = NULL;
+  gchar *contents;
+  gchar **lines;
+  gchar **line;
+
+  if (!gate || strcmp (gate, "1")) {
+    return;
+  }
+
+  if (!path) {
+    g_error ("COLORCONV_PERF_GATE needs a run recorded with "
+        "COLORCONV_PERF_RECORD in COLORCONV_PERF_BASELINE");
+  }
+
+  g_file_get_contents (path, &contents, NULL, &error);
+  g_assert_no_error (error);
+
+  baseline = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (line = lines; *line; line++) {
+    gchar name[64];
+    gdouble *value = g_new (gdouble, 1);
+
+    if (**line == '#' || sscanf (*line, "%63s %lf", name, value) != 2) {
+      g_free (value);
+      continue;
+    }
+
+    g_hash_table_insert (baseline, g_strdup (name), value);
+  }
+
+  g_strfreev (lines);
+  g_free (contents);
+}
+
+/* Tests */
+
+static void
+test_layout (void)
+{
+  int width, height, i;
+
+  for (width = 1; width <= 64; width++) {
+    for (height = 1; height <= 8; height++) {
+      GstColorConvPlanes padded;
+      GstColorConvPlanes packed;
+      int stride[3];
+      int offset[3];
+
+      gst_color_conv_planes_padded (&padded, width, height);
+      gst_color_conv_planes_packed (&packed, width, height);
+      ref_padded_layout (width, height, stride, offset);
+
+      for (i = 0; i < 3; i++) {
+        g_assert_cmpint (padded.stride[i], ==, stride[i]);
+        g_assert_cmpint (padded.offset[i], ==, offset[i]);
+      }
+
+      g_assert_cmpint (padded.size, ==,
+          offset[2] + stride[2] * (ROUND_UP_2 (height) / 2));
+      g_assert_cmpint (packed.size, ==,
+          width * height + 2 * (width / 2) * (height / 2));
+    }
+  }
+}
+
+static void
+check_repack (int width, int height, GstColorConvRange range)
+{
+  GstColorConvPlanes padded;
+  GstColorConvPlanes packed;
+  GstColorConvLuts luts;
+  int stride[3];
+  int offset[3];
+  guint8 *src;
+  guint8 *dst;
+  guint8 *expected;
+  int plane, x, y;
+  int tolerance;
+  guint i;
+  gchar *what;
+
+  gst_color_conv_planes_padded (&padded, width, height);
+  gst_color_conv_planes_packed (&packed, width, height);
+  ref_padded_layout (width, height, stride, offset);
+
+  src = g_malloc (packed.size);
+  dst = g_malloc (padded.size);
+  expected = g_malloc (padded.size);
+  fill_pattern (src, packed.size, width * 31 + height);
+  memset (dst, 0xaa, padded.size);
+  memset (expected, 0xaa, padded.size);
+
+  for (plane = 0; plane < 3; plane++) {
+    int w = plane ? width / 2 : width;
+    int h = plane ? height / 2 : height;
+    const guint8 *s = src + (plane ? width * height : 0) +
+        (plane == 2 ? w * h : 0);
+
+    for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+        expected[offset[plane] + y * stride[plane] + x] =
+            ref_range (s[y * w + x], plane != 0, range);
+      }
+    }
+  }
+
+  gst_color_conv_range_build_luts (range, luts);
+
+  /* the tables may round halfway values the other way */
+  tolerance = range == GST_COLOR_CONV_RANGE_NONE ? 0 : 1;
+
+  for (i = 0; i < n_kernels; i++) {
+    what = g_strdup_printf ("repack %s %dx%d range %d", kernels[i]->name,
+        width, height, range);
+
+    gst_color_conv_repack (kernels[i], dst, &padded, src, &packed,
+        range == GST_COLOR_CONV_RANGE_NONE ? NULL : luts);
+    compare_bytes (what, expected, dst, padded.size, tolerance);
+
+    /* in place, as done when no padding is needed */
+    if (gst_color_conv_planes_equal (&packed, &padded)) {
+      guint8 *copy = g_malloc (packed.size);
+
+      memcpy (copy, src, packed.size);
+
+      gst_color_conv_repack (kernels[i], copy, &packed, copy, &packed,
+          range == GST_COLOR_CONV_RANGE_NONE ? NULL : luts);
+      compare_bytes (what, expected, copy, padded.size, tolerance);
+      g_free (copy);
+    }
+
+    g_free (what);
+  }
+
+  g_free (expected);
+  g_free (dst);
+  g_free (src);
+}
+
+static void
+test_repack (void)
+{
+  /* odd, non multiple of 4 and non multiple of 8 widths, odd heights */
+  static const int sizes[][2] = {
+    {64, 48}, {16, 16}, {18, 10}, {17, 9}, {20, 8}, {22, 6}, {30, 14},
+    {1, 1}, {2, 2}, {3, 5}, {1278, 719}, {1280, 720},
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    check_repack (sizes[i][0], sizes[i][1], GST_COLOR_CONV_RANGE_NONE);
+  }
+}
+
+static void
+check_orient (int width, int height, guint orient, GstColorConvRange range)
+{
+  GstColorConvLuts luts;
+  GstColorConvPlanes packed, padded;
+  gboolean transpose = (orient & GST_COLOR_CONV_ORIENT_TRANSPOSE) != 0;
+  int out_width = transpose ? height : width;
+  int out_height = transpose ? width : height;
+  int stride[3], offset[3];
+  guint8 *src, *dst, *expected;
+  int plane, x, y;
+  guint i;
+
+  gst_color_conv_planes_packed (&packed, width, height);
+  gst_color_conv_planes_padded (&padded, out_width, out_height);
+  ref_padded_layout (out_width, out_height, stride, offset);
+
+  src = g_malloc (packed.size);
+  dst = g_malloc (padded.size);
+  expected = g_malloc (padded.size);
+  fill_pattern (src, packed.size, width * 17 + height + orient);
+  memset (expected, 0xaa, padded.size);
+  gst_color_conv_range_build_luts (range, luts);
+
+  /* Map every output sample back through transpose, vflip and hflip. */
+  for (plane = 0; plane < 3; plane++) {
+    int w = plane ? width / 2 : width;
+    int h = plane ? height / 2 : height;
+    const guint8 *s = src + (plane ? width * height : 0) +
+        (plane == 2 ? w * h : 0);
+
+    for (y = 0; y < (transpose ? w : h); y++) {
+      for (x = 0; x < (transpose ? h : w); x++) {
+        int sx = transpose ? y : x;
+        int sy = transpose ? x : y;
+
+        if (orient & GST_COLOR_CONV_ORIENT_VFLIP) {
+          sy = h - 1 - sy;
+        }
+
+        if (orient & GST_COLOR_CONV_ORIENT_HFLIP) {
+          sx = w - 1 - sx;
+        }
+
+        expected[offset[plane] + y * stride[plane] + x] =
+            luts[plane][s[sy * w + sx]];
+      }
+    }
+  }
+
+  for (i = 0; i < n_kernels; i++) {
+    gchar *what = g_strdup_printf ("orient %s %dx%d orientation %u "
+        "range %d", kernels[i]->name, width, height, orient, range);
+
+    memset (dst, 0xaa, padded.size);
+    gst_color_conv_orient (kernels[i], dst, &padded, src, &packed, orient,
+        range == GST_COLOR_CONV_RANGE_NONE ? NULL : luts);
+    compare_bytes (what, expected, dst, padded.size, 0);
+
+    g_free (what);
+  }
+
+  g_free (expected);
+  g_free (dst);
+  g_free (src);
+}
+
+static void
+test_orient (void)
+{
+  /* whole and partial 8x8 blocks, more than one transpose tile */
+  static const int sizes[][2] = {
+    {16, 16}, {18, 10}, {17, 9}, {30, 14}, {2, 2}, {1, 1}, {144, 80},
+    {130, 66},
+  };
+  guint i, orient;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    for (orient = 0; orient <= (GST_COLOR_CONV_ORIENT_HFLIP |
+            GST_COLOR_CONV_ORIENT_VFLIP | GST_COLOR_CONV_ORIENT_TRANSPOSE);
+        orient++) {
+      check_orient (sizes[i][0], sizes[i][1], orient,
+          GST_COLOR_CONV_RANGE_NONE);
+    }
+  }
+
+  /* The range remap is done in the same pass. */
+  for (orient = 0; orient <= (GST_COLOR_CONV_ORIENT_HFLIP |
+          GST_COLOR_CONV_ORIENT_VFLIP | GST_COLOR_CONV_ORIENT_TRANSPOSE);
+      orient++) {
+    check_orient (130, 66, orient, GST_COLOR_CONV_RANGE_FULL_TO_LIMITED);
+    check_orient (18, 10, orient, GST_COLOR_CONV_RANGE_LIMITED_TO_FULL);
+  }
+}
+
+static void
+test_range (void)
+{
+  GstColorConvLuts luts;
+  int range, plane, i;
+
+  for (range = GST_COLOR_CONV_RANGE_NONE;
+      range <= GST_COLOR_CONV_RANGE_LIMITED_TO_FULL; range++) {
+    gst_color_conv_range_build_luts (range, luts);
+
+    for (plane = 0; plane < 3; plane++) {
+      for (i = 0; i < 256; i++) {
+        g_assert_cmpint (ABS (luts[plane][i] - ref_range (i, plane != 0,
+                    range)), <=, 1);
+      }
+    }
+
+    check_repack (64, 48, range);
+    check_repack (18, 10, range);
+  }
+}
+
+static void
+test_convert (void)
+{
+  GList *frames = load_frames ();
+  Frame *tiled = g_new0 (Frame, 1);
+  GList *l;
+  guint i;
+
+  /*
+   * The stored frames are too small for mirrored tile groups and an odd
+   * row of luma tiles, add a made up one that has both.
+   */
+  tiled->format = &formats[2];
+  tiled->width = 330;
+  tiled->height = 200;
+  tiled->size = ref_tiled_size (tiled->width, tiled->height, NULL);
+  tiled->data = g_malloc (tiled->size);
+  fill_pattern (tiled->data, tiled->size, 4);
+  frames = g_list_prepend (frames, tiled);
+
+  for (l = frames; l; l = l->next) {
+    Frame *frame = l->data;
+    gsize size = frame->width * frame->height +
+        2 * (frame->width / 2) * (frame->height / 2);
+    guint8 *expected = ref_convert (frame);
+    guint8 *out = g_malloc (size);
+
+    g_assert (gst_color_conv_can_convert (frame->format->omx_format));
+
+    for (i = 0; i < n_kernels; i++) {
+      gchar *what = g_strdup_printf ("convert %s %s %dx%d", kernels[i]->name,
+          frame->format->name, frame->width, frame->height);
+
+      memset (out, 0xaa, size);
+      g_assert (gst_color_conv_convert (kernels[i], frame->format->omx_format,
+              frame->width, frame->height, frame->data, out));
+      compare_bytes (what, expected, out, size, 0);
+
+      g_free (what);
+    }
+
+    g_free (out);
+    g_free (expected);
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) free_frame);
+}
+
+static void
+test_stream_copy (void)
+{
+  guint8 src[512];
+  guint8 dst[512];
+  int offset, n, x;
+  guint i;
+
+  for (x = 0; x < (int) sizeof (src); x++) {
+    src[x] = x * 7 + 3;
+  }
+
+  /* Cover every source alignment and the head and tail paths. */
+  for (i = 0; i < n_kernels; i++) {
+    for (offset = 0; offset < 64; offset++) {
+      for (n = 0; n + offset <= (int) sizeof (src); n += 67) {
+        memset (dst, 0xaa, sizeof (dst));
+        kernels[i]->stream_copy (dst, src + offset, n);
+        g_assert (!memcmp (dst, src + offset, n));
+        g_assert (n == sizeof (dst) || dst[n] == 0xaa);
+      }
+    }
+  }
+}
+
+static guint64
+ref_checksum (const guint8 * data, gsize size, guint sample)
+{
+  guint32 sums[8] = { 0, };
+  guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+  gsize block, x;
+  int lane, i;
+
+  for (block = 0; block * GST_COLOR_CONV_CHECKSUM_BLOCK < size;
+      block += sample) {
+    gsize start = block * GST_COLOR_CONV_CHECKSUM_BLOCK;
+    gsize end = MIN (start + GST_COLOR_CONV_CHECKSUM_BLOCK, size);
+
+    for (x = start; x < end; x += 16) {
+      for (lane = 0; lane < 4; lane++) {
+        guint32 word = 0;
+
+        for (i = 3; i >= 0; i--) {
+          gsize pos = x + 4 * lane + i;
+          word = (word << 8) | (pos < end ? data[pos] : 0);
+        }
+
+        sums[lane] += word;
+        sums[4 + lane] += sums[lane];
+      }
+    }
+  }
+
+  for (i = 0; i < 8; i++) {
+    hash = (hash ^ sums[i]) * G_GUINT64_CONSTANT (1099511628211);
+  }
+
+  return hash;
+}
+
+static void
+test_checksum (void)
+{
+  /* Whole blocks, short tails and odd pairs of 16 byte blocks */
+  static const gsize sizes[] = { 16, 48, 4096, 3 * 4096 + 37, 65536 + 80 };
+  gsize size = sizes[G_N_ELEMENTS (sizes) - 1];
+  guint8 *data = g_malloc (size);
+  guint64 sum, sampled, flipped;
+  guint i, j;
+  gsize pos;
+
+  fill_pattern (data, size, 7);
+
+  for (i = 0; i < n_kernels; i++) {
+    for (j = 0; j < G_N_ELEMENTS (sizes); j++) {
+      g_assert_cmpuint (gst_color_conv_checksum (kernels[i], data, sizes[j],
+              1), ==, ref_checksum (data, sizes[j], 1));
+      g_assert_cmpuint (gst_color_conv_checksum (kernels[i], data, sizes[j],
+              4), ==, ref_checksum (data, sizes[j], 4));
+    }
+
+    /* Any single byte change shows up, sampling only sees its blocks. */
+    sum = gst_color_conv_checksum (kernels[i], data, size, 1);
+    sampled = gst_color_conv_checksum (kernels[i], data, size, 4);
+    for (pos = 0; pos < size; pos += 997) {
+      data[pos] ^= 0x10;
+      flipped = gst_color_conv_checksum (kernels[i], data, size, 1);
+      g_assert_cmpuint (flipped, !=, sum);
+      flipped = gst_color_conv_checksum (kernels[i], data, size, 4);
+      g_assert ((flipped != sampled) ==
+          ((pos / GST_COLOR_CONV_CHECKSUM_BLOCK) % 4 == 0));
+      data[pos] ^= 0x10;
+    }
+  }
+
+  g_free (data);
+}
+
+static void
+test_convert_bounced (void)
+{
+  /* Bands shorter, longer and not dividing the chroma height */
+  static const int band_rows[] = { 1, 3, GST_COLOR_CONV_BAND_ROWS, 64 };
+  GList *frames = load_frames ();
+  GList *l;
+  guint i, j;
+
+  for (l = frames; l; l = l->next) {
+    Frame *frame = l->data;
+    int format = frame->format->omx_format;
+    gsize size = frame->width * frame->height +
+        2 * (frame->width / 2) * (frame->height / 2);
+    guint8 *expected = ref_convert (frame);
+    guint8 *out = g_malloc (size);
+    guint8 *bounce = g_malloc (gst_color_conv_bounce_size (format,
+            frame->width, band_rows[G_N_ELEMENTS (band_rows) - 1]));
+
+    for (i = 0; i < n_kernels; i++) {
+      for (j = 0; j < G_N_ELEMENTS (band_rows); j++) {
+        gchar *what = g_strdup_printf ("bounced %s %s %dx%d by %d",
+            kernels[i]->name, frame->format->name, frame->width,
+            frame->height, band_rows[j]);
+
+        memset (out, 0xaa, size);
+        g_assert (gst_color_conv_convert_bounced (kernels[i], format,
+                frame->width, frame->height, frame->data, out, bounce,
+                band_rows[j]));
+        compare_bytes (what, expected, out, size, 0);
+
+        g_free (what);
+      }
+    }
+
+    g_free (bounce);
+    g_free (out);
+    g_free (expected);
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) free_frame);
+}
+
+/*
+ * Semi-planar frames laid out the way decoders pad them: rows and the
+ * luma plane rounded up, the padding filled with junk the converters must
+ * not pick up.
+ */
+static void
+test_convert_layout (void)
+{
+  GList *frames = load_frames ();
+  GList *l;
+  guint i;
+
+  for (l = frames; l; l = l->next) {
+    Frame *frame = l->data;
+    int format = frame->format->omx_format;
+    int width = frame->width;
+    int height = frame->height;
+    gsize size = width * height + 2 * (width / 2) * (height / 2);
+    GstColorConvLayout layout;
+    guint8 *expected;
+    guint8 *padded;
+    guint8 *bounce;
+    guint8 *out;
+    int row;
+
+    if (format == QOMX_COLOR_FormatYUV420PackedSemiPlanar64x32Tile2m8ka) {
+      continue;
+    }
+
+    layout.stride = (width + 31) & ~31;
+    layout.uv_stride = layout.stride;
+    layout.uv_offset = layout.stride * ((height + 15) & ~15);
+    g_assert (gst_color_conv_layout_valid (&layout, width, height));
+
+    padded = g_malloc (gst_color_conv_layout_size (&layout, format, width,
+            height));
+    fill_pattern (padded, gst_color_conv_layout_size (&layout, format, width,
+            height), 5);
+
+    for (row = 0; row < height; row++) {
+      memcpy (padded + row * layout.stride, frame->data + row * width, width);
+    }
+
+    for (row = 0; row < height / 2; row++) {
+      memcpy (padded + layout.uv_offset + row * layout.uv_stride,
+          frame->data + width * height + row * width, width);
+    }
+
+    expected = ref_convert (frame);
+    out = g_malloc (size);
+    bounce = g_malloc (gst_color_conv_bounce_size (format, width, 3));
+
+    for (i = 0; i < n_kernels; i++) {
+      gchar *what = g_strdup_printf ("layout %s %s %dx%d", kernels[i]->name,
+          frame->format->name, width, height);
+
+      memset (out, 0xaa, size);
+      g_assert (gst_color_conv_convert_layout (kernels[i], format, width,
+              height, &layout, padded, out, NULL, 0));
+      compare_bytes (what, expected, out, size, 0);
+
+      memset (out, 0xaa, size);
+      g_assert (gst_color_conv_convert_layout (kernels[i], format, width,
+              height, &layout, padded, out, bounce, 3));
+      compare_bytes (what, expected, out, size, 0);
+
+      g_free (what);
+    }
+
+    /* Planes overlapping the luma cannot be right. */
+    layout.uv_offset = layout.stride * (height - 1);
+    g_assert (!gst_color_conv_layout_valid (&layout, width, height));
+
+    g_free (bounce);
+    g_free (out);
+    g_free (expected);
+    g_free (padded);
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) free_frame);
+}
+
+static void
+test_tune (void)
+{
+  gchar *dir = g_dir_make_tmp ("colorconv-XXXXXX", NULL);
+  gchar *subdir = g_build_filename (dir, "gstcolorconv", NULL);
+  gchar *path = g_build_filename (subdir, "tuning.txt", NULL);
+  gchar *lock_path = g_strconcat (path, ".lock", NULL);
+  GstColorConvTuneCache *cache;
+  GstColorConvTuning tuning;
+  GstColorConvTuning found;
+  int format = OMX_COLOR_FormatYUV420SemiPlanar;
+
+  g_assert (dir != NULL);
+
+  /* A missing file is an empty cache, saving creates the directory. */
+  cache = gst_color_conv_tune_cache_load (path);
+  g_assert (!gst_color_conv_tune_cache_lookup (cache, "backend", format, 64,
+          48, &found));
+
+  g_assert (gst_color_conv_tune (format, 64, 48, 2, &tuning));
+  g_assert (tuning.kernels != NULL);
+  g_assert_cmpuint (tuning.threads, >=, 1);
+  g_assert_cmpuint (tuning.threads, <=, 2);
+
+  gst_color_conv_tune_cache_store (cache, "backend", format, 64, 48, &tuning);
+  g_assert (gst_color_conv_tune_cache_save (cache));
+  gst_color_conv_tune_cache_free (cache);
+
+  /* Saving went through the lock file, which stays for the next one. */
+  g_assert (g_file_test (lock_path, G_FILE_TEST_EXISTS));
+
+  /* Entries come back, other sizes stay untuned. */
+  cache = gst_color_conv_tune_cache_load (path);
+  g_assert (gst_color_conv_tune_cache_lookup (cache, "backend", format, 64,
+          48, &found));
+  g_assert (found.kernels == tuning.kernels);
+  g_assert_cmpuint (found.threads, ==, tuning.threads);
+  g_assert (!gst_color_conv_tune_cache_lookup (cache, "backend", format, 48,
+          64, &found));
+  gst_color_conv_tune_cache_free (cache);
+
+  /* Files written by another version are ignored. */
+  g_assert (g_file_set_contents (path,
+          "version 1\nbackend 0x15 64x48 scalar 1 16\n", -1, NULL));
+  cache = gst_color_conv_tune_cache_load (path);
+  g_assert (!gst_color_conv_tune_cache_lookup (cache, "backend", format, 64,
+          48, &found));
+  gst_color_conv_tune_cache_free (cache);
+
+  g_remove (path);
+  g_remove (lock_path);
+  g_rmdir (subdir);
+  g_rmdir (dir);
+  g_free (lock_path);
+  g_free (path);
+  g_free (subdir);
+  g_free (dir);
+}
+
+static void
+test_capture (void)
+{
+  GList *frames = load_frames ();
+  GList *l;
+  gchar *dir = g_dir_make_tmp ("colorconv-XXXXXX", NULL);
+  gchar *path = g_build_filename (dir, "capture.ccap", NULL);
+  GstColorConvCaptureWriter *writer;
+  GstColorConvCaptureReader *reader;
+  GstColorConvCaptureFrame info;
+  const guint8 *data;
+  GError *error = NULL;
+  gchar *contents;
+  gsize length;
+  guint n = 0;
+
+  writer = gst_color_conv_capture_writer_new (path);
+  g_assert (writer != NULL);
+
+  for (l = frames; l; l = l->next) {
+    Frame *frame = l->data;
+
+    memset (&info, 0, sizeof (info));
+    info.hal_format = frame->format->omx_format;
+    info.width = frame->width;
+    info.height = frame->height;
+    info.stride = gst_color_conv_input_stride (info.hal_format, frame->width);
+    info.uv_offset = info.stride * frame->height;
+    info.uv_stride = info.stride;
+    info.size = gst_color_conv_input_size (info.hal_format, frame->width,
+        frame->height);
+    info.timestamp = n++;
+
+    g_assert (gst_color_conv_capture_writer_add (writer, &info, frame->data));
+  }
+
+  g_assert_cmpuint (gst_color_conv_capture_writer_get_frames (writer), ==, n);
+  g_assert (gst_color_conv_capture_writer_free (writer));
+
+  /* Frames come back in order, aligned and converting like the originals. */
+  reader = gst_color_conv_capture_reader_new (path, &error);
+  g_assert_no_error (error);
+
+  n = 0;
+  for (l = frames; l; l = l->next) {
+    Frame *frame = l->data;
+
+    g_assert (gst_color_conv_capture_reader_next (reader, &info, &data));
+    g_assert_cmpuint (info.hal_format, ==, frame->format->omx_format);
+    g_assert_cmpuint (info.width, ==, frame->width);
+    g_assert_cmpuint (info.height, ==, frame->height);
+    g_assert_cmpuint (info.stride, >=, frame->width);
+    g_assert_cmpuint (info.timestamp, ==, n++);
+    g_assert_cmpuint ((guintptr) data % GST_COLOR_CONV_CAPTURE_ALIGN, ==, 0);
+    g_assert (!memcmp (data, frame->data, info.size));
+  }
+
+  g_assert (!gst_color_conv_capture_reader_next (reader, &info, &data));
+
+  gst_color_conv_capture_reader_rewind (reader);
+  g_assert (gst_color_conv_capture_reader_next (reader, &info, &data));
+  gst_color_conv_capture_reader_free (reader);
+
+  /* A capture cut short stops before the partial frame. */
+  g_assert (g_file_get_contents (path, &contents, &length, NULL));
+  g_assert (g_file_set_contents (path, contents,
+          length - GST_COLOR_CONV_CAPTURE_ALIGN, NULL));
+
+  reader = gst_color_conv_capture_reader_new (path, &error);
+  g_assert_no_error (error);
+  for (l = frames; l->next; l = l->next) {
+    g_assert (gst_color_conv_capture_reader_next (reader, &info, &data));
+  }
+  g_assert (!gst_color_conv_capture_reader_next (reader, &info, &data));
+  gst_color_conv_capture_reader_free (reader);
+
+  /* Anything else is refused. */
+  g_assert (g_file_set_contents (path, contents + 8, length - 8, NULL));
+  reader = gst_color_conv_capture_reader_new (path, &error);
+  g_assert (reader == NULL);
+  g_assert (error != NULL);
+  g_clear_error (&error);
+
+  g_free (contents);
+  g_remove (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+  g_list_free_full (frames, (GDestroyNotify) free_frame);
+}
+
+/*
+ * Padded frames keep their layout through a capture and convert like the
+ * packed original, opaque ones are not handed to the kernels.
+ */
+static void
+test_capture_layout (void)
+{
+  const int width = 64;
+  const int height = 48;
+  const GstColorConvKernels *scalar =
+      gst_color_conv_kernels_get_by_name ("scalar");
+  gchar *dir = g_dir_make_tmp ("colorconv-XXXXXX", NULL);
+  gchar *path = g_build_filename (dir, "capture.ccap", NULL);
+  gsize out_size = width * height + 2 * (width / 2) * (height / 2);
+  GstColorConvCaptureWriter *writer;
+  GstColorConvCaptureReader *reader;
+  GstColorConvCaptureFrame info;
+  GstColorConvLayout layout;
+  const guint8 *data;
+  guint8 *packed, *padded, *expected, *out;
+  GError *error = NULL;
+  int y;
+
+  /* Rows 16 bytes longer and 4 spare rows before the chroma. */
+  layout.stride = width + 16;
+  layout.uv_offset = layout.stride * (height + 4);
+  layout.uv_stride = layout.stride;
+
+  packed = g_malloc (width * height * 3 / 2);
+  padded = g_malloc0 (layout.uv_offset + layout.uv_stride * height / 2);
+  fill_pattern (packed, width * height * 3 / 2, 7);
+  for (y = 0; y < height; y++) {
+    memcpy (padded + y * layout.stride, packed + y * width, width);
+  }
+  for (y = 0; y < height / 2; y++) {
+    memcpy (padded + layout.uv_offset + y * layout.uv_stride,
+        packed + width * height + y * width, width);
+  }
+
+  writer = gst_color_conv_capture_writer_new (path);
+  g_assert (writer != NULL);
+
+  memset (&info, 0, sizeof (info));
+  info.hal_format = GST_COLOR_CONV_FORMAT_NV12;
+  info.width = width;
+  info.height = height;
+  info.stride = layout.stride;
+  info.uv_offset = layout.uv_offset;
+  info.uv_stride = layout.uv_stride;
+  info.size = gst_color_conv_layout_size (&layout, info.hal_format, width,
+      height);
+  g_assert (gst_color_conv_capture_writer_add (writer, &info, padded));
+
+  /* unknown layout, with and without the data the vendor would read */
+  info.flags = GST_COLOR_CONV_CAPTURE_FRAME_OPAQUE;
+  info.size = gst_color_conv_input_size (info.hal_format, width, height);
+  g_assert (gst_color_conv_capture_writer_add (writer, &info, packed));
+  info.hal_format = 0x7fa30c03;
+  info.size = 0;
+  g_assert (gst_color_conv_capture_writer_add (writer, &info, NULL));
+  g_assert (gst_color_conv_capture_writer_free (writer));
+
+  reader = gst_color_conv_capture_reader_new (path, &error);
+  g_assert_no_error (error);
+
+  expected = g_malloc (out_size);
+  out = g_malloc (out_size);
+  g_assert (gst_color_conv_convert (scalar, GST_COLOR_CONV_FORMAT_NV12, width,
+          height, packed, expected));
+
+  g_assert (gst_color_conv_capture_reader_next (reader, &info, &data));
+  g_assert (gst_color_conv_capture_frame_layout (&info, &layout));
+  g_assert_cmpint (layout.stride, ==, width + 16);
+  g_assert_cmpint (layout.uv_offset, ==, (width + 16) * (height + 4));
+  g_assert (gst_color_conv_convert_layout (scalar, info.hal_format, width,
+          height, &layout, data, out, NULL, 0));
+  compare_bytes ("capture layout", expected, out, out_size, 0);
+
+  /* A record shorter than its layout is not read past. */
+  info.size--;
+  g_assert (!gst_color_conv_capture_frame_layout (&info, &layout));
+
+  g_assert (gst_color_conv_capture_reader_next (reader, &info, &data));
+  g_assert_cmpuint (info.flags, ==, GST_COLOR_CONV_CAPTURE_FRAME_OPAQUE);
+  g_assert (!gst_color_conv_capture_frame_layout (&info, &layout));
+  g_assert (!memcmp (data, packed, info.size));
+
+  g_assert (gst_color_conv_capture_reader_next (reader, &info, &data));
+  g_assert_cmpuint (info.size, ==, 0);
+  g_assert (!gst_color_conv_capture_frame_layout (&info, &layout));
+
+  g_assert (!gst_color_conv_capture_reader_next (reader, &info, &data));
+  gst_color_conv_capture_reader_free (reader);
+
+  g_free (out);
+  g_free (expected);
+  g_free (padded);
+  g_free (packed);
+  g_remove (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+/*
+ * Just enough of a JSON parser to tell a well formed trace dump from a
+ * broken one. Each returns the end of what it read, NULL if malformed.
+ */
+static const gchar *json_value (const gchar * p);
+
+static const gchar *
+json_space (const gchar * p)
+{
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+    p++;
+  }
+
+  return p;
+}
+
+static const gchar *
+json_string (const gchar * p)
+{
+  int i;
+
+  if (*p++ != '"') {
+    return NULL;
+  }
+
+  for (; *p != '"'; p++) {
+    if ((guchar) * p < 0x20) {
+      return NULL;
+    }
+
+    if (*p != '\\') {
+      continue;
+    }
+
+    p++;
+    if (*p == 'u') {
+      for (i = 0; i < 4; i++) {
+        if (!g_ascii_isxdigit (*++p)) {
+          return NULL;
+        }
+      }
+    } else if (!*p || !strchr ("\"\\/bfnrt", *p)) {
+      return NULL;
+    }
+  }
+
+  return p + 1;
+}
+
+static const gchar *
+json_number (const gchar * p)
+{
+  const gchar *start;
+
+  if (*p == '-') {
+    p++;
+  }
+
+  for (start = p; g_ascii_isdigit (*p); p++);
+  if (p == start) {
+    return NULL;
+  }
+
+  if (*p == '.') {
+    for (start = ++p; g_ascii_isdigit (*p); p++);
+    if (p == start) {
+      return NULL;
+    }
+  }
+
+  if (*p == 'e' || *p == 'E') {
+    if (*++p == '+' || *p == '-') {
+      p++;
+    }
+
+    for (start = p; g_ascii_isdigit (*p); p++);
+    if (p == start) {
+      return NULL;
+    }
+  }
+
+  return p;
+}
+
+static const gchar *
+json_members (const gchar * p, gchar close, gboolean keys)
+{
+  p = json_space (p + 1);
+  if (*p == close) {
+    return p + 1;
+  }
+
+  for (;;) {
+    if (keys) {
+      if (!(p = json_string (p))) {
+        return NULL;
+      }
+
+      p = json_space (p);
+      if (*p++ != ':') {
+        return NULL;
+      }
+    }
+
+    if (!(p = json_value (p))) {
+      return NULL;
+    }
+
+    if (*p == close) {
+      return p + 1;
+    }
+
+    if (*p++ != ',') {
+      return NULL;
+    }
+
+    p = json_space (p);
+  }
+}
+
+static const gchar *
+json_value (const gchar * p)
+{
+  static const gchar *literals[] = { "true", "false", "null" };
+  guint i;
+
+  p = json_space (p);
+
+  switch (*p) {
+    case '{':
+      p = json_members (p, '}', TRUE);
+      break;
+
+    case '[':
+      p = json_members (p, ']', FALSE);
+      break;
+
+    case '"':
+      p = json_string (p);
+      break;
+
+    default:
+      for (i = 0; i < G_N_ELEMENTS (literals); i++) {
+        if (g_str_has_prefix (p, literals[i])) {
+          return json_space (p + strlen (literals[i]));
+        }
+      }
+
+      p = json_number (p);
+      break;
+  }
+
+  return p ? json_space (p) : NULL;
+}
+
+static void
+test_trace (void)
+{
+  gchar *dir = g_dir_make_tmp ("colorconv-XXXXXX", NULL);
+  gchar *path = g_build_filename (dir, "trace.json", NULL);
+  GstColorConvTrace *trace;
+  gchar *contents;
+  const gchar *end;
+  guint64 frame;
+
+  /* Rounded up to 8 slots, the 12 oldest of 20 events get overwritten. */
+  trace = gst_color_conv_trace_new (5);
+
+  for (frame = 0; frame < 20; frame++) {
+    gst_color_conv_trace_record (trace,
+        frame % GST_COLOR_CONV_TRACE_N_STAGES, frame, frame * 10,
+        frame * 10 + 5);
+  }
+
+  /* Element names may hold anything, they have to come out escaped. */
+  g_assert (gst_color_conv_trace_dump (trace, "conv\"0\\\n", path));
+  gst_color_conv_trace_free (trace);
+
+  g_assert (g_file_get_contents (path, &contents, NULL, NULL));
+
+  end = json_value (contents);
+  g_assert (end != NULL);
+  g_assert_cmpint (*end, ==, '\0');
+  g_assert (strstr (contents, "\"name\":\"conv\\\"0\\\\\\u000a\"") != NULL);
+
+  for (frame = 0; frame < 20; frame++) {
+    gchar *event = g_strdup_printf ("\"ts\":%" G_GUINT64_FORMAT ",\"dur\":5,",
+        frame * 10);
+
+    g_assert ((strstr (contents, event) != NULL) == (frame >= 12));
+    g_free (event);
+  }
+
+  g_free (contents);
+  g_remove (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+/*
+ * Scheduler jobs are numbers from 1 counting how many run at once. They
+ * hold while hold is set and sleep less the later they are in a group of
+ * eight, so later jobs often finish first. Jobs from SCHED_SECOND up
+ * belong to a second stream when there is one.
+ */
+#define SCHED_SECOND 1000
+
+typedef struct {
+  GMutex lock;
+  GCond cond;
+  gboolean hold;
+  guint running;
+  guint max_running;
+  guint ran;
+  guint ran_vendor;
+  guint released;
+
+  /* the first jobs started, in order */
+  guint started[SCHED_MAX_JOBS * 2];
+  guint n_started;
+
+  /* set once both streams have work queued */
+  gboolean contended;
+  guint stream_running[2];
+  guint stream_started[2];
+  /* jobs that took a second lane while the other stream had work */
+  guint unfair;
+} SchedCheck;
+
+static gint sched_dropped;
+
+static void
+sched_check_run (gpointer job, GstColorConvLane lane, gpointer user_data)
+{
+  SchedCheck *check = user_data;
+  guint n = GPOINTER_TO_UINT (job);
+  guint stream = n >= SCHED_SECOND;
+
+  g_mutex_lock (&check->lock);
+  check->running++;
+  check->max_running = MAX (check->max_running, check->running);
+
+  if (check->n_started < G_N_ELEMENTS (check->started)) {
+    check->started[check->n_started++] = n;
+  }
+
+  /*
+   * The other stream's last job may have been handed a lane without
+   * having got here yet, so only count while it has two more to go.
+   */
+  if (check->contended && check->stream_running[stream] > 0
+      && check->stream_started[!stream] + 1 < SCHED_MAX_JOBS) {
+    check->unfair++;
+  }
+  check->stream_running[stream]++;
+  check->stream_started[stream]++;
+  g_cond_broadcast (&check->cond);
+
+  while (check->hold) {
+    g_cond_wait (&check->cond, &check->lock);
+  }
+  g_mutex_unlock (&check->lock);
+
+  g_usleep ((8 - n % 8) * 250);
+
+  g_mutex_lock (&check->lock);
+  check->running--;
+  check->stream_running[stream]--;
+  check->ran++;
+  if (lane == GST_COLOR_CONV_LANE_VENDOR) {
+    check->ran_vendor++;
+  }
+  g_mutex_unlock (&check->lock);
+}
+
+static void
+sched_check_drop (gpointer job)
+{
+  g_atomic_int_inc (&sched_dropped);
+}
+
+/* Adds a second stream of jobs on the scheduler of the first. */
+static GstColorConvStream *
+sched_check_new_full (SchedCheck * check, gboolean vendor_lane, guint lanes,
+    GstColorConvStream ** second)
+{
+  GstColorConvScheduler *sched;
+  GstColorConvStream *stream;
+
+  memset (check, 0, sizeof (*check));
+  g_mutex_init (&check->lock);
+  g_cond_init (&check->cond);
+
+  sched = gst_color_conv_scheduler_new (vendor_lane, lanes);
+  stream = gst_color_conv_stream_new (sched, FALSE, TRUE, SCHED_MAX_JOBS,
+      sched_check_run, check);
+  if (second) {
+    *second = gst_color_conv_stream_new (sched, FALSE, TRUE, SCHED_MAX_JOBS,
+        sched_check_run, check);
+  }
+  gst_color_conv_scheduler_unref (sched);
+
+  return stream;
+}
+
+static GstColorConvStream *
+sched_check_new (SchedCheck * check, gboolean vendor_lane, guint lanes)
+{
+  return sched_check_new_full (check, vendor_lane, lanes, NULL);
+}
+
+static void
+sched_check_free (SchedCheck * check, GstColorConvStream * stream)
+{
+  gst_color_conv_stream_free (stream);
+  g_cond_clear (&check->cond);
+  g_mutex_clear (&check->lock);
+}
+
+static gpointer
+sched_submit_jobs (gpointer data)
+{
+  GstColorConvStream *stream = data;
+  guint n;
+
+  for (n = 1; n <= SCHED_JOBS; n++) {
+    g_assert (gst_color_conv_stream_submit (stream, GUINT_TO_POINTER (n), -1));
+  }
+
+  return NULL;
+}
+
+static void
+test_scheduler_order (void)
+{
+  SchedCheck check;
+  GstColorConvStream *stream = sched_check_new (&check, FALSE, SCHED_LANES);
+  GThread *thread;
+  guint n;
+
+  /* Submitting blocks on a full stream, popping makes room. */
+  thread = g_thread_new ("submit", sched_submit_jobs, stream);
+
+  for (n = 1; n <= SCHED_JOBS; n++) {
+    g_assert_cmpuint (GPOINTER_TO_UINT (gst_color_conv_stream_pop (stream)),
+        ==, n);
+    gst_color_conv_stream_release (stream);
+  }
+
+  g_thread_join (thread);
+
+  g_assert_cmpuint (check.ran, ==, SCHED_JOBS);
+  g_assert_cmpuint (check.max_running, >, 1);
+  g_assert_cmpuint (check.max_running, <=, SCHED_LANES);
+
+  sched_check_free (&check, stream);
+}
+
+static gpointer
+sched_pop_jobs (gpointer data)
+{
+  SchedCheck *check = ((gpointer *) data)[0];
+  GstColorConvStream *stream = ((gpointer *) data)[1];
+  guint n;
+
+  for (n = 1; n <= SCHED_JOBS; n++) {
+    g_assert (gst_color_conv_stream_pop (stream) != NULL);
+    g_usleep (200);
+
+    g_mutex_lock (&check->lock);
+    check->released++;
+    g_mutex_unlock (&check->lock);
+
+    gst_color_conv_stream_release (stream);
+  }
+
+  return NULL;
+}
+
+static void
+test_scheduler_drain (void)
+{
+  SchedCheck check;
+  GstColorConvStream *stream = sched_check_new (&check, FALSE, SCHED_LANES);
+  gpointer data[2] = { &check, stream };
+  GThread *thread;
+
+  thread = g_thread_new ("pop", sched_pop_jobs, data);
+
+  sched_submit_jobs (stream);
+
+  /* Returns once the last job is released, not just converted. */
+  g_assert (gst_color_conv_stream_drain (stream));
+
+  g_mutex_lock (&check.lock);
+  g_assert_cmpuint (check.released, ==, SCHED_JOBS);
+  g_mutex_unlock (&check.lock);
+
+  g_thread_join (thread);
+
+  /* Nothing in flight drains right away. */
+  g_assert (gst_color_conv_stream_drain (stream));
+
+  sched_check_free (&check, stream);
+}
+
+/* Submits a batch of jobs and takes them back in order. */
+static void
+sched_run_batch (GstColorConvStream * stream, guint first)
+{
+  guint n;
+
+  for (n = first; n < first + SCHED_MAX_JOBS; n++) {
+    g_assert (gst_color_conv_stream_submit (stream, GUINT_TO_POINTER (n), -1));
+  }
+
+  for (n = first; n < first + SCHED_MAX_JOBS; n++) {
+    g_assert (gst_color_conv_stream_pop (stream) == GUINT_TO_POINTER (n));
+    gst_color_conv_stream_release (stream);
+  }
+}
+
+static void
+test_scheduler_lanes (void)
+{
+  SchedCheck check;
+  GstColorConvStream *stream = sched_check_new (&check, TRUE, SCHED_LANES);
+
+  /* The vendor lane is idle but not for this stream. */
+  sched_run_batch (stream, 1);
+  g_assert_cmpuint (check.ran, ==, SCHED_MAX_JOBS);
+  g_assert_cmpuint (check.ran_vendor, ==, 0);
+
+  /* Input the CPU kernels cannot read goes to the vendor lane only. */
+  gst_color_conv_stream_set_lanes (stream, TRUE, FALSE);
+  sched_run_batch (stream, SCHED_MAX_JOBS + 1);
+  g_assert_cmpuint (check.ran, ==, 2 * SCHED_MAX_JOBS);
+  g_assert_cmpuint (check.ran_vendor, ==, SCHED_MAX_JOBS);
+  g_assert_cmpuint (check.max_running, <=, SCHED_LANES);
+
+  sched_check_free (&check, stream);
+}
+
+/* Waits for the given number of jobs to be running. */
+static void
+sched_wait_running (SchedCheck * check, guint running)
+{
+  g_mutex_lock (&check->lock);
+  while (check->running < running) {
+    g_cond_wait (&check->cond, &check->lock);
+  }
+  g_mutex_unlock (&check->lock);
+}
+
+static void
+sched_release_hold (SchedCheck * check)
+{
+  g_mutex_lock (&check->lock);
+  check->hold = FALSE;
+  g_cond_broadcast (&check->cond);
+  g_mutex_unlock (&check->lock);
+}
+
+/* Takes back count jobs numbered from first, in order. */
+static void
+sched_pop_range (GstColorConvStream * stream, guint first, guint count)
+{
+  guint n;
+
+  for (n = first; n < first + count; n++) {
+    g_assert (gst_color_conv_stream_pop (stream) == GUINT_TO_POINTER (n));
+    gst_color_conv_stream_release (stream);
+  }
+}
+
+/*
+ * A stream that queued up first does not keep both CPU lanes once another
+ * one has work, each gets its share. A vendor lane neither CPU only stream
+ * may use does not make that share any larger.
+ */
+static void
+check_scheduler_fairness (gboolean vendor_lane)
+{
+  SchedCheck check;
+  GstColorConvStream *second;
+  GstColorConvStream *first = sched_check_new_full (&check, vendor_lane, 2,
+      &second);
+  guint n;
+
+  /* The first stream takes both idle lanes and holds them. */
+  check.hold = TRUE;
+  for (n = 1; n <= SCHED_MAX_JOBS; n++) {
+    g_assert (gst_color_conv_stream_submit (first, GUINT_TO_POINTER (n), -1));
+  }
+  sched_wait_running (&check, 2);
+
+  for (n = SCHED_SECOND; n < SCHED_SECOND + SCHED_MAX_JOBS; n++) {
+    g_assert (gst_color_conv_stream_submit (second, GUINT_TO_POINTER (n),
+            -1));
+  }
+
+  g_mutex_lock (&check.lock);
+  check.contended = TRUE;
+  g_mutex_unlock (&check.lock);
+  sched_release_hold (&check);
+
+  sched_pop_range (first, 1, SCHED_MAX_JOBS);
+  sched_pop_range (second, SCHED_SECOND, SCHED_MAX_JOBS);
+
+  g_assert_cmpuint (check.ran, ==, 2 * SCHED_MAX_JOBS);
+  g_assert_cmpuint (check.unfair, ==, 0);
+
+  /* The first lane to free up goes to the second stream. */
+  g_assert_cmpuint (check.started[2], ==, SCHED_SECOND);
+
+  gst_color_conv_stream_free (second);
+  sched_check_free (&check, first);
+}
+
+static void
+test_scheduler_fairness (void)
+{
+  check_scheduler_fairness (FALSE);
+  check_scheduler_fairness (TRUE);
+}
+
+/* Between streams with a lane each to spare, the earliest deadline wins. */
+static void
+test_scheduler_deadlines (void)
+{
+  static const guint order[] = { 1, SCHED_SECOND, 2, SCHED_SECOND + 1, 3 };
+  SchedCheck check;
+  GstColorConvStream *second;
+  GstColorConvStream *first = sched_check_new_full (&check, FALSE, 1,
+      &second);
+  guint i;
+
+  check.hold = TRUE;
+  g_assert (gst_color_conv_stream_submit (first, GUINT_TO_POINTER (1), 0));
+  sched_wait_running (&check, 1);
+
+  g_assert (gst_color_conv_stream_submit (first, GUINT_TO_POINTER (2), 300));
+  g_assert (gst_color_conv_stream_submit (first, GUINT_TO_POINTER (3), 400));
+  g_assert (gst_color_conv_stream_submit (second,
+          GUINT_TO_POINTER (SCHED_SECOND), 100));
+  g_assert (gst_color_conv_stream_submit (second,
+          GUINT_TO_POINTER (SCHED_SECOND + 1), 350));
+  sched_release_hold (&check);
+
+  sched_pop_range (first, 1, 3);
+  sched_pop_range (second, SCHED_SECOND, 2);
+
+  g_assert_cmpuint (check.n_started, ==, G_N_ELEMENTS (order));
+  for (i = 0; i < G_N_ELEMENTS (order); i++) {
+    g_assert_cmpuint (check.started[i], ==, order[i]);
+  }
+
+  gst_color_conv_stream_free (second);
+  sched_check_free (&check, first);
+}
+
+static gpointer
+sched_unhold (gpointer data)
+{
+  SchedCheck *check = data;
+
+  g_usleep (20000);
+
+  g_mutex_lock (&check->lock);
+  check->hold = FALSE;
+  g_cond_broadcast (&check->cond);
+  g_mutex_unlock (&check->lock);
+
+  return NULL;
+}
+
+static void
+test_scheduler_flush (void)
+{
+  SchedCheck check;
+  GstColorConvStream *stream = sched_check_new (&check, FALSE, 1);
+  GThread *thread;
+  guint n;
+
+  /* One job runs and holds the only lane, the others wait for it. */
+  check.hold = TRUE;
+  for (n = 1; n <= SCHED_MAX_JOBS; n++) {
+    g_assert (gst_color_conv_stream_submit (stream, GUINT_TO_POINTER (n), -1));
+  }
+
+  g_mutex_lock (&check.lock);
+  while (check.running == 0) {
+    g_cond_wait (&check.cond, &check.lock);
+  }
+  g_mutex_unlock (&check.lock);
+
+  gst_color_conv_stream_set_flushing (stream, TRUE);
+
+  g_assert (!gst_color_conv_stream_submit (stream, GUINT_TO_POINTER (n), -1));
+  g_assert (!gst_color_conv_stream_append (stream, GUINT_TO_POINTER (n)));
+  g_assert (gst_color_conv_stream_pop (stream) == NULL);
+  g_assert (!gst_color_conv_stream_drain (stream));
+
+  /* Waits for the running job, the queued ones never run. */
+  thread = g_thread_new ("unhold", sched_unhold, &check);
+  sched_dropped = 0;
+  gst_color_conv_stream_flush (stream, sched_check_drop);
+  g_thread_join (thread);
+
+  g_assert_cmpint (g_atomic_int_get (&sched_dropped), ==, SCHED_MAX_JOBS);
+  g_assert_cmpuint (check.ran, ==, 1);
+  g_assert_cmpuint (check.running, ==, 0);
+
+  /* Back to normal, with the whole stream free again. */
+  gst_color_conv_stream_set_flushing (stream, FALSE);
+
+  g_assert (gst_color_conv_stream_append (stream, GUINT_TO_POINTER (n)));
+  g_assert_cmpuint (GPOINTER_TO_UINT (gst_color_conv_stream_pop (stream)), ==,
+      n);
+  gst_color_conv_stream_release (stream);
+  g_assert (gst_color_conv_stream_drain (stream));
+
+  sched_check_free (&check, stream);
+}
+
+static void
+test_backend (void)
+{
+  GModule *mod = NULL;
+  GstColorConvBackend *backend = load_backend (&mod);
+  GList *frames;
+  GList *l;
+  int hal_format;
+  guint tested = 0;
+
+  if (!backend) {
+    unload_backend (backend, mod);
+    return;
+  }
+
+  hal_format = backend->get_hal_format (backend->handle);
+  frames = load_frames ();
+
+  for (l = frames; l; l = l->next) {
+    Frame *frame = l->data;
+    guint8 *expected;
+    guint8 *out;
+    gsize size = frame->width * frame->height +
+        2 * (frame->width / 2) * (frame->height / 2);
+    gchar *what;
+
+    if (frame->format->omx_format != hal_format) {
+      continue;
+    }
+
+    expected = ref_convert (frame);
+    out = g_malloc0 (size);
+
+    what = g_strdup_printf ("backend %s %dx%d", frame->format->name,
+        frame->width, frame->height);
+    g_assert (backend->convert (backend->handle, frame->width, frame->height,
+            frame->data, out));
+    compare_bytes (what, expected, out, size, 0);
+    tested++;
+
+    g_free (what);
+    g_free (out);
+    g_free (expected);
+  }
+
+  g_test_message ("backend format 0x%x, %u frames checked", hal_format,
+      tested);
+
+  g_list_free_full (frames, (GDestroyNotify) free_frame);
+  unload_backend (backend, mod);
+}
+
+static void
+test_perf (void)
+{
+  int width = 1278;
+  int height = 720;
+  GstColorConvPlanes padded;
+  GstColorConvPlanes packed;
+  GstColorConvLuts luts;
+  guint8 *src;
+  guint8 *dst;
+  gint64 start;
+  gint64 elapsed;
+  guint i, n;
+  gchar *name;
+
+  gst_color_conv_planes_padded (&padded, width, height);
+  gst_color_conv_planes_packed (&packed, width, height);
+  gst_color_conv_range_build_luts (GST_COLOR_CONV_RANGE_FULL_TO_LIMITED, luts);
+
+  src = g_malloc (packed.size);
+  dst = g_malloc (padded.size);
+  fill_pattern (src, packed.size, 1);
+
+  for (i = 0; i < n_kernels; i++) {
+    start = g_get_monotonic_time ();
+    for (n = 0; (elapsed = g_get_monotonic_time () - start) < PERF_MIN_TIME;
+        n++) {
+      gst_color_conv_repack (kernels[i], dst, &padded, src, &packed, NULL);
+    }
+
+    name = g_strdup_printf ("repack-%s-1278x720", kernels[i]->name);
+    perf_check (name, width, height, elapsed, n);
+    g_free (name);
+  }
+
+  start = g_get_monotonic_time ();
+  for (n = 0; (elapsed = g_get_monotonic_time () - start) < PERF_MIN_TIME;
+      n++) {
+    gst_color_conv_repack (kernels[0], dst, &padded, src, &packed, luts);
+  }
+  perf_check ("range-1278x720", width, height, elapsed, n);
+
+  g_free (dst);
+  g_free (src);
+}
+
+static void
+test_convert_perf (void)
+{
+  int width = 1280;
+  int height = 720;
+  gsize in_size = ref_tiled_size (width, height, NULL);
+  guint8 *in;
+  guint8 *out;
+  gint64 start;
+  gint64 elapsed;
+  guint f, i, n;
+  gchar *name;
+
+  in = g_malloc (in_size);
+  out = g_malloc (width * height * 3 / 2);
+  fill_pattern (in, in_size, 3);
+
+  for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+    for (i = 0; i < n_kernels; i++) {
+      start = g_get_monotonic_time ();
+      for (n = 0; (elapsed = g_get_monotonic_time () - start) < PERF_MIN_TIME;
+          n++) {
+        gst_color_conv_convert (kernels[i], formats[f].omx_format, width,
+            height, in, out);
+      }
+
+      name = g_strdup_printf ("convert-%s-%s-1280x720", formats[f].name,
+          kernels[i]->name);
+      perf_check (name, width, height, elapsed, n);
+      g_free (name);
+    }
+  }
+
+  g_free (out);
+  g_free (in);
+}
+
+static void
+test_backend_perf (void)
+{
+  GModule *mod = NULL;
+  GstColorConvBackend *backend = load_backend (&mod);
+  int width = 1280;
+  int height = 720;
+  guint8 *in;
+  guint8 *out;
+  gint64 start;
+  gint64 elapsed;
+  guint n;
+  gchar *name;
+
+  if (!backend) {
+    unload_backend (backend, mod);
+    return;
+  }
+
+  /* big enough for the tiled layout as well */
+  in = g_malloc (ref_tiled_size (width, height, NULL));
+  out = g_malloc (width * height * 3 / 2);
+  fill_pattern (in, ref_tiled_size (width, height, NULL), 2);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; (elapsed = g_get_monotonic_time () - start) < PERF_MIN_TIME;
+      n++) {
+    g_assert (backend->convert (backend->handle, width, height, in, out));
+  }
+
+  name = g_strdup_printf ("backend-0x%x-1280x720",
+      backend->get_hal_format (backend->handle));
+  perf_check (name, width, height, elapsed, n);
+
+  g_free (name);
+  g_free (out);
+  g_free (in);
+  unload_backend (backend, mod);
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar *record_path;
+  int ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  load_baseline ();
+
+  n_kernels = gst_color_conv_kernels_get_supported (kernels,
+      G_N_ELEMENTS (kernels));
+  g_assert (gst_color_conv_kernels_get () != NULL);
+
+  record_path = g_getenv ("COLORCONV_PERF_RECORD");
+  if (record_path) {
+    record = fopen (record_path, "w");
+  }
+
+  g_test_add_func ("/colorconv/layout", test_layout);
+  g_test_add_func ("/colorconv/repack", test_repack);
+  g_test_add_func ("/colorconv/range", test_range);
+  g_test_add_func ("/colorconv/orient", test_orient);
+  g_test_add_func ("/colorconv/convert", test_convert);
+  g_test_add_func ("/colorconv/stream-copy", test_stream_copy);
+  g_test_add_func ("/colorconv/checksum", test_checksum);
+  g_test_add_func ("/colorconv/convert-bounced", test_convert_bounced);
+  g_test_add_func ("/colorconv/convert-layout", test_convert_layout);
+  g_test_add_func ("/colorconv/tune", test_tune);
+  g_test_add_func ("/colorconv/capture", test_capture);
+  g_test_add_func ("/colorconv/capture-layout", test_capture_layout);
+  g_test_add_func ("/colorconv/trace", test_trace);
+  g_test_add_func ("/colorconv/scheduler-order", test_scheduler_order);
+  g_test_add_func ("/colorconv/scheduler-drain", test_scheduler_drain);
+  g_test_add_func ("/colorconv/scheduler-flush", test_scheduler_flush);
+  g_test_add_func ("/colorconv/scheduler-lanes", test_scheduler_lanes);
+  g_test_add_func ("/colorconv/scheduler-fairness", test_scheduler_fairness);
+  g_test_add_func ("/colorconv/scheduler-deadlines",
+      test_scheduler_deadlines);
+  g_test_add_func ("/colorconv/backend", test_backend);
+  g_test_add_func ("/colorconv/perf", test_perf);
+  g_test_add_func ("/colorconv/convert-perf", test_convert_perf);
+  g_test_add_func ("/colorconv/backend-perf", test_backend_perf);
+
+  ret = g_test_run ();
+
+  if (record) {
+    fclose (record);
+  }
+
+  if (baseline) {
+    g_hash_table_destroy (baseline);
+  }
+
+  return ret;
+}
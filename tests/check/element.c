@@ -0,0 +1,1401 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Checks for the parts of the element that need GStreamer, built against
+ * whichever API the plugin is. The 1.x element is driven through test
+ * pads with gralloc buffers and a stub backend that fails every frame,
+ * which also covers the allocation query, output strides and the native
+ * branch. The 0.10 element gets GstNativeBuffer input the same way. The
+ * checks are skipped on machines without gralloc.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <gst/gst.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gst/video/video.h>
+#if GST_CHECK_VERSION (1,0,0)
+#include <glib/gstdio.h>
+#include <hardware/gralloc.h>
+#else
+#include <gst/gstnativebuffer.h>
+#include "gstcolorconvfdbuffer.h"
+#endif
+#include "gstcolorconvkernels.h"
+
+GST_DEBUG_CATEGORY (colorconv_debug);
+
+#if !GST_CHECK_VERSION (1,0,0)
+#define FD_BUFFER_SIZE 4096
+
+static void
+test_fd_pool (void)
+{
+  GstColorConvFdPool *pool = gst_color_conv_fd_pool_new (FD_BUFFER_SIZE);
+  GstBuffer *first;
+  GstBuffer *second;
+  GstBuffer *buf;
+  guint8 *data;
+  struct stat st;
+  int fd;
+
+  first = gst_color_conv_fd_pool_acquire (pool);
+  if (!first) {
+    g_test_message ("memfd not available");
+    gst_color_conv_fd_pool_destroy (pool);
+    return;
+  }
+
+  g_assert (GST_IS_COLOR_CONV_FD_BUFFER (first));
+  g_assert_cmpuint (GST_BUFFER_SIZE (first), ==, FD_BUFFER_SIZE);
+
+  fd = GST_COLOR_CONV_FD_BUFFER_FD (first);
+  data = GST_BUFFER_DATA (first);
+  g_assert_cmpint (fstat (fd, &st), ==, 0);
+  g_assert_cmpint (st.st_size, ==, FD_BUFFER_SIZE);
+
+  /* Sealed, a consumer can map the whole size without it going away. */
+  g_assert_cmpint (ftruncate (fd, FD_BUFFER_SIZE / 2), ==, -1);
+  g_assert_cmpint (ftruncate (fd, FD_BUFFER_SIZE * 2), ==, -1);
+
+  /* Buffers held downstream are not handed out twice. */
+  second = gst_color_conv_fd_pool_acquire (pool);
+  g_assert (second != NULL);
+  g_assert_cmpint (GST_COLOR_CONV_FD_BUFFER_FD (second), !=, fd);
+
+  memset (data, 0x5a, FD_BUFFER_SIZE);
+  gst_buffer_unref (second);
+  gst_buffer_unref (first);
+
+  /* The last released buffer comes back with its fd and mapping. */
+  buf = gst_color_conv_fd_pool_acquire (pool);
+  g_assert (buf == first);
+  g_assert_cmpint (GST_COLOR_CONV_FD_BUFFER_FD (buf), ==, fd);
+  g_assert (GST_BUFFER_DATA (buf) == data);
+  g_assert_cmpint (data[FD_BUFFER_SIZE - 1], ==, 0x5a);
+  g_assert_cmpuint (GST_BUFFER_SIZE (buf), ==, FD_BUFFER_SIZE);
+  g_assert (GST_BUFFER_CAPS (buf) == NULL);
+
+  /* Buffers still out outlive the pool. */
+  gst_color_conv_fd_pool_destroy (pool);
+  memset (GST_BUFFER_DATA (buf), 0, FD_BUFFER_SIZE);
+  gst_buffer_unref (buf);
+}
+
+#define REPEAT_WIDTH 64
+#define REPEAT_HEIGHT 48
+#define REPEAT_COUNT 8
+#define REPEAT_USAGE \
+    (GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN)
+
+static GstStaticPadTemplate native_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-android-buffer"));
+
+static GstStaticPadTemplate i420_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_YUV ("I420")));
+
+/* Vendor scheduling pushes from the chain function of the element. */
+static GstFlowReturn
+repeat_check_chain (GstPad * pad, GstBuffer * buffer)
+{
+  g_queue_push_tail (gst_pad_get_element_private (pad), buffer);
+
+  return GST_FLOW_OK;
+}
+
+/* Whether the CPU fallback can read frames from @gralloc. */
+static gboolean
+repeat_check_layouts (GstGralloc * gralloc)
+{
+#ifdef GRALLOC_MODULE_API_VERSION_0_2
+  return gralloc->gralloc->common.module_api_version >=
+      GRALLOC_MODULE_API_VERSION_0_2 && gralloc->gralloc->lock_ycbcr;
+#else
+  return FALSE;
+#endif
+}
+
+/*
+ * The same frame pushed again goes out as the last converted frame
+ * itself, not a copy of it, with its own timestamps and no discontinuity
+ * from the frames that were not converted.
+ */
+static void
+test_skip_unchanged (void)
+{
+  GstGralloc *gralloc = gst_gralloc_new ();
+  buffer_handle_t handle;
+  GQueue buffers = G_QUEUE_INIT;
+  GstElement *conv;
+  GstPad *src;
+  GstPad *sink;
+  GstPad *pad;
+  GstCaps *caps;
+  GstBuffer *first;
+  GstBuffer *buffer;
+  guint skipped;
+  int stride;
+  guint n;
+
+  if (!gralloc) {
+    g_test_message ("gralloc not available");
+    return;
+  }
+
+  if (!repeat_check_layouts (gralloc)) {
+    g_test_message ("gralloc does not report plane layouts");
+    gst_gralloc_unref (gralloc);
+    return;
+  }
+
+  if (gralloc->allocator->alloc (gralloc->allocator, REPEAT_WIDTH,
+          REPEAT_HEIGHT, GST_COLOR_CONV_FORMAT_NV12, REPEAT_USAGE, &handle,
+          &stride) != 0) {
+    g_test_message ("cannot allocate NV12 buffers");
+    gst_gralloc_unref (gralloc);
+    return;
+  }
+
+  conv = gst_element_factory_make ("colorconv", NULL);
+  g_assert (conv != NULL);
+  gst_util_set_object_arg (G_OBJECT (conv), "scheduling", "vendor");
+  gst_util_set_object_arg (G_OBJECT (conv), "skip-unchanged", "full");
+
+  src = gst_pad_new_from_static_template (&native_src_template, "src");
+  sink = gst_pad_new_from_static_template (&i420_template, "sink");
+  gst_pad_set_element_private (sink, &buffers);
+  gst_pad_set_chain_function (sink, repeat_check_chain);
+
+  pad = gst_element_get_static_pad (conv, "sink");
+  g_assert_cmpint (gst_pad_link (src, pad), ==, GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+
+  pad = gst_element_get_static_pad (conv, "src");
+  g_assert_cmpint (gst_pad_link (pad, sink), ==, GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+
+  gst_pad_set_active (src, TRUE);
+  gst_pad_set_active (sink, TRUE);
+  g_assert_cmpint (gst_element_set_state (conv, GST_STATE_PLAYING), ==,
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_assert (gst_pad_push_event (src, gst_event_new_new_segment (FALSE, 1.0,
+              GST_FORMAT_TIME, 0, -1, 0)));
+
+  caps = gst_caps_new_simple ("video/x-android-buffer",
+      "width", G_TYPE_INT, REPEAT_WIDTH,
+      "height", G_TYPE_INT, REPEAT_HEIGHT,
+      "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+
+  for (n = 0; n < REPEAT_COUNT; n++) {
+    buffer = GST_BUFFER (gst_native_buffer_new (handle, gralloc,
+            REPEAT_WIDTH, REPEAT_HEIGHT, stride, REPEAT_USAGE,
+            GST_COLOR_CONV_FORMAT_NV12));
+    gst_buffer_set_caps (buffer, caps);
+    GST_BUFFER_TIMESTAMP (buffer) = gst_util_uint64_scale (n, GST_SECOND, 30);
+    GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale (1, GST_SECOND, 30);
+    g_assert_cmpint (gst_pad_push (src, buffer), ==, GST_FLOW_OK);
+  }
+
+  gst_caps_unref (caps);
+  g_assert_cmpuint (g_queue_get_length (&buffers), ==, REPEAT_COUNT);
+
+  first = g_queue_pop_head (&buffers);
+  g_assert_cmpuint (GST_BUFFER_TIMESTAMP (first), ==, 0);
+
+  for (n = 1; n < REPEAT_COUNT; n++) {
+    buffer = g_queue_pop_head (&buffers);
+    g_assert (GST_BUFFER_DATA (buffer) == GST_BUFFER_DATA (first));
+    g_assert_cmpuint (GST_BUFFER_SIZE (buffer), ==, GST_BUFFER_SIZE (first));
+    g_assert_cmpuint (GST_BUFFER_TIMESTAMP (buffer), ==,
+        gst_util_uint64_scale (n, GST_SECOND, 30));
+    g_assert_cmpuint (GST_BUFFER_DURATION (buffer), ==,
+        gst_util_uint64_scale (1, GST_SECOND, 30));
+    g_assert (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT));
+    gst_buffer_unref (buffer);
+  }
+
+  gst_buffer_unref (first);
+
+  g_object_get (conv, "skipped-frames", &skipped, NULL);
+  g_assert_cmpuint (skipped, ==, REPEAT_COUNT - 1);
+
+  gst_element_set_state (conv, GST_STATE_NULL);
+  gst_pad_set_active (src, FALSE);
+  gst_pad_set_active (sink, FALSE);
+  gst_object_unref (src);
+  gst_object_unref (sink);
+  gst_object_unref (conv);
+
+  gralloc->allocator->free (gralloc->allocator, handle);
+  gst_gralloc_unref (gralloc);
+}
+#endif
+
+#if GST_CHECK_VERSION (1,0,0)
+#define FRAME_WIDTH 64
+#define FRAME_HEIGHT 48
+#define FRAME_COUNT 16
+#define PULL_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+/* What the test source answers latency queries with */
+#define UPSTREAM_MIN_LATENCY (10 * GST_MSECOND)
+#define UPSTREAM_MAX_LATENCY (40 * GST_MSECOND)
+#define CONV_LATENCY (5 * GST_MSECOND)
+/* Row alignment asked for when downstream takes video meta */
+#define OUTPUT_ALIGN 64
+
+#define LUMA(x, y) ((guint8) ((x) * 3 + (y) * 5))
+#define CB(x, y) ((guint8) ((x) + (y) * 2 + 64))
+#define CR(x, y) ((guint8) ((x) * 2 + (y) + 32))
+
+static GstStaticPadTemplate native_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-android-buffer"));
+
+static GstStaticPadTemplate native_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-android-buffer"));
+
+static GstStaticPadTemplate i420_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("I420")));
+
+/* One gralloc frame pushed again and again and the element around it. */
+typedef struct {
+  const gralloc_module_t *gralloc;
+  alloc_device_t *alloc;
+  buffer_handle_t handle;
+  /* the frame size, FRAME_WIDTH x FRAME_HEIGHT unless asked otherwise */
+  int width;
+  int height;
+
+  GstElement *conv;
+  GstPad *src;
+  GstPad *sink;
+  /* the requested native pad and what it is linked to, if anything */
+  GstPad *native;
+  GstPad *native_sink;
+
+  /* answer allocation queries with video meta and OUTPUT_ALIGN */
+  gboolean video_meta;
+
+  GMutex lock;
+  GCond cond;
+  GQueue buffers;
+  GQueue native_buffers;
+} ElementCheck;
+
+static GstFlowReturn
+element_check_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  ElementCheck *check = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&check->lock);
+  g_queue_push_tail (pad == check->sink ? &check->buffers :
+      &check->native_buffers, buffer);
+  g_cond_broadcast (&check->cond);
+  g_mutex_unlock (&check->lock);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+element_check_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  ElementCheck *check = gst_pad_get_element_private (pad);
+  GstAllocationParams params;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION || !check->video_meta) {
+    return gst_pad_query_default (pad, parent, query);
+  }
+
+  gst_allocation_params_init (&params);
+  params.align = OUTPUT_ALIGN - 1;
+  gst_query_add_allocation_param (query, NULL, &params);
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+
+  return TRUE;
+}
+
+/*
+ * Allocates an NV12 frame and fills it with a known pattern through the
+ * layout gralloc reports. Returns FALSE if gralloc is not there or cannot
+ * report the layout, the element then never converts on the CPU.
+ */
+static gboolean
+element_check_alloc (ElementCheck * check)
+{
+#ifdef GRALLOC_MODULE_API_VERSION_0_2
+  struct android_ycbcr ycbcr;
+  guint8 *y;
+  guint8 *cb;
+  guint8 *cr;
+  int stride;
+  int row;
+  int col;
+
+  if (hw_get_module (GRALLOC_HARDWARE_MODULE_ID,
+          (const hw_module_t **) & check->gralloc) != 0) {
+    g_test_message ("gralloc not available");
+    return FALSE;
+  }
+
+  if (check->gralloc->common.module_api_version <
+      GRALLOC_MODULE_API_VERSION_0_2 || !check->gralloc->lock_ycbcr) {
+    g_test_message ("gralloc does not report plane layouts");
+    return FALSE;
+  }
+
+  if (gralloc_open (&check->gralloc->common, &check->alloc) != 0) {
+    g_test_message ("no gralloc allocator");
+    return FALSE;
+  }
+
+  if (check->alloc->alloc (check->alloc, check->width, check->height,
+          GST_COLOR_CONV_FORMAT_NV12,
+          GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
+          &check->handle, &stride) != 0) {
+    g_test_message ("cannot allocate NV12 buffers");
+    gralloc_close (check->alloc);
+    return FALSE;
+  }
+
+  g_assert_cmpint (check->gralloc->lock_ycbcr (check->gralloc, check->handle,
+          GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, check->width, check->height,
+          &ycbcr), ==, 0);
+  g_assert_cmpuint (ycbcr.chroma_step, ==, 2);
+
+  y = ycbcr.y;
+  cb = ycbcr.cb;
+  cr = ycbcr.cr;
+
+  for (row = 0; row < check->height; row++) {
+    for (col = 0; col < check->width; col++) {
+      y[row * ycbcr.ystride + col] = LUMA (col, row);
+    }
+  }
+
+  for (row = 0; row < check->height / 2; row++) {
+    for (col = 0; col < check->width / 2; col++) {
+      cb[row * ycbcr.cstride + col * 2] = CB (col, row);
+      cr[row * ycbcr.cstride + col * 2] = CR (col, row);
+    }
+  }
+
+  g_assert_cmpint (check->gralloc->unlock (check->gralloc, check->handle),
+      ==, 0);
+
+  return TRUE;
+#else
+  g_test_message ("gralloc does not report plane layouts");
+  return FALSE;
+#endif
+}
+
+/*
+ * Sets up a frame of the given size and an element with the given
+ * scheduling, ready to be configured further. Returns FALSE, with nothing
+ * to clean up, if the check cannot run here.
+ */
+static gboolean
+element_check_new_size (ElementCheck * check, const gchar * scheduling,
+    guint cpu_threads, gboolean video_meta, int width, int height)
+{
+  memset (check, 0, sizeof (*check));
+  check->width = width;
+  check->height = height;
+
+  if (!element_check_alloc (check)) {
+    return FALSE;
+  }
+
+  check->video_meta = video_meta;
+  g_mutex_init (&check->lock);
+  g_cond_init (&check->cond);
+  g_queue_init (&check->buffers);
+  g_queue_init (&check->native_buffers);
+
+  check->conv = gst_element_factory_make ("colorconv", NULL);
+  g_assert (check->conv != NULL);
+  gst_util_set_object_arg (G_OBJECT (check->conv), "scheduling", scheduling);
+  g_object_set (check->conv, "cpu-threads", cpu_threads, NULL);
+
+  check->src = gst_pad_new_from_static_template (&native_src_template, "src");
+  check->sink = gst_pad_new_from_static_template (&i420_template, "sink");
+  gst_pad_set_element_private (check->sink, check);
+  gst_pad_set_chain_function (check->sink, element_check_chain);
+  gst_pad_set_query_function (check->sink, element_check_query);
+
+  return TRUE;
+}
+
+static gboolean
+element_check_new (ElementCheck * check, const gchar * scheduling,
+    guint cpu_threads, gboolean video_meta)
+{
+  return element_check_new_size (check, scheduling, cpu_threads, video_meta,
+      FRAME_WIDTH, FRAME_HEIGHT);
+}
+
+/* Requests the native pad and links it to a pad collecting its output. */
+static void
+element_check_request_native (ElementCheck * check, gboolean link)
+{
+  check->native = gst_element_get_request_pad (check->conv, "native");
+  g_assert (check->native != NULL);
+
+  if (!link) {
+    return;
+  }
+
+  check->native_sink = gst_pad_new_from_static_template (&native_sink_template,
+      "sink");
+  gst_pad_set_element_private (check->native_sink, check);
+  gst_pad_set_chain_function (check->native_sink, element_check_chain);
+  g_assert_cmpint (gst_pad_link (check->native, check->native_sink), ==,
+      GST_PAD_LINK_OK);
+  gst_pad_set_active (check->native_sink, TRUE);
+}
+
+/* Links the element up, sets it playing and sends caps and segment. */
+static void
+element_check_play (ElementCheck * check)
+{
+  GstPad *pad;
+  GstSegment segment;
+
+  pad = gst_element_get_static_pad (check->conv, "sink");
+  g_assert_cmpint (gst_pad_link (check->src, pad), ==, GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+
+  pad = gst_element_get_static_pad (check->conv, "src");
+  g_assert_cmpint (gst_pad_link (pad, check->sink), ==, GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+
+  gst_pad_set_active (check->src, TRUE);
+  gst_pad_set_active (check->sink, TRUE);
+  g_assert_cmpint (gst_element_set_state (check->conv, GST_STATE_PLAYING),
+      ==, GST_STATE_CHANGE_SUCCESS);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  g_assert (gst_pad_push_event (check->src,
+          gst_event_new_stream_start ("colorconv")));
+  g_assert (gst_pad_push_event (check->src,
+          gst_event_new_caps (gst_caps_new_simple ("video/x-android-buffer",
+                  "width", G_TYPE_INT, check->width,
+                  "height", G_TYPE_INT, check->height,
+                  "framerate", GST_TYPE_FRACTION, 30, 1, NULL))));
+  g_assert (gst_pad_push_event (check->src, gst_event_new_segment (&segment)));
+}
+
+static gboolean
+element_check_start (ElementCheck * check, const gchar * scheduling,
+    guint cpu_threads, gboolean video_meta)
+{
+  if (!element_check_new (check, scheduling, cpu_threads, video_meta)) {
+    return FALSE;
+  }
+
+  element_check_play (check);
+
+  return TRUE;
+}
+
+static void
+element_check_stop (ElementCheck * check)
+{
+  gst_element_set_state (check->conv, GST_STATE_NULL);
+  gst_pad_set_active (check->src, FALSE);
+  gst_pad_set_active (check->sink, FALSE);
+  gst_object_unref (check->src);
+  gst_object_unref (check->sink);
+
+  if (check->native) {
+    gst_element_release_request_pad (check->conv, check->native);
+    gst_object_unref (check->native);
+  }
+
+  if (check->native_sink) {
+    gst_pad_set_active (check->native_sink, FALSE);
+    gst_object_unref (check->native_sink);
+  }
+
+  gst_object_unref (check->conv);
+
+  g_queue_free_full (&check->buffers, (GDestroyNotify) gst_buffer_unref);
+  g_queue_init (&check->buffers);
+  g_queue_free_full (&check->native_buffers,
+      (GDestroyNotify) gst_buffer_unref);
+  g_queue_init (&check->native_buffers);
+  g_cond_clear (&check->cond);
+  g_mutex_clear (&check->lock);
+
+  check->alloc->free (check->alloc, check->handle);
+  gralloc_close (check->alloc);
+}
+
+/* Pushes the frame with the timestamp of the n-th one. */
+static GstFlowReturn
+element_check_push (ElementCheck * check, guint n)
+{
+  GstBuffer *buffer;
+
+  buffer = gst_buffer_new_allocate (NULL, sizeof (check->handle), NULL);
+  gst_buffer_fill (buffer, 0, &check->handle, sizeof (check->handle));
+  GST_BUFFER_PTS (buffer) = gst_util_uint64_scale (n, GST_SECOND, 30);
+  GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale (1, GST_SECOND, 30);
+
+  return gst_pad_push (check->src, buffer);
+}
+
+/* Waits for the next buffer on a queue, output may come from a task. */
+static GstBuffer *
+element_check_pull_queue (ElementCheck * check, GQueue * queue)
+{
+  gint64 end = g_get_monotonic_time () + PULL_TIMEOUT;
+  GstBuffer *buffer;
+
+  g_mutex_lock (&check->lock);
+  while (g_queue_is_empty (queue)) {
+    if (!g_cond_wait_until (&check->cond, &check->lock, end)) {
+      g_error ("no output buffer");
+    }
+  }
+  buffer = g_queue_pop_head (queue);
+  g_mutex_unlock (&check->lock);
+
+  return buffer;
+}
+
+static GstBuffer *
+element_check_pull (ElementCheck * check)
+{
+  return element_check_pull_queue (check, &check->buffers);
+}
+
+/* The pattern element_check_alloc () wrote, as I420 with @caps. */
+static void
+element_check_i420 (GstCaps * caps, GstBuffer * buffer)
+{
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  const guint8 *plane;
+  int stride;
+  int row;
+  int col;
+
+  g_assert (gst_video_info_from_caps (&info, caps));
+  g_assert_cmpint (GST_VIDEO_INFO_FORMAT (&info), ==, GST_VIDEO_FORMAT_I420);
+
+  g_assert (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ));
+
+  plane = GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+  stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+  for (row = 0; row < GST_VIDEO_INFO_HEIGHT (&info); row++) {
+    for (col = 0; col < GST_VIDEO_INFO_WIDTH (&info); col++) {
+      g_assert_cmpuint (plane[row * stride + col], ==, LUMA (col, row));
+    }
+  }
+
+  for (row = 0; row < GST_VIDEO_INFO_HEIGHT (&info) / 2; row++) {
+    for (col = 0; col < GST_VIDEO_INFO_WIDTH (&info) / 2; col++) {
+      plane = GST_VIDEO_FRAME_PLANE_DATA (&frame, 1);
+      stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 1);
+      g_assert_cmpuint (plane[row * stride + col], ==, CB (col, row));
+
+      plane = GST_VIDEO_FRAME_PLANE_DATA (&frame, 2);
+      stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 2);
+      g_assert_cmpuint (plane[row * stride + col], ==, CR (col, row));
+    }
+  }
+
+  gst_video_frame_unmap (&frame);
+}
+
+static void
+element_check_frame (ElementCheck * check, GstBuffer * buffer)
+{
+  GstCaps *caps = gst_pad_get_current_caps (check->sink);
+
+  element_check_i420 (caps, buffer);
+  gst_caps_unref (caps);
+}
+
+/*
+ * Pushes FRAME_COUNT frames through the stub backend, which fails all of
+ * them, and checks they all come out converted, in order. Returns how
+ * many the element converted on the CPU because of it.
+ */
+static guint
+element_check_fallback (const gchar * scheduling, guint cpu_threads)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  guint fallbacks;
+  guint n;
+
+  if (!element_check_start (&check, scheduling, cpu_threads, FALSE)) {
+    return G_MAXUINT;
+  }
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+  }
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    buffer = element_check_pull (&check);
+    g_assert_cmpuint (GST_BUFFER_PTS (buffer), ==,
+        gst_util_uint64_scale (n, GST_SECOND, 30));
+    element_check_frame (&check, buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  g_object_get (check.conv, "fallbacks", &fallbacks, NULL);
+  element_check_stop (&check);
+
+  return fallbacks;
+}
+
+static void
+test_vendor_fallback (void)
+{
+  guint fallbacks = element_check_fallback ("vendor", 1);
+
+  if (fallbacks != G_MAXUINT) {
+    g_assert_cmpuint (fallbacks, ==, FRAME_COUNT);
+  }
+}
+
+static void
+test_hybrid_fallback (void)
+{
+  guint fallbacks = element_check_fallback ("hybrid", 3);
+
+  /* Only the frames that went to the vendor lane fall back. */
+  if (fallbacks != G_MAXUINT) {
+    g_assert_cmpuint (fallbacks, <=, FRAME_COUNT);
+  }
+}
+
+/*
+ * The decoder is told how many input buffers the element holds on to,
+ * which is only known once the output allocation is decided.
+ */
+static void
+element_check_allocation (const gchar * scheduling, guint cpu_threads,
+    guint in_flight)
+{
+  ElementCheck check;
+  GstQuery *query;
+  GstCaps *caps;
+  guint size;
+  guint min;
+  guint max;
+
+  if (!element_check_start (&check, scheduling, cpu_threads, FALSE)) {
+    return;
+  }
+
+  g_assert_cmpint (element_check_push (&check, 0), ==, GST_FLOW_OK);
+  gst_buffer_unref (element_check_pull (&check));
+
+  caps = gst_pad_get_current_caps (check.src);
+  query = gst_query_new_allocation (caps, TRUE);
+  gst_caps_unref (caps);
+
+  g_assert (gst_pad_peer_query (check.src, query));
+  g_assert_cmpuint (gst_query_get_n_allocation_pools (query), ==, 1);
+  gst_query_parse_nth_allocation_pool (query, 0, NULL, &size, &min, &max);
+  g_assert_cmpuint (size, ==, sizeof (buffer_handle_t));
+  g_assert_cmpuint (min, ==, in_flight);
+  g_assert_cmpuint (max, ==, 0);
+
+  gst_query_unref (query);
+  element_check_stop (&check);
+}
+
+static void
+test_allocation_query (void)
+{
+  element_check_allocation ("vendor", 1, 1);
+  /* Three frames on the CPU, one on the vendor lane, one being prepared */
+  element_check_allocation ("hybrid", 3, 5);
+}
+
+/*
+ * Converts into buffers with the strides downstream gets through video
+ * meta, or the default ones for the caps without it.
+ */
+static void
+element_check_strides (gboolean video_meta)
+{
+  ElementCheck check;
+  GstVideoMeta *meta;
+  GstBuffer *buffer;
+  guint i;
+
+  if (!element_check_start (&check, "vendor", 1, video_meta)) {
+    return;
+  }
+
+  g_assert_cmpint (element_check_push (&check, 0), ==, GST_FLOW_OK);
+  buffer = element_check_pull (&check);
+
+  meta = gst_buffer_get_video_meta (buffer);
+  if (video_meta) {
+    g_assert (meta != NULL);
+    g_assert_cmpuint (meta->n_planes, ==, 3);
+
+    /* The chroma rows of a 64 pixel wide frame are padded to 64 bytes. */
+    for (i = 0; i < meta->n_planes; i++) {
+      g_assert_cmpint (meta->stride[i] % OUTPUT_ALIGN, ==, 0);
+    }
+    g_assert_cmpint (meta->stride[1], >, FRAME_WIDTH / 2);
+  } else if (meta) {
+    g_assert_cmpint (meta->stride[0], ==, FRAME_WIDTH);
+    g_assert_cmpint (meta->stride[1], ==, FRAME_WIDTH / 2);
+    g_assert_cmpint (meta->stride[2], ==, FRAME_WIDTH / 2);
+  }
+
+  element_check_frame (&check, buffer);
+  gst_buffer_unref (buffer);
+
+  element_check_stop (&check);
+}
+
+static void
+test_video_meta (void)
+{
+  element_check_strides (TRUE);
+}
+
+static void
+test_default_strides (void)
+{
+  element_check_strides (FALSE);
+}
+
+/* Counts the lock spans in a trace dump. */
+static guint
+element_check_count_locks (ElementCheck * check)
+{
+  gchar *path = g_build_filename (g_get_tmp_dir (), "colorconv-trace.json",
+      NULL);
+  gchar *contents;
+  gchar *p;
+  gboolean dumped = FALSE;
+  guint locks = 0;
+
+  g_signal_emit_by_name (check->conv, "dump-trace", path, &dumped);
+  g_assert (dumped);
+  g_assert (g_file_get_contents (path, &contents, NULL, NULL));
+
+  for (p = contents; (p = strstr (p, "\"name\":\"lock\"")); p++) {
+    locks++;
+  }
+
+  g_free (contents);
+  g_unlink (path);
+  g_free (path);
+
+  return locks;
+}
+
+/*
+ * Both branches get every frame, the display branch the input buffer as
+ * it is, and the input is only locked once per frame for converting.
+ */
+static void
+test_native_branches (void)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  buffer_handle_t handle;
+  guint n;
+
+  if (!element_check_new (&check, "vendor", 1, FALSE)) {
+    return;
+  }
+
+  g_object_set (check.conv, "tracing", TRUE, NULL);
+  element_check_request_native (&check, TRUE);
+  element_check_play (&check);
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+  }
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    buffer = element_check_pull_queue (&check, &check.native_buffers);
+    g_assert_cmpuint (gst_buffer_get_size (buffer), ==, sizeof (handle));
+    gst_buffer_extract (buffer, 0, &handle, sizeof (handle));
+    g_assert (handle == check.handle);
+    g_assert_cmpuint (GST_BUFFER_PTS (buffer), ==,
+        gst_util_uint64_scale (n, GST_SECOND, 30));
+    gst_buffer_unref (buffer);
+
+    buffer = element_check_pull (&check);
+    g_assert_cmpuint (GST_BUFFER_PTS (buffer), ==,
+        gst_util_uint64_scale (n, GST_SECOND, 30));
+    element_check_frame (&check, buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  g_assert_cmpuint (element_check_count_locks (&check), ==, FRAME_COUNT);
+
+  element_check_stop (&check);
+}
+
+/* An unlinked native pad does not hold up the converted branch. */
+static void
+test_native_unlinked (void)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  guint n;
+
+  if (!element_check_new (&check, "vendor", 1, FALSE)) {
+    return;
+  }
+
+  element_check_request_native (&check, FALSE);
+  element_check_play (&check);
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+    buffer = element_check_pull (&check);
+    element_check_frame (&check, buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  element_check_stop (&check);
+}
+
+/*
+ * Only every second frame is converted, lasting two input frames, while
+ * the display branch keeps all of them.
+ */
+static void
+test_native_decimation (void)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  guint n;
+
+  if (!element_check_new (&check, "vendor", 1, FALSE)) {
+    return;
+  }
+
+  g_object_set (check.conv, "decimation", 2, NULL);
+  element_check_request_native (&check, TRUE);
+  element_check_play (&check);
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+  }
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    buffer = element_check_pull_queue (&check, &check.native_buffers);
+    g_assert_cmpuint (GST_BUFFER_DURATION (buffer), ==,
+        gst_util_uint64_scale (1, GST_SECOND, 30));
+    gst_buffer_unref (buffer);
+  }
+
+  for (n = 0; n < FRAME_COUNT; n += 2) {
+    buffer = element_check_pull (&check);
+    g_assert_cmpuint (GST_BUFFER_PTS (buffer), ==,
+        gst_util_uint64_scale (n, GST_SECOND, 30));
+    g_assert_cmpuint (GST_BUFFER_DURATION (buffer), ==,
+        2 * gst_util_uint64_scale (1, GST_SECOND, 30));
+    gst_buffer_unref (buffer);
+  }
+
+  g_mutex_lock (&check.lock);
+  g_assert (g_queue_is_empty (&check.buffers));
+  g_mutex_unlock (&check.lock);
+
+  element_check_stop (&check);
+}
+
+/*
+ * Converts a few frames with the auto read strategy and tells whether the
+ * probe of the first one picked bounce reads. Returns FALSE if the check
+ * cannot run here.
+ */
+static gboolean
+element_check_read_probe (gdouble threshold, gboolean * bounce)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  guint n;
+
+  if (!element_check_new (&check, "vendor", 1, FALSE)) {
+    return FALSE;
+  }
+
+  gst_util_set_object_arg (G_OBJECT (check.conv), "read-strategy", "auto");
+  g_object_set (check.conv, "read-cost-threshold", threshold, NULL);
+  element_check_play (&check);
+
+  /* Nothing is measured before the first frame. */
+  g_object_get (check.conv, "bounce-reads", bounce, NULL);
+  g_assert (!*bounce);
+
+  for (n = 0; n < 3; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+    buffer = element_check_pull (&check);
+    element_check_frame (&check, buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  g_object_get (check.conv, "bounce-reads", bounce, NULL);
+  element_check_stop (&check);
+
+  return TRUE;
+}
+
+/*
+ * The same frame pushed again is repeated, not converted. Repeats go out
+ * like converted frames: with their own timestamps, the pattern, and no
+ * discontinuity from the frames that were not converted.
+ */
+static void
+element_check_skip_unchanged (const gchar * scheduling, guint cpu_threads)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  guint skipped;
+  guint n;
+
+  if (!element_check_new (&check, scheduling, cpu_threads, FALSE)) {
+    return;
+  }
+
+  gst_util_set_object_arg (G_OBJECT (check.conv), "skip-unchanged", "full");
+  element_check_play (&check);
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+  }
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    buffer = element_check_pull (&check);
+    g_assert_cmpuint (GST_BUFFER_PTS (buffer), ==,
+        gst_util_uint64_scale (n, GST_SECOND, 30));
+    g_assert_cmpuint (GST_BUFFER_DURATION (buffer), ==,
+        gst_util_uint64_scale (1, GST_SECOND, 30));
+    if (n > 0) {
+      g_assert (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT));
+    }
+    element_check_frame (&check, buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  g_mutex_lock (&check.lock);
+  g_assert (g_queue_is_empty (&check.buffers));
+  g_mutex_unlock (&check.lock);
+
+  g_object_get (check.conv, "skipped-frames", &skipped, NULL);
+  g_assert_cmpuint (skipped, ==, FRAME_COUNT - 1);
+
+  element_check_stop (&check);
+}
+
+static void
+test_skip_unchanged (void)
+{
+  element_check_skip_unchanged ("vendor", 1);
+}
+
+/*
+ * With a deadline, frames the clock is already past are counted and
+ * dropped before they are converted, frames ahead of it go through.
+ */
+static void
+element_check_deadline (gboolean late)
+{
+  ElementCheck check;
+  GstClock *clock;
+  GstBuffer *buffer;
+  guint late_frames;
+  guint n;
+
+  if (!element_check_new (&check, "vendor", 1, FALSE)) {
+    return;
+  }
+
+  g_object_set (check.conv, "deadline", TRUE, NULL);
+  element_check_play (&check);
+
+  clock = gst_system_clock_obtain ();
+  gst_element_set_clock (check.conv, clock);
+  gst_element_set_base_time (check.conv, late ? 0 :
+      gst_clock_get_time (clock) + 60 * GST_SECOND);
+  gst_object_unref (clock);
+
+  for (n = 0; n < FRAME_COUNT; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+  }
+
+  for (n = 0; !late && n < FRAME_COUNT; n++) {
+    buffer = element_check_pull (&check);
+    g_assert_cmpuint (GST_BUFFER_PTS (buffer), ==,
+        gst_util_uint64_scale (n, GST_SECOND, 30));
+    element_check_frame (&check, buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  /* Vendor scheduling pushes from the chain function, nothing is left. */
+  g_mutex_lock (&check.lock);
+  g_assert (g_queue_is_empty (&check.buffers));
+  g_mutex_unlock (&check.lock);
+
+  g_object_get (check.conv, "late-frames", &late_frames, NULL);
+  g_assert_cmpuint (late_frames, ==, late ? FRAME_COUNT : 0);
+
+  element_check_stop (&check);
+}
+
+static gboolean
+element_check_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY) {
+    return gst_pad_query_default (pad, parent, query);
+  }
+
+  gst_query_set_latency (query, TRUE, UPSTREAM_MIN_LATENCY,
+      UPSTREAM_MAX_LATENCY);
+
+  return TRUE;
+}
+
+static void
+element_check_query_latency (ElementCheck * check, GstClockTime * min,
+    GstClockTime * max)
+{
+  GstQuery *query = gst_query_new_latency ();
+  gboolean live;
+
+  g_assert (gst_pad_peer_query (check->sink, query));
+  gst_query_parse_latency (query, &live, min, max);
+  g_assert (live);
+  gst_query_unref (query);
+}
+
+/*
+ * Latency queries add nothing before the warm-up. A configured latency is
+ * added to upstream's minimum, and to its maximum along with a frame for
+ * each one a stream may hold.
+ */
+static void
+element_check_latency (const gchar * scheduling, guint cpu_threads,
+    guint depth)
+{
+  ElementCheck check;
+  GstClockTime min;
+  GstClockTime max;
+
+  if (!element_check_new (&check, scheduling, cpu_threads, FALSE)) {
+    return;
+  }
+
+  gst_pad_set_query_function (check.src, element_check_src_query);
+  element_check_play (&check);
+
+  element_check_query_latency (&check, &min, &max);
+  g_assert_cmpuint (min, ==, UPSTREAM_MIN_LATENCY);
+  g_assert_cmpuint (max, ==, UPSTREAM_MAX_LATENCY);
+
+  g_object_set (check.conv, "latency", (guint64) CONV_LATENCY, NULL);
+  element_check_query_latency (&check, &min, &max);
+  g_assert_cmpuint (min, ==, UPSTREAM_MIN_LATENCY + CONV_LATENCY);
+  g_assert_cmpuint (max, ==, UPSTREAM_MAX_LATENCY + CONV_LATENCY +
+      depth * gst_util_uint64_scale_int (GST_SECOND, 1, 30));
+
+  element_check_stop (&check);
+}
+
+static void
+test_latency_query (void)
+{
+  element_check_latency ("vendor", 1, 0);
+}
+
+/* With two CPU threads a stream holds three frames. */
+static void
+test_hybrid_latency_query (void)
+{
+  element_check_latency ("hybrid", 2, 3);
+}
+
+static void
+test_deadline_late (void)
+{
+  element_check_deadline (TRUE);
+}
+
+static void
+test_deadline_ahead (void)
+{
+  element_check_deadline (FALSE);
+}
+
+static void
+test_hybrid_skip_unchanged (void)
+{
+  element_check_skip_unchanged ("hybrid", 3);
+}
+
+/* Gives the element a bus to post snapshot messages on. */
+static GstBus *
+element_check_bus (ElementCheck * check)
+{
+  GstBus *bus = gst_bus_new ();
+
+  gst_element_set_bus (check->conv, bus);
+
+  return bus;
+}
+
+/* Waits for the next element message, which has to be a snapshot. */
+static GstSample *
+element_check_snapshot (GstBus * bus)
+{
+  GstMessage *message;
+  GstSample *sample = NULL;
+
+  message = gst_bus_timed_pop_filtered (bus, PULL_TIMEOUT * GST_USECOND,
+      GST_MESSAGE_ELEMENT);
+  g_assert (message != NULL);
+  g_assert (gst_structure_has_name (gst_message_get_structure (message),
+          "colorconv-snapshot"));
+  g_assert (gst_structure_get (gst_message_get_structure (message),
+          "sample", GST_TYPE_SAMPLE, &sample, NULL));
+  gst_message_unref (message);
+
+  return sample;
+}
+
+/*
+ * With I420 output the action signal posts the frames that are pushed,
+ * not a second conversion of them.
+ */
+static void
+test_snapshot_output (void)
+{
+  ElementCheck check;
+  GstBuffer *buffers[3];
+  GstSample *sample;
+  GstBus *bus;
+  guint n;
+
+  if (!element_check_new (&check, "vendor", 1, FALSE)) {
+    return;
+  }
+
+  bus = element_check_bus (&check);
+  element_check_play (&check);
+  g_signal_emit_by_name (check.conv, "snapshot", 2);
+
+  for (n = 0; n < G_N_ELEMENTS (buffers); n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+    buffers[n] = element_check_pull (&check);
+  }
+
+  for (n = 0; n < 2; n++) {
+    sample = element_check_snapshot (bus);
+    g_assert (gst_sample_get_buffer (sample) == buffers[n]);
+    element_check_i420 (gst_sample_get_caps (sample),
+        gst_sample_get_buffer (sample));
+    gst_sample_unref (sample);
+  }
+
+  g_assert (gst_bus_pop_filtered (bus, GST_MESSAGE_ELEMENT) == NULL);
+
+  for (n = 0; n < G_N_ELEMENTS (buffers); n++) {
+    gst_buffer_unref (buffers[n]);
+  }
+
+  element_check_stop (&check);
+  gst_object_unref (bus);
+}
+
+/* With native output the frame is converted for the message alone. */
+static void
+element_check_snapshot_native (const gchar * scheduling, int width,
+    int height)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  GstSample *sample;
+  GstBus *bus;
+  guint n;
+
+  if (!element_check_new_size (&check, scheduling, 1, FALSE, width,
+          height)) {
+    return;
+  }
+
+  gst_object_unref (check.sink);
+  check.sink = gst_pad_new_from_static_template (&native_sink_template,
+      "sink");
+  gst_pad_set_element_private (check.sink, &check);
+  gst_pad_set_chain_function (check.sink, element_check_chain);
+
+  bus = element_check_bus (&check);
+  element_check_play (&check);
+  g_signal_emit_by_name (check.conv, "snapshot", 1);
+
+  for (n = 0; n < 2; n++) {
+    g_assert_cmpint (element_check_push (&check, n), ==, GST_FLOW_OK);
+    buffer = element_check_pull (&check);
+    g_assert_cmpuint (gst_buffer_get_size (buffer), ==,
+        sizeof (check.handle));
+    gst_buffer_unref (buffer);
+  }
+
+  sample = element_check_snapshot (bus);
+  g_assert_cmpuint (GST_BUFFER_PTS (gst_sample_get_buffer (sample)), ==, 0);
+  element_check_i420 (gst_sample_get_caps (sample),
+      gst_sample_get_buffer (sample));
+  gst_sample_unref (sample);
+
+  g_assert (gst_bus_pop_filtered (bus, GST_MESSAGE_ELEMENT) == NULL);
+
+  element_check_stop (&check);
+  gst_object_unref (bus);
+}
+
+static void
+test_snapshot_native (void)
+{
+  element_check_snapshot_native ("vendor", FRAME_WIDTH, FRAME_HEIGHT);
+}
+
+/*
+ * The CPU reads the frame through the layout probed for the snapshot, and
+ * pads rows that are not a multiple of 8 through a scratch frame.
+ */
+static void
+test_cpu_snapshot_native (void)
+{
+  element_check_snapshot_native ("cpu", 18, 10);
+}
+
+/*
+ * A buffer of system memory under native caps is refused, its bytes are
+ * never taken for a gralloc handle.
+ */
+static void
+test_not_native (void)
+{
+  ElementCheck check;
+  GstBuffer *buffer;
+  GstMessage *message;
+  GstBus *bus;
+
+  if (!element_check_new (&check, "cpu", 1, FALSE)) {
+    return;
+  }
+
+  bus = element_check_bus (&check);
+  element_check_play (&check);
+
+  buffer = gst_buffer_new_allocate (NULL, 2 * sizeof (check.handle), NULL);
+  gst_buffer_memset (buffer, 0, 0xff, 2 * sizeof (check.handle));
+  g_assert_cmpint (gst_pad_push (check.src, buffer), ==,
+      GST_FLOW_NOT_NEGOTIATED);
+
+  message = gst_bus_pop_filtered (bus, GST_MESSAGE_ERROR);
+  g_assert (message != NULL);
+  gst_message_unref (message);
+
+  element_check_stop (&check);
+  gst_object_unref (bus);
+}
+
+static void
+test_read_strategy_auto (void)
+{
+  gboolean bounce;
+
+  if (!element_check_read_probe (0, &bounce)) {
+    return;
+  }
+
+  /* Any mapping is at least as slow as cache, none is that slow. */
+  g_assert (bounce);
+  g_assert (element_check_read_probe (G_MAXDOUBLE, &bounce));
+  g_assert (!bounce);
+}
+#endif
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+
+  GST_DEBUG_CATEGORY_INIT (colorconv_debug, "colorconv", 0,
+      "colorconv tests");
+
+#if GST_CHECK_VERSION (1,0,0)
+  g_test_add_func ("/element/vendor-fallback", test_vendor_fallback);
+  g_test_add_func ("/element/hybrid-fallback", test_hybrid_fallback);
+  g_test_add_func ("/element/allocation-query", test_allocation_query);
+  g_test_add_func ("/element/video-meta", test_video_meta);
+  g_test_add_func ("/element/default-strides", test_default_strides);
+  g_test_add_func ("/element/native-branches", test_native_branches);
+  g_test_add_func ("/element/native-unlinked", test_native_unlinked);
+  g_test_add_func ("/element/native-decimation", test_native_decimation);
+  g_test_add_func ("/element/read-strategy-auto", test_read_strategy_auto);
+  g_test_add_func ("/element/snapshot-output", test_snapshot_output);
+  g_test_add_func ("/element/skip-unchanged", test_skip_unchanged);
+  g_test_add_func ("/element/hybrid-skip-unchanged",
+      test_hybrid_skip_unchanged);
+  g_test_add_func ("/element/snapshot-native", test_snapshot_native);
+  g_test_add_func ("/element/cpu-snapshot-native", test_cpu_snapshot_native);
+  g_test_add_func ("/element/not-native", test_not_native);
+  g_test_add_func ("/element/deadline-late", test_deadline_late);
+  g_test_add_func ("/element/deadline-ahead", test_deadline_ahead);
+  g_test_add_func ("/element/latency-query", test_latency_query);
+  g_test_add_func ("/element/hybrid-latency-query",
+      test_hybrid_latency_query);
+#else
+  g_test_add_func ("/element/fd-pool", test_fd_pool);
+  g_test_add_func ("/element/skip-unchanged", test_skip_unchanged);
+#endif
+
+  return g_test_run ();
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Conversion backend for the element checks. It claims NV12 input and
+ * fails every frame so the element has to convert on the CPU.
+ */
+
+#include <gmodule.h>
+#include "gstcolorconvbackend.h"
+#include "gstcolorconvkernels.h"
+
+static gboolean
+fail_start (gpointer handle)
+{
+  return TRUE;
+}
+
+static gboolean
+fail_stop (gpointer handle)
+{
+  return TRUE;
+}
+
+static int
+fail_get_hal_format (gpointer handle)
+{
+  return GST_COLOR_CONV_FORMAT_NV12;
+}
+
+static void
+fail_destroy (gpointer handle)
+{
+}
+
+static gboolean
+fail_convert (gpointer handle, int width, int height, void *in_data,
+    void *out_data)
+{
+  return FALSE;
+}
+
+G_MODULE_EXPORT gboolean
+gst_color_conv_backend_get (GstColorConvBackend * backend)
+{
+  backend->handle = NULL;
+  backend->start = fail_start;
+  backend->stop = fail_stop;
+  backend->get_hal_format = fail_get_hal_format;
+  backend->destroy = fail_destroy;
+  backend->convert = fail_convert;
+
+  return TRUE;
+}
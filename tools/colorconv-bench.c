@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Times the CPU conversion for every format, common size and kernel set
+ * this CPU runs. Run it with "make bench".
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <glib.h>
+#include <string.h>
+#include "gstcolorconvkernels.h"
+
+/* Measurements are the best of this many runs */
+#define BENCH_RUNS 5
+
+static const struct
+{
+  const gchar *name;
+  int format;
+} formats[] = {
+  {"nv12", GST_COLOR_CONV_FORMAT_NV12},
+  {"nv21", GST_COLOR_CONV_FORMAT_NV21},
+  {"tiled", GST_COLOR_CONV_FORMAT_TILED},
+};
+
+static const int sizes[][2] = {
+  {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160},
+};
+
+static gchar *kernels_name = NULL;
+static gint duration = 200;
+
+static GOptionEntry entries[] = {
+  {"kernels", 'k', 0, G_OPTION_ARG_STRING, &kernels_name,
+      "Only time these CPU kernels", "NAME"},
+  {"time", 't', 0, G_OPTION_ARG_INT, &duration,
+      "Milliseconds spent on every measurement (default 200)", "MS"},
+  {NULL}
+};
+
+/* Best Mpix/s of a few runs */
+static gdouble
+measure (const GstColorConvKernels * kernels, int format, int width,
+    int height, const guint8 * in, guint8 * out)
+{
+  gdouble best = 0;
+  int run;
+
+  for (run = 0; run < BENCH_RUNS; run++) {
+    gint64 start = g_get_monotonic_time ();
+    gint64 elapsed;
+    guint n;
+
+    for (n = 0; (elapsed = g_get_monotonic_time () - start) <
+        duration * 1000 / BENCH_RUNS; n++) {
+      gst_color_conv_convert (kernels, format, width, height, in, out);
+    }
+
+    best = MAX (best, (gdouble) width * height * n / MAX (elapsed, 1));
+  }
+
+  return best;
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  const GstColorConvKernels *list[8];
+  guint n_kernels;
+  guint f, i, j;
+
+  context = g_option_context_new ("- time the CPU conversion");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (context);
+    return 1;
+  }
+
+  g_option_context_free (context);
+
+  if (kernels_name) {
+    list[0] = gst_color_conv_kernels_get_by_name (kernels_name);
+    if (!list[0]) {
+      g_printerr ("kernels %s are not supported here\n", kernels_name);
+      return 1;
+    }
+
+    n_kernels = 1;
+  } else {
+    n_kernels = gst_color_conv_kernels_get_supported (list,
+        G_N_ELEMENTS (list));
+  }
+
+  g_print ("%-28s %10s\n", "", "Mpix/s");
+
+  for (j = 0; j < G_N_ELEMENTS (sizes); j++) {
+    int width = sizes[j][0];
+    int height = sizes[j][1];
+    gsize in_size = gst_color_conv_input_size (GST_COLOR_CONV_FORMAT_TILED,
+        width, height);
+    guint8 *in = g_malloc (in_size);
+    guint8 *out = g_malloc (width * height * 3 / 2);
+
+    /* Fault the buffers in before the first measurement. */
+    memset (in, 0x80, in_size);
+    memset (out, 0, width * height * 3 / 2);
+
+    for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+      for (i = 0; i < n_kernels; i++) {
+        gchar *name = g_strdup_printf ("%s-%s-%dx%d", formats[f].name,
+            list[i]->name, width, height);
+        gdouble rate = measure (list[i], formats[f].format, width, height,
+            in, out);
+
+        g_print ("%-28s %10.1f\n", name, rate);
+        g_free (name);
+      }
+    }
+
+    g_free (out);
+    g_free (in);
+  }
+
+  return 0;
+}
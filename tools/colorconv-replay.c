@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Streams frames recorded with the colorconv capture-file property
+ * through a conversion backend or the CPU kernels as fast as it can and
+ * reports the throughput of the best loop. With --verify every frame is
+ * first checked against the scalar kernels, which makes it usable as a
+ * regression test on machines without the decoder.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <glib.h>
+#include <gmodule.h>
+#include <stdio.h>
+#include <string.h>
+#include "gstcolorconvbackend.h"
+#include "gstcolorconvkernels.h"
+#include "gstcolorconvcapture.h"
+
+static gchar *backend_path = NULL;
+static gchar *kernels_name = NULL;
+static gint loops = 10;
+static gboolean verify = FALSE;
+
+static GOptionEntry entries[] = {
+  {"backend", 'b', 0, G_OPTION_ARG_FILENAME, &backend_path,
+      "Convert with the backend module at PATH instead of the CPU kernels",
+      "PATH"},
+  {"kernels", 'k', 0, G_OPTION_ARG_STRING, &kernels_name,
+      "CPU kernels to convert with, the best supported ones by default",
+      "NAME"},
+  {"loops", 'n', 0, G_OPTION_ARG_INT, &loops,
+      "Times every file is converted (default 10)", "N"},
+  {"verify", 'v', 0, G_OPTION_ARG_NONE, &verify,
+      "Check every frame against the scalar kernels first", NULL},
+  {NULL}
+};
+
+typedef struct
+{
+  GstColorConvBackend *backend;
+  GModule *mod;
+  const GstColorConvKernels *kernels;
+  int hal_format;
+} Converter;
+
+static gboolean
+load_backend (Converter * conv, const gchar * path)
+{
+  _gst_color_conv_backend_get sym;
+
+  conv->mod = g_module_open (path, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+  if (!conv->mod) {
+    g_printerr ("failed to load backend: %s\n", g_module_error ());
+    return FALSE;
+  }
+
+  if (!g_module_symbol (conv->mod, BACKEND_SYMBOL_NAME, (gpointer *) & sym)) {
+    g_printerr ("invalid backend: %s\n", g_module_error ());
+    return FALSE;
+  }
+
+  conv->backend = g_new0 (GstColorConvBackend, 1);
+
+  if (!sym (conv->backend) || !conv->backend->start (conv->backend->handle)) {
+    g_printerr ("failed to start backend %s\n", path);
+    g_free (conv->backend);
+    conv->backend = NULL;
+    return FALSE;
+  }
+
+  conv->hal_format = conv->backend->get_hal_format (conv->backend->handle);
+
+  return TRUE;
+}
+
+static void
+unload_backend (Converter * conv)
+{
+  if (conv->backend) {
+    conv->backend->stop (conv->backend->handle);
+    conv->backend->destroy (conv->backend->handle);
+    g_free (conv->backend);
+  }
+
+  if (conv->mod) {
+    g_module_close (conv->mod);
+  }
+}
+
+/* Opaque frames only go to a backend, which reads them as captured. */
+static gboolean
+can_convert (Converter * conv, const GstColorConvCaptureFrame * frame)
+{
+  GstColorConvLayout layout;
+
+  if (conv->backend) {
+    return (int) frame->hal_format == conv->hal_format && frame->size > 0;
+  }
+
+  return gst_color_conv_can_convert (frame->hal_format)
+      && gst_color_conv_capture_frame_layout (frame, &layout);
+}
+
+static gboolean
+convert_kernels (const GstColorConvKernels * kernels,
+    const GstColorConvCaptureFrame * frame, const guint8 * data, guint8 * out)
+{
+  GstColorConvLayout layout;
+
+  if (!gst_color_conv_capture_frame_layout (frame, &layout)) {
+    return FALSE;
+  }
+
+  return gst_color_conv_convert_layout (kernels, frame->hal_format,
+      frame->width, frame->height, &layout, data, out, NULL, 0);
+}
+
+static gboolean
+convert (Converter * conv, const GstColorConvCaptureFrame * frame,
+    const guint8 * data, guint8 * out)
+{
+  if (conv->backend) {
+    return conv->backend->convert (conv->backend->handle, frame->width,
+        frame->height, (void *) data, out);
+  }
+
+  return convert_kernels (conv->kernels, frame, data, out);
+}
+
+static gsize
+output_size (const GstColorConvCaptureFrame * frame)
+{
+  return frame->width * frame->height +
+      2 * (frame->width / 2) * (frame->height / 2);
+}
+
+/* Returns the number of frames whose output differs from the scalar one */
+static guint
+verify_file (Converter * conv, GstColorConvCaptureReader * reader,
+    const gchar * path, gsize max_size)
+{
+  const GstColorConvKernels *scalar =
+      gst_color_conv_kernels_get_by_name ("scalar");
+  GstColorConvCaptureFrame frame;
+  const guint8 *data;
+  guint8 *out = g_malloc (max_size);
+  guint8 *expected = g_malloc (max_size);
+  guint index = 0;
+  guint failed = 0;
+
+  gst_color_conv_capture_reader_rewind (reader);
+
+  while (gst_color_conv_capture_reader_next (reader, &frame, &data)) {
+    gsize size = output_size (&frame);
+
+    if (can_convert (conv, &frame)
+        && convert_kernels (scalar, &frame, data, expected)) {
+      if (!convert (conv, &frame, data, out) || memcmp (out, expected, size)) {
+        g_printerr ("%s: frame %u (%ux%u, format 0x%x) differs\n", path,
+            index, frame.width, frame.height, frame.hal_format);
+        failed++;
+      }
+    }
+
+    index++;
+  }
+
+  g_free (expected);
+  g_free (out);
+
+  return failed;
+}
+
+static gboolean
+replay_file (Converter * conv, const gchar * path)
+{
+  GstColorConvCaptureReader *reader;
+  GstColorConvCaptureFrame frame;
+  const guint8 *data;
+  GError *error = NULL;
+  gsize max_size = 0;
+  guint frames = 0;
+  guint skipped = 0;
+  guint64 pixels = 0;
+  gint64 best = G_MAXINT64;
+  guint8 *out;
+  gboolean ret = TRUE;
+  int i;
+
+  reader = gst_color_conv_capture_reader_new (path, &error);
+  if (!reader) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  while (gst_color_conv_capture_reader_next (reader, &frame, &data)) {
+    if (!can_convert (conv, &frame)) {
+      skipped++;
+      continue;
+    }
+
+    max_size = MAX (max_size, output_size (&frame));
+    pixels += frame.width * frame.height;
+    frames++;
+  }
+
+  if (skipped) {
+    g_printerr ("%s: skipping %u frames in formats or layouts the converter "
+        "does not take\n", path, skipped);
+  }
+
+  if (!frames) {
+    g_printerr ("%s: no frames to convert\n", path);
+    gst_color_conv_capture_reader_free (reader);
+    return FALSE;
+  }
+
+  if (verify && verify_file (conv, reader, path, max_size) > 0) {
+    ret = FALSE;
+  }
+
+  out = g_malloc (max_size);
+
+  for (i = 0; i < loops; i++) {
+    gint64 start = g_get_monotonic_time ();
+
+    gst_color_conv_capture_reader_rewind (reader);
+
+    while (gst_color_conv_capture_reader_next (reader, &frame, &data)) {
+      if (can_convert (conv, &frame) && !convert (conv, &frame, data, out)) {
+        g_printerr ("%s: conversion failed\n", path);
+        ret = FALSE;
+      }
+    }
+
+    best = MIN (best, g_get_monotonic_time () - start);
+  }
+
+  best = MAX (best, 1);
+  g_print ("%s: %u frames, %.1f fps, %.1f Mpix/s\n", path, frames,
+      (gdouble) frames * G_USEC_PER_SEC / best, (gdouble) pixels / best);
+
+  g_free (out);
+  gst_color_conv_capture_reader_free (reader);
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  Converter conv;
+  int ret = 0;
+  int i;
+
+  context = g_option_context_new ("FILE... - replay colorconv captures");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (context);
+    return 1;
+  }
+
+  g_option_context_free (context);
+
+  if (argc < 2 || loops < 1) {
+    g_printerr ("usage: %s [OPTION...] FILE...\n", argv[0]);
+    return 1;
+  }
+
+  memset (&conv, 0, sizeof (conv));
+
+  conv.kernels = kernels_name ?
+      gst_color_conv_kernels_get_by_name (kernels_name) :
+      gst_color_conv_kernels_get ();
+  if (!conv.kernels) {
+    g_printerr ("kernels %s are not supported here\n", kernels_name);
+    return 1;
+  }
+
+  if (backend_path && !load_backend (&conv, backend_path)) {
+    unload_backend (&conv);
+    return 1;
+  }
+
+  g_print ("converting with %s\n", conv.backend ? backend_path :
+      conv.kernels->name);
+
+  for (i = 1; i < argc; i++) {
+    if (!replay_file (&conv, argv[i])) {
+      ret = 1;
+    }
+  }
+
+  unload_backend (&conv);
+
+  return ret;
+}